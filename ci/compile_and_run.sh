@@ -13,6 +13,7 @@ ARGS=(
   -D MFMG_ENABLE_DOCUMENTATION=OFF
   -D DEAL_II_DIR=${DEAL_II_DIR}
   -D MFMG_ENABLE_AMGX=ON
+  -D MFMG_ENABLE_MPI_SHARED_MEMORY=ON
   -D AMGX_DIR=${AMGX_DIR}
   -D CMAKE_CXX_FLAGS="-Wall -Wpedantic -Wextra -Wshadow -Werror"
   -D LAPACK_DIR=${OPENBLAS_DIR}
@@ -0,0 +1,26 @@
+#!/bin/bash
+# Build with the MPI profiling wrappers so that the whole test suite runs
+# through them. CUDA and coverage are left to compile_and_run.sh.
+set -e
+cd $1
+rm -rf build_mpi_profiling
+mkdir build_mpi_profiling && cd build_mpi_profiling
+ARGS=(
+  -D CMAKE_BUILD_TYPE=Debug
+  -D MFMG_ENABLE_TESTS=ON
+  -D MFMG_ENABLE_CUDA=OFF
+  -D MFMG_ENABLE_CLANGFORMAT=OFF
+  -D MFMG_ENABLE_COVERAGE=OFF
+  -D MFMG_ENABLE_DOCUMENTATION=OFF
+  -D DEAL_II_DIR=${DEAL_II_DIR}
+  -D MFMG_ENABLE_MPI_SHARED_MEMORY=ON
+  -D MFMG_ENABLE_MPI_PROFILING=ON
+  -D CMAKE_CXX_FLAGS="-Wall -Wpedantic -Wextra -Wshadow -Werror"
+  -D LAPACK_DIR=${OPENBLAS_DIR}
+  )
+cmake "${ARGS[@]}" ../
+make -j12
+export DEAL_II_NUM_THREADS=3
+ctest -j12 --no-compress-output -T Test
+
+exit 0
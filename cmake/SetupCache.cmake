@@ -10,6 +10,10 @@ FUNCTION(INITIALIZE_CACHE)
     BOOL "Enable test coverage")
   SET(MFMG_ENABLE_CUDA ${MFMG_ENABLE_CUDA} CACHE BOOL "Enable CUDA support")
   SET(MFMG_ENABLE_CUDA_MPI ${MFMG_ENABLE_CUDA_MPI} CACHE BOOL "Assume CUDA-aware MPI")
+  SET(MFMG_ENABLE_MPI_SHARED_MEMORY ${MFMG_ENABLE_MPI_SHARED_MEMORY} CACHE
+    BOOL "Use MPI-3 shared memory windows for on-node ghost exchanges")
+  SET(MFMG_ENABLE_MPI_PROFILING ${MFMG_ENABLE_MPI_PROFILING} CACHE
+    BOOL "Record the MPI communication of each level with the PMPI interface")
   SET(MFMG_ENABLE_DOCUMENTATION ${MFMG_ENABLE_DOCUMENTATION} CACHE
     BOOL "Build ReadTheDocs documentation")
   SET(MFMG_ENABLE_STACKTRACE ${MFMG_ENABLE_STACKTRACE} CACHE
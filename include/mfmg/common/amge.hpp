@@ -16,6 +16,7 @@
 #include <deal.II/dofs/dof_handler.h>
 #include <deal.II/lac/la_parallel_vector.h>
 #include <deal.II/lac/sparse_matrix.h>
+#include <deal.II/lac/sparsity_pattern.h>
 #include <deal.II/lac/trilinos_sparse_matrix.h>
 #include <deal.II/lac/trilinos_sparsity_pattern.h>
 
@@ -24,9 +25,22 @@
 #include <array>
 #include <map>
 #include <string>
+#include <tuple>
+#include <vector>
 
 namespace mfmg
 {
+/**
+ * Sizes, in number of cells, of the agglomerates of the current processor.
+ */
+struct AgglomerateStatistics
+{
+  unsigned int n_agglomerates = 0;
+  unsigned int min_size = 0;
+  unsigned int max_size = 0;
+  double mean_size = 0.;
+};
+
 template <int dim, typename VectorType>
 class AMGe
 {
@@ -36,10 +50,24 @@ public:
   /**
    * Flag cells to create agglomerates. This function returns the local number
    * of agglomerates that have been created.
+   *
+   * With the zoltan and metis partitioners, the sizes of the agglomerates can
+   * be balanced by setting "balance" to true. The agglomerates larger than
+   * "max_size_ratio" [default: 2] times the target size, i.e., the number of
+   * local cells divided by "n_agglomerates", are split along the cell graph
+   * and the agglomerates smaller than "min_size_ratio" [default: 0.5] times
+   * the target size are merged into their smallest neighbor. If "verbosity"
+   * is positive, the size statistics are printed.
    */
   unsigned int
   build_agglomerates(boost::property_tree::ptree const &ptree) const;
 
+  /**
+   * Return the statistics of the sizes of the agglomerates built by
+   * build_agglomerates().
+   */
+  AgglomerateStatistics compute_agglomerate_statistics() const;
+
   /**
    * Return the interior agglomerates (agglomerates made of cells at the
    * boundary of the base agglomerates) and the halo agglomerates (agglomerates
@@ -122,6 +150,30 @@ public:
           &delta_eigenvector_matrix) const;
 
 protected:
+  /**
+   * Compute the sparsity pattern of the restriction matrix from the
+   * agglomeration, i.e., before any eigenvector has been computed. The
+   * agglomerate of id i built by build_agglomerates() contributes
+   * \p n_agglomerate_eigenvectors[i-1] consecutive rows, ordered by
+   * agglomerate id, whose entries are the dofs of the cells of the
+   * agglomerate.
+   */
+  dealii::TrilinosWrappers::SparsityPattern
+  compute_restriction_sparsity_pattern(
+      std::vector<unsigned int> const &n_agglomerate_eigenvectors) const;
+
+  /**
+   * Compute the sparsity pattern of the restriction matrix from the
+   * eigenvectors of the agglomerates, their dof maps \p dof_indices_maps, and
+   * their number of eigenvectors \p n_local_eigenvectors.
+   */
+  dealii::TrilinosWrappers::SparsityPattern
+  compute_restriction_sparsity_pattern(
+      std::vector<dealii::Vector<double>> const &eigenvectors,
+      std::vector<std::vector<dealii::types::global_dof_index>> const
+          &dof_indices_maps,
+      std::vector<unsigned int> const &n_local_eigenvectors) const;
+
   MPI_Comm _comm;
   dealii::DoFHandler<dim> const &_dof_handler;
 
@@ -137,19 +189,38 @@ private:
   /**
    * Flag cells to create agglomerates. \p partitioner_type is the partitioner
    * used (zoltan or metis) and \p n_agglomerates is the local number of
-   * agglomerates that we would like to have. This function returns the local
-   * number of agglomerates that have been created.
+   * agglomerates that we would like to have. If \p balance is true, the
+   * partition is post-processed by balance_agglomerates(). This function
+   * returns the local number of agglomerates that have been created.
    */
-  unsigned int
-  build_agglomerates_partitioner(std::string const &partitioner_type,
-                                 unsigned int n_agglomerates) const;
+  unsigned int build_agglomerates_partitioner(
+      std::string const &partitioner_type, unsigned int n_agglomerates,
+      bool const balance, double const min_size_ratio,
+      double const max_size_ratio) const;
 
-  dealii::TrilinosWrappers::SparsityPattern
-  compute_restriction_sparsity_pattern(
-      std::vector<dealii::Vector<double>> const &eigenvectors,
-      std::vector<std::vector<dealii::types::global_dof_index>> const
-          &dof_indices_maps,
-      std::vector<unsigned int> const &n_local_eigenvectors) const;
+  /**
+   * Balance the partition \p partition_indices of the graph \p
+   * cell_connectivity. The parts larger than \p max_size cells are split in
+   * parts of at most \p target_size and \p max_size cells by cutting a
+   * breadth-first ordering of their cells that starts from a peripheral cell.
+   * Then, the parts smaller than \p min_size cells are merged, from the
+   * smallest to the largest, into their smallest neighboring part, so a merged
+   * part may have more than \p max_size cells. The part indices are not
+   * consecutive afterwards.
+   */
+  static void
+  balance_agglomerates(dealii::SparsityPattern const &cell_connectivity,
+                       unsigned int const target_size,
+                       unsigned int const min_size,
+                       unsigned int const max_size,
+                       std::vector<unsigned int> &partition_indices);
+
+  /**
+   * Return the rows of the restriction matrix owned by the current processor
+   * and the number of rows owned by the processors of lower rank.
+   */
+  std::tuple<dealii::IndexSet, dealii::types::global_dof_index>
+  compute_restriction_row_indexset(unsigned int const n_local_rows) const;
 
   /**
    * This function contains the implementation that is common between the other
@@ -24,8 +24,12 @@
 #include <deal.II/numerics/data_out.h>
 
 #include <algorithm>
+#include <cmath>
 #include <fstream>
+#include <iostream>
+#include <limits>
 #include <map>
+#include <numeric>
 #include <unordered_map>
 
 #ifdef DEAL_II_TRILINOS_WITH_ZOLTAN
@@ -63,9 +67,24 @@ unsigned int AMGe<dim, VectorType>::build_agglomerates(
 #endif
     unsigned int const n_desired_agglomerates =
         ptree.get<unsigned int>("n_agglomerates");
+    bool const balance = ptree.get("balance", false);
+    double const min_size_ratio = ptree.get("min_size_ratio", 0.5);
+    double const max_size_ratio = ptree.get("max_size_ratio", 2.);
+    ASSERT_THROW(min_size_ratio <= max_size_ratio,
+                 "min_size_ratio must not be larger than max_size_ratio");
+
+    build_agglomerates_partitioner(partitioner_type, n_desired_agglomerates,
+                                   balance, min_size_ratio, max_size_ratio);
+    if (ptree.get("verbosity", 0) > 0)
+    {
+      auto const statistics = compute_agglomerate_statistics();
+      std::cout << "agglomerates: " << statistics.n_agglomerates
+                << " min size: " << statistics.min_size
+                << " max size: " << statistics.max_size
+                << " mean size: " << statistics.mean_size << std::endl;
+    }
 
-    return build_agglomerates_partitioner(partitioner_type,
-                                          n_desired_agglomerates);
+    return _n_agglomerates;
   }
   else if (partitioner_type == "block")
   {
@@ -84,6 +103,29 @@ unsigned int AMGe<dim, VectorType>::build_agglomerates(
   return 0;
 }
 
+template <int dim, typename VectorType>
+AgglomerateStatistics
+AMGe<dim, VectorType>::compute_agglomerate_statistics() const
+{
+  std::vector<unsigned int> sizes(_n_agglomerates, 0);
+  for (auto cell : _dof_handler.active_cell_iterators())
+    if (cell->is_locally_owned())
+      ++sizes[cell->user_index() - 1];
+
+  AgglomerateStatistics statistics;
+  statistics.n_agglomerates = _n_agglomerates;
+  if (_n_agglomerates > 0)
+  {
+    statistics.min_size = *std::min_element(sizes.begin(), sizes.end());
+    statistics.max_size = *std::max_element(sizes.begin(), sizes.end());
+    statistics.mean_size =
+        static_cast<double>(std::accumulate(sizes.begin(), sizes.end(), 0u)) /
+        _n_agglomerates;
+  }
+
+  return statistics;
+}
+
 template <int dim, typename VectorType>
 std::pair<std::vector<std::vector<unsigned int>>,
           std::vector<std::vector<unsigned int>>>
@@ -500,7 +542,9 @@ unsigned int AMGe<dim, VectorType>::build_agglomerates_block(
 
 template <int dim, typename VectorType>
 unsigned int AMGe<dim, VectorType>::build_agglomerates_partitioner(
-    std::string const &partitioner_type, unsigned int n_agglomerates) const
+    std::string const &partitioner_type, unsigned int n_agglomerates,
+    bool const balance, double const min_size_ratio,
+    double const max_size_ratio) const
 {
   // We cannot use deal.II wrappers to create the agglomerates because
   //   1) the wrappers only works on serial Triangulation
@@ -563,6 +607,21 @@ unsigned int AMGe<dim, VectorType>::build_agglomerates_partitioner(
   dealii::SparsityTools::partition(cell_connectivity, n_agglomerates,
                                    partition_indices, partitioner);
 
+  // The partitioners only approximately balance the number of cells of the
+  // agglomerates.
+  if (balance && (n_agglomerates > 0))
+  {
+    double const target_size =
+        static_cast<double>(n_local_cells) / n_agglomerates;
+    balance_agglomerates(
+        cell_connectivity,
+        std::max(1u, static_cast<unsigned int>(std::round(target_size))),
+        static_cast<unsigned int>(std::ceil(min_size_ratio * target_size)),
+        std::max(1u,
+                 static_cast<unsigned int>(max_size_ratio * target_size)),
+        partition_indices);
+  }
+
   // Assign the agglomerate ID to all the locally owned cells. Zoltan does not
   // guarantee that the agglomerate IDs will consecutive so we need to
   // renumber them. The lowest agglomerate ID is one because zero is reserved
@@ -594,17 +653,129 @@ unsigned int AMGe<dim, VectorType>::build_agglomerates_partitioner(
 }
 
 template <int dim, typename VectorType>
-dealii::TrilinosWrappers::SparsityPattern
-AMGe<dim, VectorType>::compute_restriction_sparsity_pattern(
-    std::vector<dealii::Vector<double>> const &eigenvectors,
-    std::vector<std::vector<dealii::types::global_dof_index>> const
-        &dof_indices_maps,
-    std::vector<unsigned int> const &n_local_eigenvectors) const
+void AMGe<dim, VectorType>::balance_agglomerates(
+    dealii::SparsityPattern const &cell_connectivity,
+    unsigned int const target_size, unsigned int const min_size,
+    unsigned int const max_size, std::vector<unsigned int> &partition_indices)
+{
+  unsigned int const n_cells = partition_indices.size();
+
+  // Number the parts consecutively and list their cells
+  std::unordered_map<unsigned int, unsigned int> part_renumbering;
+  std::vector<std::vector<unsigned int>> parts;
+  std::vector<unsigned int> owner(n_cells);
+  for (unsigned int i = 0; i < n_cells; ++i)
+  {
+    auto const inserted =
+        part_renumbering.emplace(partition_indices[i], parts.size());
+    if (inserted.second)
+      parts.emplace_back();
+    owner[i] = inserted.first->second;
+    parts[owner[i]].push_back(i);
+  }
+
+  // Return the cells of a part in breadth-first order starting from the cell
+  // start. The connected components that do not contain start follow.
+  std::vector<bool> visited(n_cells, false);
+  auto breadth_first_order = [&](unsigned int const part,
+                                 unsigned int const start) {
+    std::vector<unsigned int> order;
+    order.reserve(parts[part].size());
+    auto visit = [&](unsigned int const root) {
+      visited[root] = true;
+      order.push_back(root);
+      for (unsigned int k = order.size() - 1; k < order.size(); ++k)
+        for (auto it = cell_connectivity.begin(order[k]);
+             it != cell_connectivity.end(order[k]); ++it)
+        {
+          unsigned int const j = it->column();
+          if ((owner[j] == part) && (visited[j] == false))
+          {
+            visited[j] = true;
+            order.push_back(j);
+          }
+        }
+    };
+    visit(start);
+    for (auto const cell : parts[part])
+      if (visited[cell] == false)
+        visit(cell);
+    for (auto const cell : order)
+      visited[cell] = false;
+
+    return order;
+  };
+
+  // Split the oversized parts. The breadth-first ordering starts from the
+  // last cell reached from an arbitrary cell, i.e., a cell on the periphery
+  // of the part, so the cut parts are slabs across the part.
+  unsigned int const n_initial_parts = parts.size();
+  for (unsigned int part = 0; part < n_initial_parts; ++part)
+  {
+    unsigned int const size = parts[part].size();
+    if (size <= max_size)
+      continue;
+
+    auto const order = breadth_first_order(
+        part, breadth_first_order(part, parts[part][0]).back());
+    unsigned int const slab_size = std::min(target_size, max_size);
+    unsigned int const n_slabs = (size + slab_size - 1) / slab_size;
+    parts[part].assign(order.begin(), order.begin() + size / n_slabs);
+    for (unsigned int slab = 1; slab < n_slabs; ++slab)
+    {
+      parts.emplace_back(order.begin() + slab * size / n_slabs,
+                         order.begin() + (slab + 1) * size / n_slabs);
+      for (auto const cell : parts.back())
+        owner[cell] = parts.size() - 1;
+    }
+  }
+
+  // Merge the undersized parts, from the smallest to the largest. A part is
+  // merged into its smallest neighbor to avoid creating oversized parts. A
+  // part without neighbor is left unchanged.
+  std::vector<unsigned int> by_size(parts.size());
+  std::iota(by_size.begin(), by_size.end(), 0);
+  std::stable_sort(by_size.begin(), by_size.end(),
+                   [&](unsigned int const a, unsigned int const b) {
+                     return parts[a].size() < parts[b].size();
+                   });
+  unsigned int const invalid = std::numeric_limits<unsigned int>::max();
+  for (auto const part : by_size)
+  {
+    if (parts[part].empty() || (parts[part].size() >= min_size))
+      continue;
+
+    unsigned int neighbor = invalid;
+    for (auto const cell : parts[part])
+      for (auto it = cell_connectivity.begin(cell);
+           it != cell_connectivity.end(cell); ++it)
+      {
+        unsigned int const other = owner[it->column()];
+        if ((other != part) &&
+            ((neighbor == invalid) ||
+             (parts[other].size() < parts[neighbor].size())))
+          neighbor = other;
+      }
+    if (neighbor == invalid)
+      continue;
+
+    for (auto const cell : parts[part])
+      owner[cell] = neighbor;
+    parts[neighbor].insert(parts[neighbor].end(), parts[part].begin(),
+                           parts[part].end());
+    parts[part].clear();
+  }
+
+  partition_indices = owner;
+}
+
+template <int dim, typename VectorType>
+std::tuple<dealii::IndexSet, dealii::types::global_dof_index>
+AMGe<dim, VectorType>::compute_restriction_row_indexset(
+    unsigned int const n_local_rows) const
 {
-  // Compute the row IndexSet
   int const n_procs = dealii::Utilities::MPI::n_mpi_processes(this->_comm);
   int const rank = dealii::Utilities::MPI::this_mpi_process(this->_comm);
-  unsigned int const n_local_rows(eigenvectors.size());
   std::vector<unsigned int> n_rows_per_proc(n_procs);
   n_rows_per_proc[rank] = n_local_rows;
   MPI_Allgather(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, &n_rows_per_proc[0], 1,
@@ -620,6 +791,23 @@ AMGe<dim, VectorType>::compute_restriction_sparsity_pattern(
   row_indexset.add_range(n_rows_before, n_rows_before + n_local_rows);
   row_indexset.compress();
 
+  return std::make_tuple(row_indexset, n_rows_before);
+}
+
+template <int dim, typename VectorType>
+dealii::TrilinosWrappers::SparsityPattern
+AMGe<dim, VectorType>::compute_restriction_sparsity_pattern(
+    std::vector<dealii::Vector<double>> const &eigenvectors,
+    std::vector<std::vector<dealii::types::global_dof_index>> const
+        &dof_indices_maps,
+    std::vector<unsigned int> const &n_local_eigenvectors) const
+{
+  // Compute the row IndexSet
+  dealii::IndexSet row_indexset;
+  dealii::types::global_dof_index n_rows_before;
+  std::tie(row_indexset, n_rows_before) =
+      compute_restriction_row_indexset(eigenvectors.size());
+
   // Build the sparsity pattern
   dealii::TrilinosWrappers::SparsityPattern sp(
       row_indexset, this->_dof_handler.locally_owned_dofs(), this->_comm);
@@ -642,6 +830,54 @@ AMGe<dim, VectorType>::compute_restriction_sparsity_pattern(
   return sp;
 }
 
+template <int dim, typename VectorType>
+dealii::TrilinosWrappers::SparsityPattern
+AMGe<dim, VectorType>::compute_restriction_sparsity_pattern(
+    std::vector<unsigned int> const &n_agglomerate_eigenvectors) const
+{
+  // The rows of each agglomerate start after the rows of the agglomerates of
+  // lower id.
+  unsigned int const n_agglomerates = n_agglomerate_eigenvectors.size();
+  std::vector<unsigned int> first_rows(n_agglomerates + 1, 0);
+  for (unsigned int i = 0; i < n_agglomerates; ++i)
+    first_rows[i + 1] = first_rows[i] + n_agglomerate_eigenvectors[i];
+
+  // Compute the row IndexSet
+  dealii::IndexSet row_indexset;
+  dealii::types::global_dof_index n_rows_before;
+  std::tie(row_indexset, n_rows_before) =
+      compute_restriction_row_indexset(first_rows.back());
+
+  // Build the sparsity pattern. The agglomerates are made of the locally owned
+  // cells whose user index is the agglomerate id, see
+  // build_agglomerate_triangulation(). The user index of the other cells is
+  // meaningless.
+  dealii::TrilinosWrappers::SparsityPattern sp(
+      row_indexset, this->_dof_handler.locally_owned_dofs(), this->_comm);
+
+  std::vector<dealii::types::global_dof_index> dof_indices(
+      _dof_handler.get_fe().dofs_per_cell);
+  for (auto cell : _dof_handler.active_cell_iterators())
+  {
+    if (!cell->is_locally_owned())
+      continue;
+
+    unsigned int const agglomerate_id = cell->user_index();
+    if ((agglomerate_id == 0) || (agglomerate_id > n_agglomerates))
+      continue;
+
+    cell->get_dof_indices(dof_indices);
+    for (unsigned int row = first_rows[agglomerate_id - 1];
+         row < first_rows[agglomerate_id]; ++row)
+      sp.add_entries(n_rows_before + row, dof_indices.begin(),
+                     dof_indices.end());
+  }
+
+  sp.compress();
+
+  return sp;
+}
+
 template <int dim, typename VectorType>
 void AMGe<dim, VectorType>::build_agglomerate_triangulation(
     std::vector<typename dealii::DoFHandler<dim>::active_cell_iterator> const
@@ -0,0 +1,80 @@
+/**************************************************************************
+ * Copyright (c) 2017-2019 by the mfmg authors                            *
+ * All rights reserved.                                                   *
+ *                                                                        *
+ * This file is part of the mfmg library. mfmg is distributed under a BSD *
+ * 3-clause license. For the licensing terms see the LICENSE file in the  *
+ * top-level directory                                                    *
+ *                                                                        *
+ * SPDX-License-Identifier: BSD-3-Clause                                  *
+ *************************************************************************/
+
+#ifndef MFMG_LANCZOS_BLOCK_LANCZOS_HPP
+#define MFMG_LANCZOS_BLOCK_LANCZOS_HPP
+
+#include <boost/property_tree/ptree.hpp>
+
+#include <tuple>
+#include <vector>
+
+namespace mfmg
+{
+
+//-----------------------------------------------------------------------------
+/// \brief Block Lanczos solver
+///
+/// Compute the smallest eigenpairs of a symmetric operator with a block
+/// Krylov method. A block of b vectors resolves eigenvalues of multiplicity up
+/// to b in a single run, whereas the single-vector Lanczos needs one deflation
+/// cycle per copy of the eigenvalue. The basis is fully reorthogonalized so no
+/// spurious copies of the eigenvalues appear, and the projected problem is
+/// solved with LAPACK.
+///
+/// The parameters are:
+///   - "num_eigenpairs": number of eigenpairs to compute
+///   - "block_size": number of vectors in a block [default: num_eigenpairs]
+///   - "max_iterations": maximum number of basis vectors, i.e., of operator
+///     applications
+///   - "tolerance": the iterations stop once the residuals of all the
+///     requested eigenpairs are below this value
+///   - "time_budget": wall-clock time in seconds after which the best
+///     available Ritz pairs are returned [default: 0, i.e., no limit]
+///
+/// The first vector of the starting block is the initial guess. The others
+/// are random perturbations of it that keep its zero entries, e.g., the ones
+/// associated with constrained dofs.
+
+template <typename OperatorType, typename VectorType>
+class BlockLanczos
+{
+public:
+  BlockLanczos(OperatorType const &op);
+
+  // Same as above but the basis vectors are stored in workspace, see Lanczos.
+  BlockLanczos(OperatorType const &op, std::vector<VectorType> &workspace);
+
+  BlockLanczos(BlockLanczos<OperatorType, VectorType> const &) = delete;
+  BlockLanczos<OperatorType, VectorType> &
+  operator=(BlockLanczos<OperatorType, VectorType> const &) = delete;
+
+  // Operations
+  std::tuple<std::vector<double>, std::vector<VectorType>>
+  solve(boost::property_tree::ptree const &params,
+        VectorType const &initial_guess) const;
+
+private:
+  OperatorType const &_op; // reference to operator object to use
+  std::vector<VectorType> *_workspace; // basis vectors, may be null
+
+  static double details_orthogonalize(std::vector<VectorType> const &basis,
+                                      int const n_basis, VectorType &v,
+                                      double *coefficients);
+
+  static std::tuple<std::vector<double>, std::vector<double>>
+  details_calc_ritz_pairs(std::vector<double> const &projected_matrix,
+                          int const ld, int const n_basis);
+};
+
+} // namespace mfmg
+
+#endif
@@ -0,0 +1,262 @@
+/**************************************************************************
+ * Copyright (c) 2017-2019 by the mfmg authors                            *
+ * All rights reserved.                                                   *
+ *                                                                        *
+ * This file is part of the mfmg library. mfmg is distributed under a BSD *
+ * 3-clause license. For the licensing terms see the LICENSE file in the  *
+ * top-level directory                                                    *
+ *                                                                        *
+ * SPDX-License-Identifier: BSD-3-Clause                                  *
+ *************************************************************************/
+
+#ifndef MFMG_LANCZOS_BLOCK_LANCZOS_TEMPLATE_HPP
+#define MFMG_LANCZOS_BLOCK_LANCZOS_TEMPLATE_HPP
+
+#include <mfmg/common/exceptions.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include "block_lanczos.hpp"
+#include "lanczos.templates.hpp"
+
+namespace mfmg
+{
+
+/// \brief Block Lanczos solver: constructor
+template <typename OperatorType, typename VectorType>
+BlockLanczos<OperatorType, VectorType>::BlockLanczos(OperatorType const &op)
+    : _op(op), _workspace(nullptr)
+{
+  ASSERT(_op.m() == _op.n(), "Operator must be square");
+}
+
+/// \brief Block Lanczos solver: constructor with a reusable workspace
+template <typename OperatorType, typename VectorType>
+BlockLanczos<OperatorType, VectorType>::BlockLanczos(
+    OperatorType const &op, std::vector<VectorType> &workspace)
+    : _op(op), _workspace(&workspace)
+{
+  ASSERT(_op.m() == _op.n(), "Operator must be square");
+}
+
+/// \brief Block Lanczos solver: perform block Lanczos solve
+template <typename OperatorType, typename VectorType>
+std::tuple<std::vector<double>, std::vector<VectorType>>
+BlockLanczos<OperatorType, VectorType>::solve(
+    boost::property_tree::ptree const &params,
+    VectorType const &initial_guess) const
+{
+  int const num_requested = params.get<int>("num_eigenpairs");
+  int const block_size = params.get<int>("block_size", num_requested);
+  int const maxit = params.get<int>("max_iterations");
+  double const tol = params.get<double>("tolerance");
+  double const time_budget = params.get<double>("time_budget", 0.);
+  auto const start_time = std::chrono::steady_clock::now();
+
+  int const n = _op.n();
+
+  ASSERT(num_requested >= 1,
+         "Number of computed eigenpairs must be positive");
+  ASSERT(num_requested <= n, "Number of computed eigenpairs must not exceed "
+                             "the dimension of the operator");
+  ASSERT(block_size >= 1, "Block Lanczos block size must be positive");
+  ASSERT(tol >= 0., "Block Lanczos tolerance must be non-negative");
+  ASSERT(maxit >= num_requested,
+         "Block Lanczos max iterations is too small to produce required "
+         "number of eigenvectors.");
+
+  // A remainder of the orthogonalization smaller than this, relative to the
+  // vector before orthogonalization, is considered to be in the span of the
+  // basis.
+  double const breakdown_tol = 1e-10;
+
+  // The operator is applied to at most maxit basis vectors and each
+  // application adds at most one vector to the basis. The last vector of the
+  // workspace is used as a temporary.
+  int const ld = std::min(n, maxit + block_size);
+  std::vector<VectorType> local_basis;
+  std::vector<VectorType> &basis =
+      _workspace != nullptr ? *_workspace : local_basis;
+  if (basis.size() < static_cast<size_t>(ld + 1))
+    basis.resize(ld + 1);
+  for (int i = 0; i <= ld; ++i)
+    if (static_cast<int>(basis[i].size()) != n)
+      basis[i].reinit(n, true);
+  VectorType &w = basis[ld];
+
+  // Coefficients of the projection of the operator on the basis, stored by
+  // columns: the column j contains the coefficients of op * basis[j].
+  std::vector<double> h(ld * ld, 0.);
+
+  // Add to the basis a random perturbation of the initial guess. The first
+  // vector added is the initial guess itself. Return false if the vector is in
+  // the span of the basis.
+  int n_basis = 0;
+  int seed = 0;
+  auto add_random_vector = [&]() {
+    VectorType &v = basis[n_basis];
+    v = initial_guess;
+    if (seed > 0)
+      internal::details_set_initial_guess(v, seed);
+    ++seed;
+    double const norm = v.l2_norm();
+    double const new_norm = details_orthogonalize(basis, n_basis, v, nullptr);
+    if (!(new_norm > breakdown_tol * norm))
+      return false;
+    v /= new_norm;
+    ++n_basis;
+    return true;
+  };
+
+  // Starting block. The number of attempts is bounded because the initial
+  // guess may have fewer non-zero entries than the block size.
+  for (int attempt = 0; attempt < 2 * block_size && n_basis < block_size &&
+                        n_basis < ld;
+       ++attempt)
+    add_random_vector();
+  ASSERT(n_basis > 0, "Block Lanczos initial guess must be non-zero");
+
+  std::vector<double> evals;
+  std::vector<double> evecs_projected; // flat array
+  int block_begin = 0;
+  int block_end = n_basis;
+  while (true)
+  {
+    // Apply the operator to the last block and orthogonalize the results
+    // against the basis. The remainders become the next block.
+    for (int j = block_begin; j < block_end; ++j)
+    {
+      _op.vmult(w, basis[j]);
+      double const norm = w.l2_norm();
+      double const new_norm =
+          details_orthogonalize(basis, n_basis, w, &h[ld * j]);
+      if (new_norm > breakdown_tol * norm && n_basis < ld)
+      {
+        w /= new_norm;
+        h[n_basis + ld * j] = new_norm;
+        std::swap(basis[n_basis], w);
+        ++n_basis;
+      }
+    }
+
+    // The projected operator is known on the vectors the operator has been
+    // applied to.
+    std::tie(evals, evecs_projected) =
+        details_calc_ritz_pairs(h, ld, block_end);
+
+    // The residual of a Ritz pair is the part of op * (basis * y) that is
+    // outside the basis, i.e., the coupling with the next block times the last
+    // block of y.
+    bool converged = block_end >= num_requested;
+    for (int i = 0; converged && i < num_requested; ++i)
+    {
+      double residual = 0.;
+      for (int k = block_end; k < n_basis; ++k)
+      {
+        double coupling = 0.;
+        for (int j = block_begin; j < block_end; ++j)
+          coupling += h[k + ld * j] * evecs_projected[j + block_end * i];
+        residual += coupling * coupling;
+      }
+      converged = std::sqrt(residual) <= tol;
+    }
+
+    // Once the time budget is exceeded, the best available Ritz pairs are
+    // returned even if they have not converged.
+    bool const time_budget_exceeded =
+        (time_budget > 0.) && (block_end >= num_requested) &&
+        (std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start_time)
+             .count() > time_budget);
+    if (converged || block_end >= maxit || time_budget_exceeded)
+      break;
+
+    // Complete the next block with random vectors if some directions were in
+    // the span of the basis. This is what allows the method to continue past
+    // an invariant subspace, e.g., when the initial block is smaller than the
+    // multiplicity of an eigenvalue.
+    for (int attempt = 0; attempt < 2 * block_size &&
+                          n_basis - block_end < block_size && n_basis < ld;
+         ++attempt)
+      add_random_vector();
+
+    // The basis spans the whole space.
+    if (n_basis == block_end)
+      break;
+
+    block_begin = block_end;
+    block_end = n_basis;
+  }
+
+  ASSERT(block_end >= num_requested,
+         "Internal error: required number of iterations not reached");
+
+  // Compute the Ritz vectors
+  evals.resize(num_requested);
+  std::vector<VectorType> evecs(num_requested, initial_guess);
+  for (int i = 0; i < num_requested; ++i)
+  {
+    evecs[i] = 0.;
+    for (int j = 0; j < block_end; ++j)
+      evecs[i].add(evecs_projected[j + block_end * i], basis[j]);
+  }
+
+  return std::make_tuple(evals, evecs);
+}
+
+/// \brief Block Lanczos solver: orthogonalize a vector against the basis
+///
+/// Classical Gram-Schmidt is not stable enough, so we use two passes of
+/// modified Gram-Schmidt. The coefficients are added to @p coefficients if it
+/// is not null. Return the norm of the orthogonalized vector.
+template <typename OperatorType, typename VectorType>
+double BlockLanczos<OperatorType, VectorType>::details_orthogonalize(
+    std::vector<VectorType> const &basis, int const n_basis, VectorType &v,
+    double *coefficients)
+{
+  for (int pass = 0; pass < 2; ++pass)
+    for (int i = 0; i < n_basis; ++i)
+    {
+      double const c = basis[i] * v;
+      v.add(-c, basis[i]);
+      if (coefficients != nullptr)
+        coefficients[i] += c;
+    }
+
+  return v.l2_norm();
+}
+
+/// \brief Block Lanczos solver: calculate the eigenpairs of the projected
+/// operator
+template <typename OperatorType, typename VectorType>
+std::tuple<std::vector<double>, std::vector<double>>
+BlockLanczos<OperatorType, VectorType>::details_calc_ritz_pairs(
+    std::vector<double> const &projected_matrix, int const ld,
+    int const n_basis)
+{
+  // DSYEV only reads the upper triangle, i.e., the coefficients of the vectors
+  // against the images of the same or of later vectors. It guarantees that
+  // the eigenvalues are returned in ascending order.
+  //   http://www.netlib.org/lapack/explore-html/dd/d4c/dsyev_8f.html
+  std::vector<double> evals(n_basis);
+  std::vector<double> evecs(n_basis * n_basis);
+  for (int j = 0; j < n_basis; ++j)
+    std::copy(projected_matrix.begin() + ld * j,
+              projected_matrix.begin() + ld * j + n_basis,
+              evecs.begin() + n_basis * j);
+
+  lapack_int const info =
+      LAPACKE_dsyev(LAPACK_COL_MAJOR, 'V', 'U', n_basis, evecs.data(), n_basis,
+                    evals.data());
+  ASSERT(!info, "Call to LAPACKE_dsyev failed.");
+
+  return std::make_tuple(evals, evecs);
+}
+
+} // namespace mfmg
+
+#endif
@@ -0,0 +1,84 @@
+/**************************************************************************
+ * Copyright (c) 2017-2019 by the mfmg authors                            *
+ * All rights reserved.                                                   *
+ *                                                                        *
+ * This file is part of the mfmg library. mfmg is distributed under a BSD *
+ * 3-clause license. For the licensing terms see the LICENSE file in the  *
+ * top-level directory                                                    *
+ *                                                                        *
+ * SPDX-License-Identifier: BSD-3-Clause                                  *
+ *************************************************************************/
+
+#ifndef MFMG_COMMUNICATION_PROFILER_HPP
+#define MFMG_COMMUNICATION_PROFILER_HPP
+
+#include <cstddef>
+#include <map>
+#include <ostream>
+#include <string>
+#include <utility>
+
+namespace mfmg
+{
+/**
+ * Communication counters of a (level, stage) pair. The messages are the
+ * point-to-point sends and receives; the received bytes are the sizes of the
+ * posted buffers. The time is the time spent inside MPI, including the time
+ * spent waiting for non-blocking requests.
+ */
+struct CommunicationStatistics
+{
+  std::size_t n_messages = 0;
+  std::size_t n_collectives = 0;
+  std::size_t n_bytes = 0;
+  double time = 0.;
+};
+
+/**
+ * Profiler that attributes the MPI communication of the calling process to a
+ * level of the Hierarchy and to a stage, e.g., the smoother or the
+ * restriction. When mfmg is configured with MFMG_ENABLE_MPI_PROFILING, the
+ * library defines the MPI functions used by deal.II, Trilinos, and mfmg
+ * itself, records the calls in the current (level, stage), and forwards them
+ * to the PMPI interface. Otherwise, no communication is recorded.
+ *
+ * The stages are nested: enter() pushes a stage and leave() pops it. The
+ * communication is attributed to the innermost stage. A negative level means
+ * that the stage belongs to the level of the enclosing stage. Every thread
+ * has its own stack of stages, so a task that runs on another thread must
+ * enter its own stage; the communication of a thread outside of any stage is
+ * attributed to level -1 and an empty stage. The counters are shared by all
+ * the threads and all the functions are thread-safe.
+ */
+class CommunicationProfiler
+{
+public:
+  using Key = std::pair<int, std::string>;
+
+  static void enter(int level, std::string const &stage);
+
+  static void leave();
+
+  /**
+   * Record a communication in the current stage. This is called by the MPI
+   * wrappers.
+   */
+  static void record(std::size_t n_messages, std::size_t n_collectives,
+                     std::size_t n_bytes, double time);
+
+  /**
+   * Return the counters of the calling process.
+   */
+  static std::map<Key, CommunicationStatistics> get_statistics();
+
+  static void reset();
+
+  /**
+   * Print the counters of the calling process, one (level, stage) pair per
+   * line.
+   */
+  static void print(std::ostream &out);
+};
+} // namespace mfmg
+
+#endif
@@ -12,6 +12,7 @@
 #ifndef MFMG_HIERARCHY_HPP
 #define MFMG_HIERARCHY_HPP
 
+#include <mfmg/common/communication_profiler.hpp>
 #include <mfmg/common/exceptions.hpp>
 #include <mfmg/common/level.hpp>
 #include <mfmg/common/mesh_evaluator.hpp>
@@ -24,6 +25,8 @@
 #include <mfmg/cuda/cuda_mesh_evaluator.cuh>
 #endif
 
+#include <deal.II/base/mpi.h>
+#include <deal.II/base/thread_management.h>
 #include <deal.II/base/timer.h>
 
 #include <boost/property_tree/ptree.hpp>
@@ -33,19 +36,44 @@
 
 namespace mfmg
 {
+// The communication of the timed sections is also attributed to them when
+// the MPI profiling is enabled.
 void timer_enter_subsection(std::shared_ptr<dealii::TimerOutput> const &timer,
                             std::string const &section)
 {
   if (timer)
     timer->enter_subsection(section);
+#ifdef MFMG_WITH_MPI_PROFILING
+  CommunicationProfiler::enter(-1, section);
+#endif
 }
 
 void timer_leave_subsection(std::shared_ptr<dealii::TimerOutput> const &timer)
 {
+#ifdef MFMG_WITH_MPI_PROFILING
+  CommunicationProfiler::leave();
+#endif
   if (timer)
     timer->leave_subsection();
 }
 
+inline void profiler_enter_stage(int level, std::string const &stage)
+{
+#ifdef MFMG_WITH_MPI_PROFILING
+  CommunicationProfiler::enter(level, stage);
+#else
+  (void)level;
+  (void)stage;
+#endif
+}
+
+inline void profiler_leave_stage()
+{
+#ifdef MFMG_WITH_MPI_PROFILING
+  CommunicationProfiler::leave();
+#endif
+}
+
 template <typename VectorType>
 std::unique_ptr<HierarchyHelpers<VectorType>>
 create_hierarchy_helpers(std::shared_ptr<MeshEvaluator const> evaluator)
@@ -162,26 +190,180 @@ public:
       : _timer(timer)
   {
     timer_enter_subsection(_timer, "Setup");
+
     // Replace by a factory
     auto hierarchy_helpers = create_hierarchy_helpers<VectorType>(evaluator);
 
     _is_preconditioner = params->get("is preconditioner", true);
     _n_smoothing_steps = params->get("smoother.n_smoothing_steps", 1);
 
+    std::string const cycle = params->get("cycle", "V");
+    ASSERT_THROW(cycle == "V" || cycle == "additive",
+                 "Unknown cycle type: \"" + cycle + "\"");
+    _is_additive = (cycle == "additive");
+    // With "concurrent setup", the smoothers and the coarse solver are built
+    // by tasks that overlap with the construction of the coarser levels. With
+    // "additive.concurrent levels", the corrections of the levels are computed
+    // concurrently. Both require full thread support from MPI. Each level
+    // whose operator can be copied then gets its own duplicate of the
+    // communicator: the level operator is replaced by a copy on this
+    // communicator, which is also used by the smoother, the coarse solver,
+    // and the vectors of the level. Thus, the messages and the collectives of
+    // a level cannot be matched with the ones of another level or of the main
+    // thread. The other levels, e.g., the matrix-free ones, keep the
+    // communicator of the hierarchy and are set up by the main thread.
+    int thread_support = MPI_THREAD_SINGLE;
+    MPI_Query_thread(&thread_support);
+    bool const concurrent_setup = params->get("concurrent setup", false) &&
+                                  (thread_support == MPI_THREAD_MULTIPLE);
+    bool const concurrent_levels =
+        _is_additive && params->get("additive.concurrent levels", false) &&
+        (thread_support == MPI_THREAD_MULTIPLE);
+    // Number of levels that use the communicator of the hierarchy
+    unsigned int n_shared_levels = 0;
+    auto isolate_level = [&](Level<VectorType> &level) {
+      if (!concurrent_setup && !concurrent_levels)
+        return false;
+      std::shared_ptr<MPI_Comm> level_comm(new MPI_Comm, [](MPI_Comm *c) {
+        int finalized = 0;
+        MPI_Finalized(&finalized);
+        if (!finalized)
+          MPI_Comm_free(c);
+        delete c;
+      });
+      *level_comm = dealii::Utilities::MPI::duplicate_communicator(comm);
+      auto level_operator =
+          level.get_operator()->copy_on_communicator(*level_comm);
+      if (level_operator == nullptr)
+        return false;
+      level.set_operator(level_operator);
+      _level_comms.push_back(level_comm);
+      return true;
+    };
+
+    // The smoothers and the coarse solver are not needed to build the coarser
+    // levels. Since TimerOutput sections cannot overlap, only the time spent
+    // waiting for the tasks is reported.
+    dealii::Threads::TaskGroup<void> setup_tasks;
+    auto build_level_solver = [&](Level<VectorType> &level,
+                                  bool const is_coarsest) {
+      bool const is_isolated = isolate_level(level);
+      if (!is_isolated)
+        ++n_shared_levels;
+      auto a = level.get_operator();
+      if (concurrent_setup && is_isolated)
+      {
+        // The task gets its own copy of the parameters because they are
+        // modified before the coarse solver is built.
+        auto task_params =
+            std::make_shared<boost::property_tree::ptree const>(*params);
+        auto helpers = hierarchy_helpers.get();
+        setup_tasks += dealii::Threads::new_task(
+            [helpers, a, task_params, is_coarsest, &level]() {
+              if (is_coarsest)
+                level.set_solver(helpers->build_coarse_solver(a, task_params));
+              else
+                level.set_smoother(helpers->build_smoother(a, task_params));
+            });
+      }
+      else if (is_coarsest)
+      {
+        timer_enter_subsection(_timer, "Setup: build coarse solver");
+        level.set_solver(hierarchy_helpers->build_coarse_solver(a, params));
+        timer_leave_subsection(_timer);
+      }
+      else
+      {
+        timer_enter_subsection(_timer, "Setup: build smoother");
+        level.set_smoother(hierarchy_helpers->build_smoother(a, params));
+        timer_leave_subsection(_timer);
+      }
+    };
+
     // TODO: add stopping criteria for levels (number of levels / coarse size)
     int const num_levels = params->get("max levels", 2);
     ASSERT(num_levels > 0, "number of levels specified by \"max levels\" "
                            "parameter must be positive");
-    _levels.resize(num_levels);
+
+    // With p-multigrid, the polynomial degree is first coarsened down to one.
+    // The mesh is then coarsened "geometric levels" times, and the AMGe
+    // levels, whose number is given by "max levels", are built on the coarsest
+    // rediscretized problem. The rediscretized levels stay matrix-free.
+    std::vector<std::shared_ptr<MeshEvaluator>> rediscretized_evaluators = {
+        evaluator};
+    std::vector<bool> is_geometric_level = {false};
+    if (params->get("p-multigrid", false))
+    {
+      timer_enter_subsection(_timer, "Setup: build p-multigrid evaluators");
+      while (auto coarser_evaluator =
+                 hierarchy_helpers->build_coarser_degree_evaluator(
+                     rediscretized_evaluators.back()))
+      {
+        rediscretized_evaluators.push_back(coarser_evaluator);
+        is_geometric_level.push_back(false);
+      }
+      timer_leave_subsection(_timer);
+    }
+    int const n_geometric_levels = params->get("geometric levels", 0);
+    ASSERT(n_geometric_levels >= 0, "number of levels specified by \"geometric "
+                                    "levels\" parameter must be non-negative");
+    if (n_geometric_levels > 0)
+    {
+      timer_enter_subsection(_timer, "Setup: build geometric evaluators");
+      for (int i = 0; i < n_geometric_levels; ++i)
+      {
+        rediscretized_evaluators.push_back(
+            hierarchy_helpers->build_coarser_mesh_evaluator(
+                rediscretized_evaluators.back()));
+        is_geometric_level.push_back(true);
+      }
+      timer_leave_subsection(_timer);
+    }
+    int const n_rediscretized_levels = rediscretized_evaluators.size() - 1;
+    _levels.resize(n_rediscretized_levels + num_levels);
 
     _levels[0].set_operator(hierarchy_helpers->get_global_operator(evaluator));
-    for (int level_index = 0; level_index < num_levels; level_index++)
+    for (int level_index = 0; level_index < n_rediscretized_levels;
+         ++level_index)
+    {
+      auto &level_fine = _levels[level_index];
+      auto &level_coarse = _levels[level_index + 1];
+
+      build_level_solver(level_fine, false);
+
+      auto const &fine_evaluator = rediscretized_evaluators[level_index];
+      auto const &coarse_evaluator = rediscretized_evaluators[level_index + 1];
+      std::shared_ptr<Operator<VectorType>> restrictor;
+      if (is_geometric_level[level_index + 1])
+      {
+        timer_enter_subsection(_timer, "Setup: build geometric restrictor");
+        restrictor = hierarchy_helpers->build_mesh_restrictor(
+            comm, fine_evaluator, coarse_evaluator);
+      }
+      else
+      {
+        timer_enter_subsection(_timer, "Setup: build p-multigrid restrictor");
+        restrictor = hierarchy_helpers->build_degree_restrictor(
+            comm, fine_evaluator, coarse_evaluator);
+      }
+      level_coarse.set_restrictor(restrictor);
+      timer_leave_subsection(_timer);
+
+      level_coarse.set_operator(
+          hierarchy_helpers->get_global_operator(coarse_evaluator));
+    }
+
+    auto amge_evaluator = rediscretized_evaluators.back();
+    for (int level_index = n_rediscretized_levels;
+         level_index < n_rediscretized_levels + num_levels; level_index++)
     {
       auto &level_fine = _levels[level_index];
 
+      // The main thread keeps using the operator on the communicator of the
+      // hierarchy even if the level is moved to its own communicator.
       auto a = level_fine.get_operator();
 
-      if (level_index == num_levels - 1)
+      if (level_index == n_rediscretized_levels + num_levels - 1)
       {
         if (level_index == 0)
         {
@@ -190,24 +372,18 @@ public:
                       _is_preconditioner);
         }
 
-        timer_enter_subsection(_timer, "Setup: build coarse solver");
-        auto coarse_solver = hierarchy_helpers->build_coarse_solver(a, params);
-        level_fine.set_solver(coarse_solver);
-        timer_leave_subsection(_timer);
+        build_level_solver(level_fine, true);
 
         break;
       }
 
       auto &level_coarse = _levels[level_index + 1];
 
-      timer_enter_subsection(_timer, "Setup: build smoother");
-      auto smoother = hierarchy_helpers->build_smoother(a, params);
-      level_fine.set_smoother(smoother);
-      timer_leave_subsection(_timer);
+      build_level_solver(level_fine, false);
 
       timer_enter_subsection(_timer, "Setup: build restrictor");
       auto restrictor =
-          hierarchy_helpers->build_restrictor(comm, evaluator, params);
+          hierarchy_helpers->build_restrictor(comm, amge_evaluator, params);
       level_coarse.set_restrictor(restrictor);
       timer_leave_subsection(_timer);
 
@@ -230,8 +406,68 @@ public:
       auto a_coarse = restrictor->multiply(ap);
       timer_leave_subsection(_timer);
 
+      // Non-Galerkin coarse operator: the weak entries of the Galerkin
+      // operator are lumped to the diagonal to limit the fill-in of the
+      // coarser levels. The lumping can only increase the energy of the
+      // operator, by at most "safeguard" times its diagonal.
+      double const drop_tolerance =
+          params->get("sparsification.drop_tolerance", 0.);
+      if (drop_tolerance > 0.)
+      {
+        timer_enter_subsection(_timer, "Setup: sparsify coarse matrix");
+        a_coarse = a_coarse->sparsify(
+            drop_tolerance, params->get("sparsification.safeguard", 0.5));
+        timer_leave_subsection(_timer);
+      }
+
       level_coarse.set_operator(a_coarse);
     }
+
+    if (concurrent_setup)
+    {
+      timer_enter_subsection(_timer, "Setup: wait for smoothers");
+      setup_tasks.join_all();
+      timer_leave_subsection(_timer);
+    }
+    // The levels that use the communicator of the hierarchy cannot be
+    // processed concurrently with each other.
+    _concurrent_levels = concurrent_levels && (n_shared_levels <= 1);
+
+    // The V-cycle restricts the residual of the level operators and both
+    // cycles apply the transpose of the restrictors. The data used by these
+    // kernels are built now because building them is collective.
+    timer_enter_subsection(_timer, "Setup: transfer kernels");
+    for (unsigned int i = 1; i < _levels.size(); ++i)
+    {
+      if (!_is_additive)
+        _levels[i - 1].get_operator()->setup_transfer(OperatorMode::NO_TRANS);
+      _levels[i].get_restrictor()->setup_transfer(OperatorMode::TRANS);
+    }
+    timer_leave_subsection(_timer);
+
+    // The vectors of the cycles are allocated once instead of at every
+    // application. Now that the transfer kernels are set up, the operators
+    // zero new vectors with the threads that apply them, e.g., the Trilinos
+    // operators by the blocks of rows of their kernels, so the pages are
+    // first touched by these threads rather than all by the main thread. The
+    // V-cycle does not use the vectors of the finest level.
+    timer_enter_subsection(_timer, "Setup: allocate vectors");
+    unsigned int const n_levels = _levels.size();
+    _residuals.resize(n_levels);
+    _corrections.resize(n_levels);
+    for (unsigned int i = _is_additive ? 0 : 1; i < n_levels; ++i)
+    {
+      _residuals[i] = _levels[i].build_vector();
+      _corrections[i] = _levels[i].build_vector();
+    }
+    if (!_is_additive)
+    {
+      _restriction_residuals.resize(n_levels - 1);
+      for (unsigned int i = 0; i < n_levels - 1; ++i)
+        _restriction_residuals[i] =
+            _levels[i].get_operator()->build_range_vector();
+    }
+    timer_leave_subsection(_timer);
     timer_leave_subsection(_timer);
   }
 
@@ -245,12 +481,19 @@ public:
 
   void apply(VectorType const &b, VectorType &x, int level_index = 0) const
   {
+    if (_is_additive)
+    {
+      apply_additive(b, x);
+      return;
+    }
+
     auto const num_levels = _levels.size();
 
     auto &level_fine = _levels[level_index];
     auto a = level_fine.get_operator();
 
-    if (level_index > 0 || _is_preconditioner)
+    bool const zero_initial_guess = (level_index > 0 || _is_preconditioner);
+    if (zero_initial_guess)
     {
       // Zero out any garbage in x.
       // The only exception is when it's the finest level in a standalone
@@ -263,7 +506,9 @@ public:
       timer_enter_subsection(_timer, "Apply: coarsest level");
       // Coarsest level
       auto coarse_solver = level_fine.get_solver();
+      profiler_enter_stage(level_index, "coarse solver");
       coarse_solver->apply(b, x);
+      profiler_leave_stage();
       timer_leave_subsection(_timer);
     }
     else
@@ -273,37 +518,43 @@ public:
 
       auto restrictor = level_coarse.get_restrictor();
 
-      // apply pre-smoother
+      // apply pre-smoother. When x is zero, the first sweep does not need to
+      // apply the operator.
       auto smoother = level_fine.get_smoother();
+      profiler_enter_stage(level_index, "smoother");
       for (unsigned int i = 0; i < _n_smoothing_steps; ++i)
-        smoother->apply(b, x);
+        if (i == 0 && zero_initial_guess)
+          smoother->apply_zero_initial_guess(b, x);
+        else
+          smoother->apply(b, x);
+      profiler_leave_stage();
 
-      // compute residual
+      // compute and restrict residual
       // NOTE: we compute negative residual -r = Ax-b, so that we can avoid
-      // using sadd and can just use add
-      auto res = level_fine.build_vector();
-      a->apply(x, *res);
-      res->add(-1., b);
-
-      // restrict residual
-      auto b_coarse = level_coarse.build_vector();
-      restrictor->apply(*res, *b_coarse);
+      // using sadd and can just use add. The restrictor is responsible for
+      // computing the residual, which allows it to avoid storing it.
+      auto &b_coarse = *_residuals[level_index + 1];
+      profiler_enter_stage(level_index, "restriction");
+      restrictor->restrict_residual(*a, x, b, b_coarse,
+                                    *_restriction_residuals[level_index]);
+      profiler_leave_stage();
 
       // compute coarse grid correction
-      auto x_coarse = level_coarse.build_vector();
-      apply(*b_coarse, *x_coarse, level_index + 1);
+      auto &x_coarse = *_corrections[level_index + 1];
+      apply(b_coarse, x_coarse, level_index + 1);
 
       // update solution
-      auto x_correction = level_fine.build_vector();
-      restrictor->apply(*x_coarse, *x_correction, OperatorMode::TRANS);
-
       // NOTE: as we used negative residual, we subtract instead of adding
       // here
-      x.add(-1., *x_correction);
+      profiler_enter_stage(level_index, "prolongation");
+      restrictor->apply_add(x_coarse, x, -1., OperatorMode::TRANS);
+      profiler_leave_stage();
 
       // apply post-smoother
+      profiler_enter_stage(level_index, "smoother");
       for (unsigned int i = 0; i < _n_smoothing_steps; ++i)
         smoother->apply(b, x);
+      profiler_leave_stage();
       timer_leave_subsection(_timer);
     }
   }
@@ -366,10 +617,105 @@ public:
   }
 
 private:
+  /**
+   * Apply an additive (BPX-style) cycle. The residual is restricted to every
+   * level, the corrections of all the levels are computed independently from
+   * these residuals, and the sum of the prolongated corrections is added to
+   * \p x. With "additive.concurrent levels", the level corrections are
+   * computed concurrently if MPI supports multiple threads and at most one
+   * level uses the communicator of the hierarchy. The other levels
+   * communicate on their own communicator. This cycle should be used as a
+   * preconditioner.
+   */
+  void apply_additive(VectorType const &b, VectorType &x) const
+  {
+    auto const num_levels = _levels.size();
+
+    if (_is_preconditioner)
+      x = 0.;
+
+    // NOTE: as in the V-cycle, we use the negative residual -r = Ax-b
+    timer_enter_subsection(_timer, "Apply: additive restriction");
+    auto const &residuals = _residuals;
+    profiler_enter_stage(0, "residual");
+    _levels[0].get_operator()->apply(x, *residuals[0]);
+    residuals[0]->add(-1., b);
+    profiler_leave_stage();
+    for (unsigned int i = 1; i < num_levels; ++i)
+    {
+      profiler_enter_stage(i - 1, "restriction");
+      _levels[i].get_restrictor()->apply(*residuals[i - 1], *residuals[i]);
+      profiler_leave_stage();
+    }
+    timer_leave_subsection(_timer);
+
+    timer_enter_subsection(_timer, "Apply: additive corrections");
+    auto const &corrections = _corrections;
+    auto compute_correction = [&](unsigned int const i) {
+      *corrections[i] = 0.;
+      if (i == num_levels - 1)
+        _levels[i].get_solver()->apply(*residuals[i], *corrections[i]);
+      else
+        for (unsigned int j = 0; j < _n_smoothing_steps; ++j)
+          if (j == 0)
+            _levels[i].get_smoother()->apply_zero_initial_guess(
+                *residuals[i], *corrections[i]);
+          else
+            _levels[i].get_smoother()->apply(*residuals[i], *corrections[i]);
+    };
+    // The stages of the profiler are local to each thread, so every task
+    // enters the stage of its level.
+    auto profiled_correction = [&](unsigned int const i) {
+      profiler_enter_stage(i, i == num_levels - 1 ? "coarse solver"
+                                                  : "smoother");
+      compute_correction(i);
+      profiler_leave_stage();
+    };
+    if (_concurrent_levels)
+    {
+      dealii::Threads::TaskGroup<void> tasks;
+      for (unsigned int i = 0; i < num_levels; ++i)
+        tasks += dealii::Threads::new_task(
+            [&profiled_correction, i]() { profiled_correction(i); });
+      tasks.join_all();
+    }
+    else
+    {
+      for (unsigned int i = 0; i < num_levels; ++i)
+        profiled_correction(i);
+    }
+    timer_leave_subsection(_timer);
+
+    // NOTE: as we used negative residual, we subtract instead of adding here
+    timer_enter_subsection(_timer, "Apply: additive prolongation");
+    for (unsigned int i = num_levels - 1; i > 0; --i)
+    {
+      profiler_enter_stage(i - 1, "prolongation");
+      _levels[i].get_restrictor()->apply_add(
+          *corrections[i], *corrections[i - 1], 1., OperatorMode::TRANS);
+      profiler_leave_stage();
+    }
+    x.add(-1., *corrections[0]);
+    timer_leave_subsection(_timer);
+  }
+
   std::shared_ptr<dealii::TimerOutput> _timer;
+  // Communicators of the levels that do not use the communicator of the
+  // hierarchy. They are declared before the levels so that they are freed
+  // after the objects that use them.
+  std::vector<std::shared_ptr<MPI_Comm>> _level_comms;
   std::vector<Level<VectorType>> _levels;
   bool _is_preconditioner = true;
+  bool _is_additive = false;
+  bool _concurrent_levels = false;
   unsigned int _n_smoothing_steps;
+  // Right-hand sides and corrections of the levels used by the cycles. They
+  // are reused by every application, so apply() is not reentrant.
+  std::vector<std::shared_ptr<VectorType>> _residuals;
+  std::vector<std::shared_ptr<VectorType>> _corrections;
+  // Fine residuals of the V-cycle, used by the restrictors that store the
+  // residual before restricting it.
+  std::vector<std::shared_ptr<VectorType>> _restriction_residuals;
 };
 } // namespace mfmg
 
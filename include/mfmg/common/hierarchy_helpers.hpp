@@ -48,6 +48,57 @@ public:
     return nullptr;
   }
 
+  /**
+   * Return a MeshEvaluator for the same problem discretized with a lower
+   * polynomial degree or nullptr if the lowest degree has been reached. This
+   * is used to build the polynomial coarsening (p-multigrid) levels.
+   */
+  virtual std::shared_ptr<MeshEvaluator> build_coarser_degree_evaluator(
+      std::shared_ptr<MeshEvaluator> /*mesh_evaluator*/)
+  {
+    ASSERT_THROW_NOT_IMPLEMENTED();
+
+    return nullptr;
+  }
+
+  /**
+   * Return the restriction between two polynomial coarsening levels. The
+   * prolongation is its transpose.
+   */
+  virtual std::shared_ptr<Operator<vector_type>> build_degree_restrictor(
+      MPI_Comm /*comm*/, std::shared_ptr<MeshEvaluator> /*fine_evaluator*/,
+      std::shared_ptr<MeshEvaluator> /*coarse_evaluator*/)
+  {
+    ASSERT_THROW_NOT_IMPLEMENTED();
+
+    return nullptr;
+  }
+
+  /**
+   * Return a MeshEvaluator for the same problem discretized on a mesh that has
+   * been coarsened once. This is used to build the geometric levels.
+   */
+  virtual std::shared_ptr<MeshEvaluator> build_coarser_mesh_evaluator(
+      std::shared_ptr<MeshEvaluator> /*mesh_evaluator*/)
+  {
+    ASSERT_THROW_NOT_IMPLEMENTED();
+
+    return nullptr;
+  }
+
+  /**
+   * Return the restriction between two geometric levels. The prolongation is
+   * its transpose.
+   */
+  virtual std::shared_ptr<Operator<vector_type>> build_mesh_restrictor(
+      MPI_Comm /*comm*/, std::shared_ptr<MeshEvaluator> /*fine_evaluator*/,
+      std::shared_ptr<MeshEvaluator> /*coarse_evaluator*/)
+  {
+    ASSERT_THROW_NOT_IMPLEMENTED();
+
+    return nullptr;
+  }
+
   virtual std::shared_ptr<Smoother<vector_type>>
   build_smoother(std::shared_ptr<Operator<vector_type> const> op,
                  std::shared_ptr<boost::property_tree::ptree const> params) = 0;
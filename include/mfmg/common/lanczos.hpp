@@ -14,6 +14,7 @@
 
 #include <boost/property_tree/ptree.hpp>
 
+#include <chrono>
 #include <memory>
 #include <vector>
 
@@ -29,6 +30,12 @@ class Lanczos
 public:
   Lanczos(OperatorType const &op);
 
+  // Same as above but the Lanczos vectors are stored in workspace instead of
+  // being allocated for each solve. The vectors already in workspace are
+  // resized to the size of the operator, so keeping the workspace alive across
+  // solves on operators of similar sizes avoids most of the allocations.
+  Lanczos(OperatorType const &op, std::vector<VectorType> &workspace);
+
   Lanczos(Lanczos<OperatorType, VectorType> const &) = delete;
   Lanczos<OperatorType, VectorType> &
   operator=(Lanczos<OperatorType, VectorType> const &) = delete;
@@ -40,12 +47,15 @@ public:
 
 private:
   OperatorType const &_op; // reference to operator object to use
+  std::vector<VectorType> *_workspace; // Lanczos vectors, may be null
 
   template <typename FullOperatorType>
   static std::tuple<std::vector<double>, std::vector<VectorType>>
   details_solve_lanczos(FullOperatorType const &op, int const num_requested,
                         boost::property_tree::ptree const &params,
-                        VectorType const &initial_guess);
+                        VectorType const &initial_guess,
+                        std::vector<VectorType> &lanc_vectors,
+                        std::chrono::steady_clock::time_point start_time);
 
   static std::tuple<std::vector<double>, std::vector<double>>
   details_calc_tridiag_epairs(std::vector<double> const &main_diagonal,
@@ -15,6 +15,7 @@
 #include <mfmg/cuda/utils.cuh>
 
 #include <algorithm>
+#include <chrono>
 #include <random>
 #include <vector>
 
@@ -74,7 +75,17 @@ void details_set_initial_guess(
 
 /// \brief Lanczos solver: constructor
 template <typename OperatorType, typename VectorType>
-Lanczos<OperatorType, VectorType>::Lanczos(OperatorType const &op) : _op(op)
+Lanczos<OperatorType, VectorType>::Lanczos(OperatorType const &op)
+    : _op(op), _workspace(nullptr)
+{
+  ASSERT(_op.m() == _op.n(), "Operator must be square");
+}
+
+/// \brief Lanczos solver: constructor with a reusable workspace
+template <typename OperatorType, typename VectorType>
+Lanczos<OperatorType, VectorType>::Lanczos(OperatorType const &op,
+                                           std::vector<VectorType> &workspace)
+    : _op(op), _workspace(&workspace)
 {
   ASSERT(_op.m() == _op.n(), "Operator must be square");
 }
@@ -108,6 +119,14 @@ Lanczos<OperatorType, VectorType>::solve(
   // NOTE: for regular Lanczos, it will never do any deflation
   DeflatedOperator<OperatorType, VectorType> deflated_op(_op);
 
+  // Use the workspace for the Lanczos vectors if we have one
+  std::vector<VectorType> local_lanc_vectors;
+  std::vector<VectorType> &lanc_vectors =
+      _workspace != nullptr ? *_workspace : local_lanc_vectors;
+
+  // The time budget is shared by all the cycles
+  auto const start_time = std::chrono::steady_clock::now();
+
   // Loop over Lanczos solves
   for (int cycle = 0; cycle < num_cycles; ++cycle)
   {
@@ -123,7 +142,8 @@ Lanczos<OperatorType, VectorType>::solve(
     std::vector<double> cycle_evals;
     std::vector<VectorType> cycle_evecs;
     std::tie(cycle_evals, cycle_evecs) = details_solve_lanczos(
-        deflated_op, num_evecs_per_cycle, params, initial_guess);
+        deflated_op, num_evecs_per_cycle, params, initial_guess, lanc_vectors,
+        start_time);
 
     // Save the eigenpairs just calculated
 
@@ -181,11 +201,17 @@ template <typename FullOperatorType>
 std::tuple<std::vector<double>, std::vector<VectorType>>
 Lanczos<OperatorType, VectorType>::details_solve_lanczos(
     FullOperatorType const &op, int const num_requested,
-    boost::property_tree::ptree const &params, VectorType const &initial_guess)
+    boost::property_tree::ptree const &params, VectorType const &initial_guess,
+    std::vector<VectorType> &lanc_vectors,
+    std::chrono::steady_clock::time_point start_time)
 {
   int const maxit = params.get<int>("max_iterations");
   double const tol = params.get<double>("tolerance");
   int const percent_overshoot = params.get<int>("percent_overshoot", 0);
+  // Wall-clock time in seconds, counted from \p start_time, after which the
+  // iterations stop with the best available Ritz pairs. A non-positive value
+  // means no limit.
+  double const time_budget = params.get<double>("time_budget", 0.);
 
   ASSERT(0 <= percent_overshoot && percent_overshoot < 100,
          "Lanczos overshoot percentage should be in [0, 100)");
@@ -202,11 +228,12 @@ Lanczos<OperatorType, VectorType>::details_solve_lanczos(
   double alpha = 0;
   double beta = initial_guess.l2_norm();
 
-  std::vector<VectorType> lanc_vectors; // Lanczos vectors
-
-  // Create first Lanczos vector if necessary
+  // Create first Lanczos vector if necessary. Otherwise, reuse the vectors
+  // left over by a previous solve.
   if (lanc_vectors.size() < 1)
     lanc_vectors.push_back(initial_guess);
+  else
+    lanc_vectors[0] = initial_guess;
 
   std::vector<double> main_diagonal;
   std::vector<double> sub_diagonal;
@@ -228,6 +255,11 @@ Lanczos<OperatorType, VectorType>::details_solve_lanczos(
       // Add new Lanczos vector
       lanc_vectors.push_back(VectorType(n));
     }
+    else if (static_cast<int>(lanc_vectors[it].size()) != n)
+    {
+      // The vector is overwritten by the operator, no need to zero it
+      lanc_vectors[it].reinit(n, true);
+    }
 
     // Apply operator.
     op.vmult(lanc_vectors[it], lanc_vectors[it - 1]);
@@ -254,7 +286,13 @@ Lanczos<OperatorType, VectorType>::details_solve_lanczos(
     bool const max_iterations_reached = (it == maxit);
     bool const percent_overshoot_exceeded =
         (100 * (it - it_prev_check) > percent_overshoot * it_prev_check);
-    if (first_iteration || max_iterations_reached || percent_overshoot_exceeded)
+    bool const time_budget_exceeded =
+        (time_budget > 0.) &&
+        (std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start_time)
+             .count() > time_budget);
+    if (first_iteration || max_iterations_reached ||
+        percent_overshoot_exceeded || time_budget_exceeded)
     {
       int const dim_hessenberg = it;
       ASSERT((size_t)dim_hessenberg == main_diagonal.size(), "Internal error");
@@ -270,6 +308,13 @@ Lanczos<OperatorType, VectorType>::details_solve_lanczos(
         break;
       }
 
+      // Once the time budget is exceeded, stop as soon as enough Ritz pairs
+      // are available even if they have not converged.
+      if (time_budget_exceeded && !evals.empty())
+      {
+        break;
+      }
+
       // Record iteration number when this check done
       it_prev_check = it;
     }
@@ -12,8 +12,12 @@
 #ifndef MFMG_OPERATOR_HPP
 #define MFMG_OPERATOR_HPP
 
+#include <mfmg/common/exceptions.hpp>
+
 #include <memory>
 
+#include <mpi.h>
+
 namespace mfmg
 {
 enum class OperatorMode
@@ -34,6 +38,47 @@ public:
   virtual void apply(vector_type const &x, vector_type &y,
                      OperatorMode mode = OperatorMode::NO_TRANS) const = 0;
 
+  /**
+   * Compute the restricted residual y = this * (a * x - b). \p a is the
+   * operator on the domain of this operator. \p residual is a vector built
+   * like the range vectors of \p a that is overwritten when the residual
+   * needs to be stored. The default implementation stores the residual in
+   * it; implementations that have access to the rows of \p a should override
+   * it so that the residual is consumed as soon as it is computed.
+   */
+  virtual void restrict_residual(operator_type const &a, vector_type const &x,
+                                 vector_type const &b, vector_type &y,
+                                 vector_type &residual) const
+  {
+    a.apply(x, residual);
+    residual.add(-1., b);
+    apply(residual, y);
+  }
+
+  /**
+   * Compute y += alpha * op(x) where op is this operator or its transpose
+   * depending on \p mode. The default implementation uses a temporary vector;
+   * implementations should override it to update \p y in place.
+   */
+  virtual void apply_add(vector_type const &x, vector_type &y,
+                         double const alpha,
+                         OperatorMode mode = OperatorMode::NO_TRANS) const
+  {
+    auto tmp = (mode == OperatorMode::NO_TRANS) ? build_range_vector()
+                                                : build_domain_vector();
+    apply(x, *tmp, mode);
+    y.add(alpha, *tmp);
+  }
+
+  /**
+   * Build the data used by apply_add() and restrict_residual() for \p mode,
+   * e.g., a transposed matrix or a communication pattern. Building them may
+   * require collective communication, so the hierarchy builds them during the
+   * setup instead of letting the cycles build them on first use. The default
+   * implementation does nothing.
+   */
+  virtual void setup_transfer(OperatorMode const /*mode*/) const {}
+
   virtual std::shared_ptr<operator_type> transpose() const = 0;
 
   virtual std::shared_ptr<operator_type>
@@ -42,6 +87,38 @@ public:
   virtual std::shared_ptr<operator_type>
   multiply_transpose(std::shared_ptr<operator_type const> b) const = 0;
 
+  /**
+   * Return a sparsified copy A_s of this symmetric operator A. The
+   * off-diagonal entries a_ij with |a_ij| < \p drop_tolerance *
+   * sqrt(|a_ii a_jj|) are dropped and |a_ij| is added to the diagonal entries
+   * of the rows i and j. This preserves the symmetry and A <= A_s, so A_s is
+   * positive definite if A is. As a safeguard, the entries of a row are only
+   * dropped if the Gershgorin bound of the row of D^{-1/2} (A_s - A) D^{-1/2},
+   * with D the diagonal of A, is at most \p safeguard, and an entry is only
+   * dropped if both of its rows allow it. Then A <= A_s <= A + \p safeguard D.
+   */
+  virtual std::shared_ptr<operator_type>
+  sparsify(double const /*drop_tolerance*/, double const /*safeguard*/) const
+  {
+    ASSERT_THROW_NOT_IMPLEMENTED();
+
+    return nullptr;
+  }
+
+  /**
+   * Return a copy of this operator that communicates on \p comm, a duplicate
+   * of the communicator of this operator. The copy and the vectors that it
+   * builds can then be used by a thread while other threads communicate on
+   * the original communicator. Building the copy is collective on \p comm.
+   * The default implementation returns nullptr, i.e., the operator cannot be
+   * copied.
+   */
+  virtual std::shared_ptr<operator_type>
+  copy_on_communicator(MPI_Comm /*comm*/) const
+  {
+    return nullptr;
+  }
+
   virtual std::shared_ptr<vector_type> build_domain_vector() const = 0;
 
   virtual std::shared_ptr<vector_type> build_range_vector() const = 0;
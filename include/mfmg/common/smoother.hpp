@@ -34,6 +34,19 @@ public:
 
   virtual void apply(vector_type const &x, vector_type &y) const = 0;
 
+  /**
+   * Same as apply() with a zero initial guess: the input value of \p y is
+   * ignored. Smoothers should override it to skip the application of the
+   * operator, since the residual is then \p x. The default implementation
+   * zeroes \p y and calls apply().
+   */
+  virtual void apply_zero_initial_guess(vector_type const &x,
+                                        vector_type &y) const
+  {
+    y = 0.;
+    apply(x, y);
+  }
+
   virtual ~Smoother() = default;
 
 protected:
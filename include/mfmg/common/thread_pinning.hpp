@@ -0,0 +1,43 @@
+/**************************************************************************
+ * Copyright (c) 2017-2019 by the mfmg authors                            *
+ * All rights reserved.                                                   *
+ *                                                                        *
+ * This file is part of the mfmg library. mfmg is distributed under a BSD *
+ * 3-clause license. For the licensing terms see the LICENSE file in the  *
+ * top-level directory                                                    *
+ *                                                                        *
+ * SPDX-License-Identifier: BSD-3-Clause                                  *
+ *************************************************************************/
+
+#ifndef MFMG_THREAD_PINNING_HPP
+#define MFMG_THREAD_PINNING_HPP
+
+namespace mfmg
+{
+/**
+ * Pin the threads of the task scheduler used by deal.II, including the
+ * calling thread, to the cores the calling process is allowed to run on,
+ * e.g., the cores that the MPI launcher bound the process to. The calling
+ * thread is pinned immediately. The other threads are assigned to the cores
+ * round-robin the first time they execute a task and they keep their core
+ * afterwards, so the pages they first touch stay on their NUMA domain.
+ *
+ * The task scheduler is shared by the whole process and a thread cannot be
+ * unpinned once other code relied on its placement. The pinning is
+ * therefore installed for the rest of the execution and it must be requested
+ * by the application, e.g., right after MPI is initialized, and not by a
+ * solver. Subsequent calls only pin the calling thread. Throw if the affinity
+ * of the process cannot be read or if the calling thread cannot be pinned.
+ * Return false if the pinning is not supported, i.e., if deal.II is built
+ * without threads or on other systems than Linux.
+ */
+bool pin_threads();
+
+/**
+ * Return the number of threads of the task scheduler whose affinity could not
+ * be set after pin_threads() was called. These threads are not pinned.
+ */
+unsigned int get_n_unpinned_threads();
+} // namespace mfmg
+
+#endif
@@ -80,7 +80,7 @@ void apply_permutation_in_place(std::vector<unsigned int> const &permutation,
 
 template <typename ScalarType>
 void check_restriction_matrix(
-    MPI_Comm comm, std::vector<dealii::Vector<ScalarType>> const &eigenvectors,
+    MPI_Comm comm,
     std::vector<std::vector<dealii::types::global_dof_index>> const
         &dof_indices_maps,
     dealii::LinearAlgebra::distributed::Vector<ScalarType> const
@@ -97,10 +97,7 @@ void check_restriction_matrix(
   unsigned int const n_agglomerates = n_local_eigenvectors.size();
   for (unsigned int i = 0; i < n_agglomerates; ++i)
   {
-    // Get the size of the eigenvectors in agglomerate i
-    unsigned int offset = std::accumulate(n_local_eigenvectors.begin(),
-                                          n_local_eigenvectors.begin() + i, 0);
-    unsigned int const n_elem = eigenvectors[offset].size();
+    unsigned int const n_elem = dof_indices_maps[i].size();
 
     for (unsigned int j = 0; j < n_elem; ++j)
     {
@@ -124,10 +121,9 @@ void check_restriction_matrix(
   sp.compress();
 
   dealii::TrilinosWrappers::SparseMatrix weight_matrix(sp);
-  unsigned int pos = 0;
   for (unsigned int i = 0; i < n_agglomerates; ++i)
   {
-    unsigned int const n_elem = eigenvectors[pos].size();
+    unsigned int const n_elem = dof_indices_maps[i].size();
     for (unsigned int j = 0; j < n_elem; ++j)
     {
       dealii::types::global_dof_index const global_pos = dof_indices_maps[i][j];
@@ -135,7 +131,6 @@ void check_restriction_matrix(
           diag_elements[i][j] / locally_relevant_global_diag[global_pos];
       weight_matrix.add(global_pos, global_pos, value);
     }
-    pos += n_local_eigenvectors[i];
   }
 
   // Compress the matrix
@@ -146,7 +141,6 @@ void check_restriction_matrix(
            "Sum of local weight matrices is not the identity");
 #else
   std::ignore = comm;
-  std::ignore = eigenvectors;
   std::ignore = dof_indices_maps;
   std::ignore = locally_relevant_global_diag;
   std::ignore = diag_elements;
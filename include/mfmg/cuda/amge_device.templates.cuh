@@ -340,7 +340,7 @@ AMGe_device<dim, MeshEvaluator, VectorType>::compute_restriction_sparse_matrix(
   AMGe<dim, VectorType>::compute_restriction_sparse_matrix(
       eigenvectors, diag_elements, dof_indices_maps, n_local_eigenvectors,
       locally_relevant_global_diag, restriction_sparse_matrix);
-  check_restriction_matrix(this->_comm, eigenvectors, dof_indices_maps,
+  check_restriction_matrix(this->_comm, dof_indices_maps,
                            locally_relevant_global_diag, diag_elements,
                            n_local_eigenvectors);
 
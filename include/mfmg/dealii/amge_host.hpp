@@ -15,14 +15,66 @@
 #include <mfmg/common/amge.hpp>
 #include <mfmg/dealii/dealii_matrix_free_mesh_evaluator.hpp>
 
+#include <deal.II/lac/dynamic_sparsity_pattern.h>
+#include <deal.II/lac/la_parallel_vector.h>
+#include <deal.II/lac/sparse_matrix.h>
+#include <deal.II/lac/sparsity_pattern.h>
+#include <deal.II/lac/vector.h>
+
+#include <vector>
+
 namespace mfmg
 {
 /**
- * Use the structure to store initial guess for LOBPCG
+ * Rescaling of the entries of a row of the restriction that are kept when its
+ * small entries are dropped, see AMGe_host::setup_restrictor().
+ */
+enum class DropRescaling
+{
+  row_sum,
+  norm,
+  none
+};
+
+/**
+ * Scratch data of the agglomerate workers. WorkStream gives each thread its
+ * own copy, which is reused from one agglomerate to the next. Besides the
+ * initial guess for LOBPCG, the structure stores the buffers of the local
+ * eigenproblems: deal.II only reallocates them when an agglomerate needs more
+ * memory than any agglomerate treated before by the same thread. The buffers
+ * are mutable because they do not carry any information from one agglomerate
+ * to the next.
  */
 struct LobpcgScratchData
 {
   std::vector<dealii::Vector<double>> lobpcg_init_guess;
+
+  /**
+   * Lanczos vectors of the matrix-based eigensolver.
+   */
+  mutable std::vector<dealii::Vector<double>> lanczos_vectors;
+
+  /**
+   * Lanczos vectors of the matrix-free eigensolver.
+   */
+  mutable std::vector<dealii::LinearAlgebra::distributed::Vector<double>>
+      matrix_free_lanczos_vectors;
+
+  /**
+   * Sparsity pattern and system matrix of the agglomerate. The matrix is
+   * declared last so that it is destroyed before the sparsity pattern it
+   * points to.
+   */
+  mutable dealii::SparsityPattern sparsity_pattern;
+  mutable dealii::SparseMatrix<double> system_matrix;
+
+  /**
+   * Sparsity pattern and system matrix of the agglomerate restricted to the
+   * unconstrained dofs.
+   */
+  mutable dealii::DynamicSparsityPattern free_dynamic_sparsity_pattern;
+  mutable dealii::SparsityPattern free_sparsity_pattern;
+  mutable dealii::SparseMatrix<double> free_system_matrix;
 };
 
 template <int dim, typename MeshEvaluator, typename VectorType>
@@ -51,6 +103,14 @@ public:
    * the diagonal elements of the local system matrix, and a vector that maps
    * the dof indices from the local problem to the global problem.
    *
+   * The eigensolver is given by the eigensolver parameter "type". In the
+   * matrix-based version, the eigenproblem is restricted to the unconstrained
+   * dofs. Agglomerates with at most 2 * n_eigenvectors + 2 unconstrained
+   * dofs use the eigensolver "small agglomerate type" [default: "lapack"]
+   * instead, because the iterative eigensolvers need more dofs than
+   * eigenvectors. Set it to the value of "type" to use the same eigensolver
+   * on every agglomerate.
+   *
    * NOTE: MeshEvaluator is a template argument of the AMGe_host and therefore
    * cannot be used to provide separate specializations depending on whether
    * the mesh evaluator is matrix-free or not. The Triangulation template
@@ -90,7 +150,18 @@ public:
                                 int> = 0) const;
 
   /**
-   *  Build the agglomerates and their associated triangulations.
+   * Build the agglomerates and their associated triangulations. The
+   * restriction matrix is allocated from the agglomerates before the local
+   * eigenproblems are solved and the result of each agglomerate is inserted
+   * as soon as it is available, so that the eigenvectors of all the
+   * agglomerates are never stored at the same time.
+   *
+   * If the eigensolver parameter "drop_tolerance" is positive, the entries of
+   * each eigenvector smaller than this tolerance times its largest entry are
+   * not stored. The remaining entries are rescaled according to
+   * "drop_rescaling": "row_sum" [default] preserves the sum of the row of
+   * the restriction, "norm" preserves the norm of the eigenvector, and "none"
+   * does not rescale them.
    */
   void setup_restrictor(
       boost::property_tree::ptree const &params,
@@ -127,6 +198,18 @@ private:
     std::vector<dealii::types::global_dof_index> local_dof_indices_map;
   };
 
+  /**
+   * Return the number of eigenvectors of each agglomerate, indexed by the
+   * agglomerate id minus one: \p n_eigenvectors, clamped to the number of dofs
+   * of the agglomerate that are not constrained in the global constraints of
+   * \p evaluator. An agglomerate lying mostly on the Dirichlet boundary has
+   * fewer local eigenvectors than requested.
+   */
+  std::vector<unsigned int>
+  compute_n_agglomerate_eigenvectors(unsigned int const n_agglomerates,
+                                     unsigned int const n_eigenvectors,
+                                     MeshEvaluator const &evaluator) const;
+
   /**
    * This function encapsulates the different functions that work on an
    * independent set of data.
@@ -137,26 +220,61 @@ private:
                     LobpcgScratchData &scratch_data, CopyData &copy_data);
 
   /**
-   * This function copies quantities computed in local worker to output
-   * variables.
+   * Locally owned rows of the restriction matrix whose small entries were
+   * dropped, in compressed row format. The rows are stored in the order in
+   * which they are numbered, so the k-th row is the k-th locally owned row.
+   * The values of the eigenvector matrix are only stored if \p
+   * store_eigenvectors is true.
+   */
+  struct DroppedRows
+  {
+    bool store_eigenvectors = false;
+    std::vector<std::size_t> offsets = {0};
+    std::vector<dealii::types::global_dof_index> indices;
+    std::vector<double> restriction_values;
+    std::vector<double> eigenvector_values;
+  };
+
+  /**
+   * This function inserts the rows computed in local worker in the restriction
+   * matrix and, if they are not null, in the eigenvector and the delta
+   * eigenvector matrices. \p row is the first row of the agglomerate and is
+   * advanced past its rows.
+   */
+  void copy_local_to_restriction(
+      CopyData const &copy_data,
+      dealii::LinearAlgebra::distributed::Vector<
+          typename VectorType::value_type> const &locally_relevant_global_diag,
+      dealii::types::global_dof_index &row,
+      dealii::TrilinosWrappers::SparseMatrix &restriction_sparse_matrix,
+      dealii::TrilinosWrappers::SparseMatrix *eigenvector_sparse_matrix,
+      dealii::TrilinosWrappers::SparseMatrix *delta_eigenvector_matrix);
+
+  /**
+   * Append the rows computed in local worker to \p dropped_rows once the
+   * entries smaller than \p drop_tolerance times the largest entry of each
+   * eigenvector are dropped.
+   */
+  void copy_local_to_dropped_rows(
+      CopyData const &copy_data,
+      dealii::LinearAlgebra::distributed::Vector<
+          typename VectorType::value_type> const &locally_relevant_global_diag,
+      double const drop_tolerance, DropRescaling const drop_rescaling,
+      DroppedRows &dropped_rows) const;
+
+  /**
+   * Build the restriction matrix and, if they are not null, the eigenvector
+   * and the delta eigenvector matrices from \p dropped_rows. Their sparsity
+   * pattern only contains the kept entries. \p restriction_sp is the pattern
+   * of the rows before the entries were dropped and it gives the
+   * distribution of the matrices.
    */
-  void
-  copy_local_to_global(CopyData const &copy_data,
-                       std::vector<dealii::Vector<double>> &eigenvectors,
-                       std::vector<std::vector<ScalarType>> &diag_elements,
-                       std::vector<std::vector<dealii::types::global_dof_index>>
-                           &dof_indices_maps,
-                       std::vector<unsigned int> &n_local_eigenvectors);
-
-  // Give a different name to help the compiler. Otherwise, it gets confused
-  // when calling WorkStream
-  void copy_local_to_global_eig(
-      CopyData const &copy_data, std::vector<double> &eigenvalues,
-      std::vector<dealii::Vector<double>> &eigenvectors,
-      std::vector<std::vector<ScalarType>> &diag_elements,
-      std::vector<std::vector<dealii::types::global_dof_index>>
-          &dof_indices_maps,
-      std::vector<unsigned int> &n_local_eigenvectors);
+  void build_dropped_matrices(
+      DroppedRows const &dropped_rows,
+      dealii::TrilinosWrappers::SparsityPattern const &restriction_sp,
+      dealii::TrilinosWrappers::SparseMatrix &restriction_sparse_matrix,
+      dealii::TrilinosWrappers::SparseMatrix *eigenvector_sparse_matrix,
+      dealii::TrilinosWrappers::SparseMatrix *delta_eigenvector_matrix) const;
 
   boost::property_tree::ptree _eigensolver_params;
 };
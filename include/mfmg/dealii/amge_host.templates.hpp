@@ -12,15 +12,18 @@
 #ifndef AMGE_HOST_TEMPLATES_HPP
 #define AMGE_HOST_TEMPLATES_HPP
 
+#include <mfmg/common/block_lanczos.templates.hpp>
 #include <mfmg/common/lanczos.templates.hpp>
 #include <mfmg/common/utils.hpp>
 #include <mfmg/dealii/amge_host.hpp>
 #include <mfmg/dealii/anasazi.templates.hpp>
 #include <mfmg/dealii/dealii_matrix_free_mesh_evaluator.hpp>
+#include <mfmg/dealii/fast_diagonalization.hpp>
 
 #include <deal.II/base/work_stream.h>
 #include <deal.II/dofs/dof_accessor.h>
 #include <deal.II/lac/arpack_solver.h>
+#include <deal.II/lac/dynamic_sparsity_pattern.h>
 #include <deal.II/lac/la_parallel_vector.h>
 #include <deal.II/lac/lapack_full_matrix.h>
 #include <deal.II/lac/precondition.h>
@@ -29,6 +32,8 @@
 
 #include <EpetraExt_MatrixMatrix.h>
 
+#include <set>
+
 namespace mfmg
 {
 
@@ -51,6 +56,13 @@ struct MatrixFreeAgglomerateOperator
 {
   using size_type = typename MeshEvaluator::size_type;
 
+  /**
+   * The vector type the operator acts on. This is the native vector type of
+   * the deal.II matrix-free operators so that the evaluation on the
+   * agglomerate does not require any copy.
+   */
+  using vector_type = dealii::LinearAlgebra::distributed::Vector<double>;
+
   /**
    * This constructor expects @p mesh_evaluator to be an object that performs
    * the actual operator evaluation. @p dof_handler is used to initialize the
@@ -68,11 +80,26 @@ struct MatrixFreeAgglomerateOperator
     _mesh_evaluator->matrix_free_initialize_agglomerate(dof_handler);
   }
 
+  /**
+   * Same as above but @p patch_to_global_map is passed on to the
+   * MeshEvaluator so that it can reuse the global matrix-free data.
+   */
+  template <typename DoFHandler, typename PatchToGlobalMap>
+  MatrixFreeAgglomerateOperator(MeshEvaluator const &mesh_evaluator,
+                                DoFHandler &dof_handler,
+                                dealii::AffineConstraints<double> &constraints,
+                                PatchToGlobalMap const &patch_to_global_map)
+      : _mesh_evaluator(mesh_evaluator.clone()), _dof_handler(dof_handler),
+        _constraints(constraints)
+  {
+    _mesh_evaluator->matrix_free_initialize_agglomerate(dof_handler,
+                                                        patch_to_global_map);
+  }
+
   /**
    * Perform the operator evaluation on the agglomerate.
    */
-  void vmult(dealii::Vector<double> &dst,
-             dealii::Vector<double> const &src) const
+  void vmult(vector_type &dst, vector_type const &src) const
   {
     _mesh_evaluator->matrix_free_evaluate_agglomerate(src, dst);
   }
@@ -161,14 +188,14 @@ namespace mfmg
 {
 namespace
 {
-template <typename AgglomerateOperator>
+template <typename AgglomerateOperator, typename VectorType>
 void lanczos_compute_eigenvalues_and_eigenvectors(
     unsigned int n_eigenvectors, double tolerance,
     boost::property_tree::ptree const &eigensolver_params,
     AgglomerateOperator const &agglomerate_operator,
-    dealii::Vector<double> const &initial_guess,
+    VectorType const &initial_guess, std::vector<VectorType> &lanczos_vectors,
     std::vector<std::complex<double>> &eigenvalues,
-    std::vector<dealii::Vector<double>> &eigenvectors)
+    std::vector<VectorType> &eigenvectors)
 {
   boost::property_tree::ptree lanczos_params;
   lanczos_params.put("num_eigenpairs", n_eigenvectors);
@@ -183,6 +210,7 @@ void lanczos_compute_eigenvalues_and_eigenvectors(
                      eigensolver_params.get("max_iterations", 200));
   lanczos_params.put("percent_overshoot",
                      eigensolver_params.get("percent_overshoot", 5));
+  lanczos_params.put("time_budget", eigensolver_params.get("time_budget", 0.));
   bool is_deflated = eigensolver_params.get("is_deflated", false);
   if (is_deflated)
   {
@@ -192,8 +220,8 @@ void lanczos_compute_eigenvalues_and_eigenvectors(
                        eigensolver_params.get<int>("num_eigenpairs_per_cycle"));
   }
 
-  Lanczos<AgglomerateOperator, dealii::Vector<double>> solver(
-      agglomerate_operator);
+  Lanczos<AgglomerateOperator, VectorType> solver(agglomerate_operator,
+                                                  lanczos_vectors);
 
   std::vector<double> real_eigenvalues;
   std::tie(real_eigenvalues, eigenvectors) =
@@ -206,37 +234,203 @@ void lanczos_compute_eigenvalues_and_eigenvectors(
             eigenvalues.begin());
 }
 
-template <typename AgglomerateOperator>
+template <typename AgglomerateOperator, typename VectorType>
+void block_lanczos_compute_eigenvalues_and_eigenvectors(
+    unsigned int n_eigenvectors, double tolerance,
+    boost::property_tree::ptree const &eigensolver_params,
+    AgglomerateOperator const &agglomerate_operator,
+    VectorType const &initial_guess, std::vector<VectorType> &lanczos_vectors,
+    std::vector<std::complex<double>> &eigenvalues,
+    std::vector<VectorType> &eigenvectors)
+{
+  boost::property_tree::ptree lanczos_params;
+  lanczos_params.put("num_eigenpairs", n_eigenvectors);
+  // The block size defaults to the number of eigenvectors so that degenerate
+  // eigenspaces, e.g., on symmetric agglomerates, are captured in one run.
+  lanczos_params.put("block_size",
+                     eigensolver_params.get("block_size", n_eigenvectors));
+  // The basis is fully reorthogonalized so that tight tolerances do not
+  // produce spurious eigenvalues, but they may not be reachable in floating
+  // point arithmetic.
+  lanczos_params.put("tolerance", std::max(tolerance, 1e-10));
+  lanczos_params.put("max_iterations",
+                     eigensolver_params.get("max_iterations", 200));
+  lanczos_params.put("time_budget", eigensolver_params.get("time_budget", 0.));
+
+  BlockLanczos<AgglomerateOperator, VectorType> solver(agglomerate_operator,
+                                                       lanczos_vectors);
+
+  std::vector<double> real_eigenvalues;
+  std::tie(real_eigenvalues, eigenvectors) =
+      solver.solve(lanczos_params, initial_guess);
+  ASSERT(n_eigenvectors == eigenvectors.size(),
+         "Wrong number of computed eigenpairs");
+
+  // Copy real eigenvalues to complex
+  std::copy(real_eigenvalues.begin(), real_eigenvalues.end(),
+            eigenvalues.begin());
+}
+
+/**
+ * Complete the eigenpairs returned by an eigensolver that has not converged
+ * within its budget. The missing vectors are the initial guess, or a random
+ * perturbation of the last accepted vector, smoothed with a few damped Jacobi
+ * iterations and orthogonalized against the available eigenvectors. This
+ * approximates the smooth modes that the coarse space needs the most. The
+ * eigenvalues are the Rayleigh quotients.
+ */
+template <typename AgglomerateOperator, typename VectorType>
+void complete_eigenpairs(unsigned int n_eigenvectors,
+                         AgglomerateOperator const &agglomerate_operator,
+                         std::vector<double> const &diagonal,
+                         VectorType const &initial_guess,
+                         std::vector<double> &real_eigenvalues,
+                         std::vector<VectorType> &eigenvectors)
+{
+  unsigned int const n_smoothing_iterations = 2;
+  double const omega = 2. / 3.;
+  double const breakdown_tol = 1e-8;
+
+  unsigned int const size = initial_guess.size();
+  VectorType candidate(initial_guess);
+  VectorType residual(initial_guess);
+  for (unsigned int attempt = 0;
+       attempt < 2 * n_eigenvectors && eigenvectors.size() < n_eigenvectors;
+       ++attempt)
+  {
+    if (attempt > 0)
+      internal::details_set_initial_guess(candidate, attempt);
+
+    // Damped Jacobi iterations for the homogeneous problem. The zero entries
+    // of the diagonal, if any, are left untouched.
+    for (unsigned int k = 0; k < n_smoothing_iterations; ++k)
+    {
+      agglomerate_operator.vmult(residual, candidate);
+      for (unsigned int i = 0; i < size; ++i)
+        if (diagonal[i] != 0.)
+          candidate[i] -= omega * residual[i] / diagonal[i];
+    }
+
+    double const norm = candidate.l2_norm();
+    for (unsigned int pass = 0; pass < 2; ++pass)
+      for (auto const &eigenvector : eigenvectors)
+        candidate.add(-(eigenvector * candidate), eigenvector);
+    double const new_norm = candidate.l2_norm();
+    if (!(new_norm > breakdown_tol * norm))
+      continue;
+
+    candidate /= new_norm;
+    agglomerate_operator.vmult(residual, candidate);
+    real_eigenvalues.push_back(candidate * residual);
+    eigenvectors.push_back(candidate);
+  }
+
+  ASSERT_THROW(eigenvectors.size() == n_eigenvectors,
+               "Could not complete the partially converged eigenpairs");
+}
+
+/**
+ * Put the near-nullspace provided by the evaluator first in the local coarse
+ * space and fill the rest with the eigenvectors, by increasing eigenvalue,
+ * orthogonalized against the vectors already selected. The eigenvectors are
+ * orthonormal so that enough of them are left whatever the near-nullspace.
+ * The entries of the near-nullspace on the dofs constrained in \p constraints
+ * are set to zero like the ones of the eigenvectors. The eigenvalues are
+ * replaced by the Rayleigh quotients of the new vectors.
+ */
+template <typename AgglomerateOperator, typename VectorType>
+void add_near_nullspace(
+    AgglomerateOperator const &agglomerate_operator,
+    dealii::AffineConstraints<double> const &constraints,
+    std::vector<dealii::Vector<double>> const &near_nullspace,
+    std::vector<std::complex<double>> &eigenvalues,
+    std::vector<VectorType> &eigenvectors)
+{
+  // An agglomerate without unconstrained dofs has no local coarse space.
+  if (eigenvectors.empty())
+    return;
+
+  double const breakdown_tol = 1e-8;
+
+  unsigned int const n_eigenvectors = eigenvectors.size();
+  std::vector<VectorType> coarse_vectors;
+  coarse_vectors.reserve(n_eigenvectors);
+  VectorType candidate(eigenvectors[0]);
+  auto add_candidate = [&]() {
+    double const norm = candidate.l2_norm();
+    for (unsigned int pass = 0; pass < 2; ++pass)
+      for (auto const &coarse_vector : coarse_vectors)
+        candidate.add(-(coarse_vector * candidate), coarse_vector);
+    double const new_norm = candidate.l2_norm();
+    if (new_norm > breakdown_tol * norm)
+    {
+      candidate /= new_norm;
+      coarse_vectors.push_back(candidate);
+    }
+  };
+
+  for (unsigned int i = 0;
+       i < near_nullspace.size() && coarse_vectors.size() < n_eigenvectors;
+       ++i)
+  {
+    std::copy(near_nullspace[i].begin(), near_nullspace[i].end(),
+              candidate.begin());
+    for (unsigned int j = 0; j < candidate.size(); ++j)
+      if (constraints.is_constrained(j))
+        candidate[j] = 0.;
+    add_candidate();
+  }
+  for (unsigned int i = 0;
+       i < n_eigenvectors && coarse_vectors.size() < n_eigenvectors; ++i)
+  {
+    candidate = eigenvectors[i];
+    add_candidate();
+  }
+  ASSERT(coarse_vectors.size() == n_eigenvectors,
+         "Internal error: the coarse space is too small");
+
+  for (unsigned int i = 0; i < n_eigenvectors; ++i)
+  {
+    agglomerate_operator.vmult(candidate, coarse_vectors[i]);
+    eigenvalues[i] = coarse_vectors[i] * candidate;
+  }
+  eigenvectors.swap(coarse_vectors);
+}
+
+template <typename AgglomerateOperator, typename VectorType>
 void anasazi_compute_eigenvalues_and_eigenvectors(
     unsigned int n_eigenvectors,
     boost::property_tree::ptree const &eigensolver_params,
     AgglomerateOperator const &agglomerate_operator,
-    dealii::Vector<double> const &initial_guess,
+    std::vector<double> const &diagonal, VectorType const &initial_guess,
     std::vector<dealii::Vector<double>> const &lobpcg_vectors,
     std::vector<std::complex<double>> &eigenvalues,
-    std::vector<dealii::Vector<double>> &eigenvectors)
+    std::vector<VectorType> &eigenvectors)
 {
-  AnasaziSolver<AgglomerateOperator, dealii::Vector<double>> solver(
-      agglomerate_operator);
+  AnasaziSolver<AgglomerateOperator, VectorType> solver(agglomerate_operator);
 
   std::vector<double> real_eigenvalues;
-  std::vector<std::shared_ptr<dealii::Vector<double>>> lobpcg_initial_guess;
+  std::vector<std::shared_ptr<VectorType>> lobpcg_initial_guess;
   // If the vectors in scratch_data do not exist or if the size of agglomerate
-  // has changed, the initial guess for LOBPCG is the initial provided by the
-  // user.
+  // or the number of eigenvectors has changed, the initial guess for LOBPCG is
+  // the initial provided by the user.
   if ((lobpcg_vectors.size() == 0) ||
+      (lobpcg_vectors.size() < n_eigenvectors) ||
       (lobpcg_vectors[0].size() != initial_guess.size()))
   {
     lobpcg_initial_guess.resize(1);
-    lobpcg_initial_guess[0] =
-        std::make_shared<dealii::Vector<double>>(initial_guess);
+    lobpcg_initial_guess[0] = std::make_shared<VectorType>(initial_guess);
   }
   else
   {
     lobpcg_initial_guess.resize(n_eigenvectors);
     for (unsigned int i = 0; i < n_eigenvectors; ++i)
+    {
       lobpcg_initial_guess[i] =
-          std::make_shared<dealii::Vector<double>>(lobpcg_vectors[i]);
+          std::make_shared<VectorType>(lobpcg_vectors[i].size());
+      std::copy(lobpcg_vectors[i].begin(), lobpcg_vectors[i].end(),
+                lobpcg_initial_guess[i]->begin());
+    }
 
     // If the initial vector has zero entries due to the constraints, we need
     // to modify the LOPBCG initial guess. Conversely if the LOBPCG initial
@@ -266,13 +460,104 @@ void anasazi_compute_eigenvalues_and_eigenvectors(
   }
   std::tie(real_eigenvalues, eigenvectors) =
       solver.solve(eigensolver_params, lobpcg_initial_guess);
-  ASSERT(n_eigenvectors == eigenvectors.size(),
-         "Wrong number of computed eigenpairs");
+  // If the iteration budget was exhausted, fewer eigenpairs may have
+  // converged.
+  if (eigenvectors.size() < n_eigenvectors)
+    complete_eigenpairs(n_eigenvectors, agglomerate_operator, diagonal,
+                        initial_guess, real_eigenvalues, eigenvectors);
 
   // Copy real eigenvalues to complex
   std::copy(real_eigenvalues.begin(), real_eigenvalues.end(),
             eigenvalues.begin());
 }
+
+/**
+ * Return the rescaling given by the eigensolver parameter "drop_rescaling".
+ */
+DropRescaling
+get_drop_rescaling(boost::property_tree::ptree const &eigensolver_params)
+{
+  std::string const rescaling =
+      eigensolver_params.get("drop_rescaling", "row_sum");
+  if (rescaling == "norm")
+    return DropRescaling::norm;
+  if (rescaling == "none")
+    return DropRescaling::none;
+  ASSERT_THROW(rescaling == "row_sum",
+               "Unknown drop_rescaling: \"" + rescaling + "\"");
+  return DropRescaling::row_sum;
+}
+
+/**
+ * Return the weight of each dof of an agglomerate in the restriction, i.e.,
+ * the ratio of the local and the global diagonals.
+ */
+template <typename ScalarType>
+std::vector<double> compute_restriction_weights(
+    std::vector<ScalarType> const &diag_elements,
+    std::vector<dealii::types::global_dof_index> const &dof_indices_map,
+    dealii::LinearAlgebra::distributed::Vector<ScalarType> const
+        &locally_relevant_global_diag)
+{
+  unsigned int const n_elem = dof_indices_map.size();
+  ASSERT(diag_elements.size() == n_elem,
+         "diag_elements has the wrong size: " +
+             std::to_string(diag_elements.size()) + " instead of " +
+             std::to_string(n_elem));
+
+  std::vector<double> weights(n_elem);
+  for (unsigned int j = 0; j < n_elem; ++j)
+    weights[j] =
+        diag_elements[j] / locally_relevant_global_diag[dof_indices_map[j]];
+
+  return weights;
+}
+
+/**
+ * Return the positions of the entries of \p eigenvector that are larger than
+ * \p drop_tolerance times its largest entry in absolute value, and the factor
+ * by which these entries are scaled to compensate for the dropped ones. With
+ * row_sum, the sum of the entries of the eigenvector weighted by \p weights,
+ * i.e., of the row of the restriction, is preserved so that constants are
+ * restricted as before. With norm, the l2 norm of the eigenvector is
+ * preserved. The norm is also preserved when the row sum (nearly) vanishes,
+ * e.g., for oscillatory modes, or changes sign.
+ */
+std::pair<std::vector<unsigned int>, double>
+drop_small_entries(dealii::Vector<double> const &eigenvector,
+                   std::vector<double> const &weights,
+                   double const drop_tolerance, DropRescaling const rescaling)
+{
+  double const threshold = drop_tolerance * eigenvector.linfty_norm();
+  std::vector<unsigned int> kept_entries;
+  double row_sum = 0.;
+  double row_abs_sum = 0.;
+  double kept_row_sum = 0.;
+  double norm_square = 0.;
+  double kept_norm_square = 0.;
+  for (unsigned int j = 0; j < eigenvector.size(); ++j)
+  {
+    double const value = eigenvector[j];
+    row_sum += weights[j] * value;
+    row_abs_sum += std::abs(weights[j] * value);
+    norm_square += value * value;
+    if ((value != 0.) && (std::abs(value) >= threshold))
+    {
+      kept_entries.push_back(j);
+      kept_row_sum += weights[j] * value;
+      kept_norm_square += value * value;
+    }
+  }
+
+  double scaling = 1.;
+  if ((rescaling == DropRescaling::row_sum) &&
+      (std::abs(row_sum) > 1e-8 * row_abs_sum) && (kept_row_sum * row_sum > 0.))
+    scaling = row_sum / kept_row_sum;
+  else if ((rescaling != DropRescaling::none) && (kept_norm_square > 0.))
+    scaling = std::sqrt(norm_square / kept_norm_square);
+
+  return std::make_pair(kept_entries, scaling);
+}
 } // namespace
 
 template <int dim, typename MeshEvaluator, typename VectorType>
@@ -297,32 +582,76 @@ AMGe_host<dim, MeshEvaluator, VectorType>::compute_local_eigenvectors(
 
   using AgglomerateOperator = MatrixFreeAgglomerateOperator<MeshEvaluator>;
   AgglomerateOperator agglomerate_operator(evaluator, agglomerate_dof_handler,
-                                           agglomerate_constraints);
+                                           agglomerate_constraints,
+                                           patch_to_global_map);
 
   auto const diag_elements = agglomerate_operator.get_diag_elements();
 
-  // Compute the eigenvalues and the eigenvectors
+  // Compute the eigenvalues and the eigenvectors. The eigensolvers work
+  // directly on the vector type of the agglomerate operator so that the
+  // operator evaluations do not copy. The eigenvectors are only converted once
+  // they have been computed.
+  using AgglomerateVector = typename AgglomerateOperator::vector_type;
   unsigned int const n_dofs_agglomerate = agglomerate_operator.m();
   std::vector<std::complex<double>> eigenvalues(n_eigenvectors);
-  std::vector<dealii::Vector<double>> eigenvectors(
-      n_eigenvectors, dealii::Vector<double>(n_dofs_agglomerate));
+  std::vector<AgglomerateVector> agglomerate_eigenvectors(
+      n_eigenvectors, AgglomerateVector(n_dofs_agglomerate));
 
-  auto const eigensolver_type =
+  auto eigensolver_type =
       _eigensolver_params.get<std::string>("type", "lanczos");
   dealii::Vector<double> initial_vector(n_dofs_agglomerate);
   evaluator.set_initial_guess(agglomerate_constraints, initial_vector);
-  if (eigensolver_type == "lanczos")
+  AgglomerateVector agglomerate_initial_vector(n_dofs_agglomerate);
+  std::copy(initial_vector.begin(), initial_vector.end(),
+            agglomerate_initial_vector.begin());
+  if (n_eigenvectors == 0)
+  {
+    // The agglomerate does not contribute to the coarse space, see
+    // compute_n_agglomerate_eigenvectors().
+    eigensolver_type = "";
+  }
+  else if (eigensolver_type == "fast_diagonalization")
+  {
+    // Agglomerates without tensor-product structure use the fallback
+    // eigensolver. A fallback set to "none" makes them an error.
+    if (fast_diagonalization_compute_eigenvalues_and_eigenvectors(
+            n_eigenvectors,
+            _eigensolver_params.get("fast diagonalization tolerance", 1e-8),
+            agglomerate_dof_handler, agglomerate_constraints,
+            agglomerate_operator, eigenvalues, agglomerate_eigenvectors))
+      eigensolver_type = "";
+    else
+      eigensolver_type = _eigensolver_params.get<std::string>(
+          "fast diagonalization fallback", "lanczos");
+    ASSERT_THROW(eigensolver_type != "none",
+                 "The fast diagonalization failed on an agglomerate and "
+                 "\"fast diagonalization fallback\" is \"none\"");
+  }
+
+  if (eigensolver_type.empty())
+  {
+    // The eigenpairs have already been computed.
+  }
+  else if (eigensolver_type == "lanczos")
   {
     lanczos_compute_eigenvalues_and_eigenvectors(
         n_eigenvectors, tolerance, _eigensolver_params, agglomerate_operator,
-        initial_vector, eigenvalues, eigenvectors);
+        agglomerate_initial_vector, scratch_data.matrix_free_lanczos_vectors,
+        eigenvalues, agglomerate_eigenvectors);
+  }
+  else if (eigensolver_type == "block_lanczos")
+  {
+    block_lanczos_compute_eigenvalues_and_eigenvectors(
+        n_eigenvectors, tolerance, _eigensolver_params, agglomerate_operator,
+        agglomerate_initial_vector, scratch_data.matrix_free_lanczos_vectors,
+        eigenvalues, agglomerate_eigenvectors);
   }
   else if (eigensolver_type == "anasazi")
   {
     anasazi_compute_eigenvalues_and_eigenvectors(
         n_eigenvectors, _eigensolver_params, agglomerate_operator,
-        initial_vector, scratch_data.lobpcg_init_guess, eigenvalues,
-        eigenvectors);
+        diag_elements, agglomerate_initial_vector,
+        scratch_data.lobpcg_init_guess, eigenvalues, agglomerate_eigenvectors);
   }
   else if (eigensolver_type == "arpack")
   {
@@ -339,6 +668,18 @@ AMGe_host<dim, MeshEvaluator, VectorType>::compute_local_eigenvectors(
     ASSERT(false, "Unknown eigensolver type '" + eigensolver_type + "'");
   }
 
+  auto const near_nullspace = evaluator.get_near_nullspace(
+      agglomerate_dof_handler, agglomerate_constraints);
+  if (!near_nullspace.empty())
+    add_near_nullspace(agglomerate_operator, agglomerate_constraints,
+                       near_nullspace, eigenvalues, agglomerate_eigenvectors);
+
+  std::vector<dealii::Vector<double>> eigenvectors(
+      n_eigenvectors, dealii::Vector<double>(n_dofs_agglomerate));
+  for (unsigned int i = 0; i < n_eigenvectors; ++i)
+    std::copy(agglomerate_eigenvectors[i].begin(),
+              agglomerate_eigenvectors[i].end(), eigenvectors[i].begin());
+
   // Compute the map between the local and the global dof indices.
   std::vector<dealii::types::global_dof_index> dof_indices_map =
       this->compute_dof_index_map(patch_to_global_map, agglomerate_dof_handler);
@@ -366,9 +707,12 @@ AMGe_host<dim, MeshEvaluator, VectorType>::compute_local_eigenvectors(
 {
   dealii::DoFHandler<dim> agglomerate_dof_handler(agglomerate_triangulation);
   dealii::AffineConstraints<double> agglomerate_constraints;
-  using value_type = typename VectorType::value_type;
-  dealii::SparsityPattern agglomerate_sparsity_pattern;
-  dealii::SparseMatrix<value_type> agglomerate_system_matrix;
+  // The sparsity pattern and the system matrix are reinitialized by the
+  // evaluator. They reuse the memory of the previous agglomerate.
+  dealii::SparsityPattern &agglomerate_sparsity_pattern =
+      scratch_data.sparsity_pattern;
+  dealii::SparseMatrix<double> &agglomerate_system_matrix =
+      scratch_data.system_matrix;
 
   // Call user function to build the system matrix
   evaluator.evaluate_agglomerate(
@@ -381,17 +725,9 @@ AMGe_host<dim, MeshEvaluator, VectorType>::compute_local_eigenvectors(
   for (unsigned int i = 0; i < size; ++i)
     diag_elements[i] = agglomerate_system_matrix.diag_element(i);
 
-  // Shift eigenvalues away from zero
-  double const average_diagonal =
-      std::accumulate(diag_elements.begin(), diag_elements.end(), 0.) / size;
-  for (unsigned int i = 0; i < size; ++i)
-    agglomerate_system_matrix.diag_element(i) += average_diagonal;
-  // Shift diagonal entries for constrained degrees of freedom, to avoid
-  // using the corresponding eigenvectors
-  for (auto const constraint : agglomerate_constraints.get_lines())
-  {
-    agglomerate_system_matrix.diag_element(constraint.index) = 200;
-  }
+  // Compute the map between the local and the global dof indices.
+  std::vector<dealii::types::global_dof_index> dof_indices_map =
+      this->compute_dof_index_map(patch_to_global_map, agglomerate_dof_handler);
 
   // Compute the eigenvalues and the eigenvectors
   unsigned int const n_dofs_agglomerate = agglomerate_system_matrix.m();
@@ -399,21 +735,151 @@ AMGe_host<dim, MeshEvaluator, VectorType>::compute_local_eigenvectors(
   // Arpack only works with double not float
   std::vector<dealii::Vector<double>> eigenvectors(
       n_eigenvectors, dealii::Vector<double>(n_dofs_agglomerate));
+  auto const near_nullspace = evaluator.get_near_nullspace(
+      agglomerate_dof_handler, agglomerate_constraints);
+
+  auto eigensolver_type =
+      _eigensolver_params.get<std::string>("type", "arpack");
+  if (eigensolver_type == "fast_diagonalization")
+  {
+    // The fast diagonalization works on the unshifted matrix. Agglomerates
+    // without tensor-product structure use the fallback eigensolver. A
+    // fallback set to "none" makes them an error.
+    if (fast_diagonalization_compute_eigenvalues_and_eigenvectors(
+            n_eigenvectors,
+            _eigensolver_params.get("fast diagonalization tolerance", 1e-8),
+            agglomerate_dof_handler, agglomerate_constraints,
+            agglomerate_system_matrix, eigenvalues, eigenvectors))
+    {
+      if (!near_nullspace.empty())
+        add_near_nullspace(agglomerate_system_matrix, agglomerate_constraints,
+                           near_nullspace, eigenvalues, eigenvectors);
+
+      return std::make_tuple(eigenvalues, eigenvectors, diag_elements,
+                             dof_indices_map);
+    }
+
+    eigensolver_type = _eigensolver_params.get<std::string>(
+        "fast diagonalization fallback", "arpack");
+    ASSERT_THROW(eigensolver_type != "none",
+                 "The fast diagonalization failed on an agglomerate and "
+                 "\"fast diagonalization fallback\" is \"none\"");
+  }
 
   dealii::Vector<double> initial_vector(n_dofs_agglomerate);
   evaluator.set_initial_guess(agglomerate_constraints, initial_vector);
-  auto const eigensolver_type =
-      _eigensolver_params.get<std::string>("type", "arpack");
-  if (eigensolver_type == "arpack")
+
+  // The constrained dofs are eliminated: the eigenproblem is solved on the
+  // unconstrained dofs only and the eigenvectors are extended by zero. This
+  // avoids polluting the spectrum with the eigenvalues of the constrained
+  // rows. Without constraints, the matrix of the agglomerate is used as is.
+  std::vector<unsigned int> free_dofs;
+  free_dofs.reserve(size);
+  for (unsigned int i = 0; i < size; ++i)
+    if (!agglomerate_constraints.is_constrained(i))
+      free_dofs.push_back(i);
+  unsigned int const n_free_dofs = free_dofs.size();
+  bool const eliminate_constraints = n_free_dofs < size;
+
+  // Shift eigenvalues away from zero by the average diagonal of the rows of
+  // the eigenproblem. The diagonal entries of the constrained rows, whatever
+  // their value, do not change the shift.
+  double average_diagonal = 0.;
+  for (auto const i : free_dofs)
+    average_diagonal += diag_elements[i];
+  if (n_free_dofs > 0)
+    average_diagonal /= n_free_dofs;
+  for (unsigned int i = 0; i < size; ++i)
+    agglomerate_system_matrix.diag_element(i) += average_diagonal;
+
+  // setup_restrictor() clamps the number of eigenvectors to the number of
+  // dofs that are not constrained globally, see
+  // compute_n_agglomerate_eigenvectors(). If the agglomerate has even fewer
+  // unconstrained dofs, the missing eigenvectors are zero so that the rows of
+  // the restriction matrix stay consistent with its sparsity pattern.
+  unsigned int const n_solved_eigenvectors =
+      std::min(n_eigenvectors, n_free_dofs);
+  eigenvalues.resize(n_solved_eigenvectors);
+  eigenvectors.resize(n_solved_eigenvectors);
+  // The iterative eigensolvers are not meant for agglomerates that have
+  // barely more unconstrained dofs than eigenvectors requested, e.g., ARPACK
+  // needs more dofs than Arnoldi vectors. These agglomerates use the
+  // eigensolver given by "small agglomerate type".
+  if (n_solved_eigenvectors == 0)
+    eigensolver_type = "";
+  else if (n_free_dofs <= 2 * n_solved_eigenvectors + 2)
+    eigensolver_type = _eigensolver_params.get<std::string>(
+        "small agglomerate type", "lapack");
+
+  std::vector<dealii::Vector<double>> free_eigenvectors;
+  std::vector<dealii::Vector<double>> free_lobpcg_init_guess;
+  dealii::Vector<double> free_initial_vector;
+  if (eliminate_constraints)
+  {
+    unsigned int const invalid = dealii::numbers::invalid_unsigned_int;
+    std::vector<unsigned int> free_index(size, invalid);
+    for (unsigned int i = 0; i < n_free_dofs; ++i)
+      free_index[free_dofs[i]] = i;
+
+    dealii::DynamicSparsityPattern &free_dsp =
+        scratch_data.free_dynamic_sparsity_pattern;
+    free_dsp.reinit(n_free_dofs, n_free_dofs);
+    for (unsigned int i = 0; i < n_free_dofs; ++i)
+      for (auto entry = agglomerate_system_matrix.begin(free_dofs[i]);
+           entry != agglomerate_system_matrix.end(free_dofs[i]); ++entry)
+        if (free_index[entry->column()] != invalid)
+          free_dsp.add(i, free_index[entry->column()]);
+    scratch_data.free_sparsity_pattern.copy_from(free_dsp);
+    scratch_data.free_system_matrix.reinit(scratch_data.free_sparsity_pattern);
+    for (unsigned int i = 0; i < n_free_dofs; ++i)
+      for (auto entry = agglomerate_system_matrix.begin(free_dofs[i]);
+           entry != agglomerate_system_matrix.end(free_dofs[i]); ++entry)
+        if (free_index[entry->column()] != invalid)
+          scratch_data.free_system_matrix.set(
+              i, free_index[entry->column()], entry->value());
+
+    free_initial_vector.reinit(n_free_dofs);
+    for (unsigned int i = 0; i < n_free_dofs; ++i)
+      free_initial_vector[i] = initial_vector[free_dofs[i]];
+    free_eigenvectors.resize(n_solved_eigenvectors,
+                             dealii::Vector<double>(n_free_dofs));
+    // The initial guess of LOBPCG is given on the whole agglomerate.
+    auto const &lobpcg_init_guess = scratch_data.lobpcg_init_guess;
+    if ((lobpcg_init_guess.size() > 0) && (lobpcg_init_guess[0].size() == size))
+    {
+      free_lobpcg_init_guess.resize(lobpcg_init_guess.size(),
+                                    dealii::Vector<double>(n_free_dofs));
+      for (unsigned int j = 0; j < lobpcg_init_guess.size(); ++j)
+        for (unsigned int i = 0; i < n_free_dofs; ++i)
+          free_lobpcg_init_guess[j][i] = lobpcg_init_guess[j][free_dofs[i]];
+    }
+  }
+
+  dealii::SparseMatrix<double> const &local_matrix =
+      eliminate_constraints ? scratch_data.free_system_matrix
+                            : agglomerate_system_matrix;
+  dealii::Vector<double> const &local_initial_vector =
+      eliminate_constraints ? free_initial_vector : initial_vector;
+  std::vector<dealii::Vector<double>> &local_eigenvectors =
+      eliminate_constraints ? free_eigenvectors : eigenvectors;
+  std::vector<dealii::Vector<double>> const &local_lobpcg_init_guess =
+      eliminate_constraints ? free_lobpcg_init_guess
+                            : scratch_data.lobpcg_init_guess;
+
+  if (eigensolver_type.empty())
+  {
+    // The agglomerate has no unconstrained dof.
+  }
+  else if (eigensolver_type == "arpack")
   {
     // Make Identity mass matrix
     Identity agglomerate_mass_matrix;
 
     dealii::SparseDirectUMFPACK inv_system_matrix;
-    inv_system_matrix.initialize(agglomerate_system_matrix);
+    inv_system_matrix.initialize(local_matrix);
 
-    dealii::SolverControl solver_control(n_dofs_agglomerate, tolerance);
-    unsigned int const n_arnoldi_vectors = 2 * n_eigenvectors + 2;
+    dealii::SolverControl solver_control(n_free_dofs, tolerance);
+    unsigned int const n_arnoldi_vectors = 2 * n_solved_eigenvectors + 2;
     bool const symmetric = true;
     // We want the eigenvalues of the smallest magnitudes but we need to ask
     // for the ones with the largest magnitudes because they are computed for
@@ -426,57 +892,95 @@ AMGe_host<dim, MeshEvaluator, VectorType>::compute_local_eigenvectors(
 
     // Compute the eigenvectors. Arpack outputs eigenvectors with a L2 norm of
     // one.
-    solver.set_initial_vector(initial_vector);
-    solver.solve(agglomerate_system_matrix, agglomerate_mass_matrix,
-                 inv_system_matrix, eigenvalues, eigenvectors);
+    solver.set_initial_vector(local_initial_vector);
+    solver.solve(local_matrix, agglomerate_mass_matrix, inv_system_matrix,
+                 eigenvalues, local_eigenvectors);
   }
   else if (eigensolver_type == "lanczos")
   {
     lanczos_compute_eigenvalues_and_eigenvectors(
-        n_eigenvectors, tolerance, _eigensolver_params,
-        agglomerate_system_matrix, initial_vector, eigenvalues, eigenvectors);
+        n_solved_eigenvectors, tolerance, _eigensolver_params, local_matrix,
+        local_initial_vector, scratch_data.lanczos_vectors, eigenvalues,
+        local_eigenvectors);
+  }
+  else if (eigensolver_type == "block_lanczos")
+  {
+    block_lanczos_compute_eigenvalues_and_eigenvectors(
+        n_solved_eigenvectors, tolerance, _eigensolver_params, local_matrix,
+        local_initial_vector, scratch_data.lanczos_vectors, eigenvalues,
+        local_eigenvectors);
   }
   else if (eigensolver_type == "anasazi")
   {
+    // The diagonal of the shifted matrix is used to complete the eigenpairs
+    // if the solver does not converge.
+    std::vector<double> shifted_diag_elements(n_free_dofs);
+    for (unsigned int i = 0; i < n_free_dofs; ++i)
+      shifted_diag_elements[i] = local_matrix.diag_element(i);
     anasazi_compute_eigenvalues_and_eigenvectors(
-        n_eigenvectors, _eigensolver_params, agglomerate_system_matrix,
-        initial_vector, scratch_data.lobpcg_init_guess, eigenvalues,
-        eigenvectors);
+        n_solved_eigenvectors, _eigensolver_params, local_matrix,
+        shifted_diag_elements, local_initial_vector, local_lobpcg_init_guess,
+        eigenvalues, local_eigenvectors);
   }
   else if (eigensolver_type == "lapack")
   {
     // Use Lapack to compute the eigenvalues
     dealii::LAPACKFullMatrix<double> full_matrix;
-    full_matrix.copy_from(agglomerate_system_matrix);
+    full_matrix.copy_from(local_matrix);
 
+    // The eigenvalues of the shifted matrix are bounded by the largest
+    // absolute row sum.
     double const lower_bound = -0.5;
-    double const upper_bound = 100.;
+    double upper_bound = 100.;
+    for (unsigned int i = 0; i < n_free_dofs; ++i)
+    {
+      double row_sum = 0.;
+      for (auto entry = local_matrix.begin(i); entry != local_matrix.end(i);
+           ++entry)
+        row_sum += std::abs(entry->value());
+      upper_bound = std::max(upper_bound, 1.1 * row_sum);
+    }
     double const tol = 1e-12;
-    dealii::Vector<double> lapack_eigenvalues(size);
+    dealii::Vector<double> lapack_eigenvalues(n_free_dofs);
     dealii::FullMatrix<double> lapack_eigenvectors;
     full_matrix.compute_eigenvalues_symmetric(
         lower_bound, upper_bound, tol, lapack_eigenvalues, lapack_eigenvectors);
 
     // Copy the eigenvalues and the eigenvectors in the right format
-    for (unsigned int i = 0; i < n_eigenvectors; ++i)
+    for (unsigned int i = 0; i < n_solved_eigenvectors; ++i)
       eigenvalues[i] = lapack_eigenvalues[i];
 
-    for (unsigned int i = 0; i < n_eigenvectors; ++i)
-      for (unsigned int j = 0; j < n_dofs_agglomerate; ++j)
-        eigenvectors[i][j] = lapack_eigenvectors[j][i];
+    for (unsigned int i = 0; i < n_solved_eigenvectors; ++i)
+      for (unsigned int j = 0; j < n_free_dofs; ++j)
+        local_eigenvectors[i][j] = lapack_eigenvectors[j][i];
   }
   else
   {
     ASSERT(false, "Unknown eigensolver type '" + eigensolver_type + "'");
   }
 
+  // Extend the eigenvectors by zero on the constrained dofs
+  if (eliminate_constraints)
+    for (unsigned int i = 0; i < n_solved_eigenvectors; ++i)
+    {
+      eigenvectors[i] = 0.;
+      for (unsigned int j = 0; j < n_free_dofs; ++j)
+        eigenvectors[i][free_dofs[j]] = free_eigenvectors[i][j];
+    }
+
+  // The Rayleigh quotients are computed with the shifted matrix like the
+  // eigenvalues.
+  if (!near_nullspace.empty())
+    add_near_nullspace(agglomerate_system_matrix, agglomerate_constraints,
+                       near_nullspace, eigenvalues, eigenvectors);
+
   // Shift eigenvalues back
-  for (unsigned int i = 0; i < n_eigenvectors; ++i)
+  for (unsigned int i = 0; i < n_solved_eigenvectors; ++i)
     eigenvalues[i] -= average_diagonal;
 
-  // Compute the map between the local and the global dof indices.
-  std::vector<dealii::types::global_dof_index> dof_indices_map =
-      this->compute_dof_index_map(patch_to_global_map, agglomerate_dof_handler);
+  // Pad with zero eigenpairs
+  eigenvalues.resize(n_eigenvectors, 0.);
+  eigenvectors.resize(n_eigenvectors, dealii::Vector<double>(size));
 
   return std::make_tuple(eigenvalues, eigenvectors, diag_elements,
                          dof_indices_map);
@@ -494,14 +998,39 @@ void AMGe_host<dim, MeshEvaluator, VectorType>::setup_restrictor(
   // Flag the cells to build agglomerates.
   unsigned int const n_agglomerates =
       this->build_agglomerates(agglomerate_ptree);
+  std::vector<unsigned int> const n_agglomerate_eigenvectors =
+      compute_n_agglomerate_eigenvectors(n_agglomerates, n_eigenvectors,
+                                         evaluator);
+
+  // The graph of the restriction matrix only depends on the agglomerates so we
+  // can build the matrix before computing the eigenvectors. The results of
+  // each agglomerate are then inserted as soon as they are available and
+  // discarded.
+  dealii::TrilinosWrappers::SparsityPattern restriction_sp =
+      this->compute_restriction_sparsity_pattern(n_agglomerate_eigenvectors);
+  dealii::types::global_dof_index row = restriction_sp.local_range().first;
+  // When small entries are dropped, the graph of the restriction matrix is
+  // only known once the eigenvectors are computed. The kept entries are then
+  // stored by rows and the matrix is built from their sparsity pattern at the
+  // end.
+  double const drop_tolerance = _eigensolver_params.get("drop_tolerance", 0.);
+  bool const drop_entries = drop_tolerance > 0.;
+  DropRescaling const drop_rescaling = get_drop_rescaling(_eigensolver_params);
+  DroppedRows dropped_rows;
+  if (!drop_entries)
+    restriction_sparse_matrix.reinit(restriction_sp);
+
+#if MFMG_DEBUG
+  // The diagonals and the dof maps of the agglomerates are only kept to check
+  // the restriction matrix.
+  std::vector<std::vector<ScalarType>> diag_elements;
+  std::vector<std::vector<dealii::types::global_dof_index>> dof_indices_maps;
+  std::vector<unsigned int> n_local_eigenvectors;
+#endif
 
   // Parallel part of the setup.
   std::vector<unsigned int> agglomerate_ids(n_agglomerates);
   std::iota(agglomerate_ids.begin(), agglomerate_ids.end(), 1);
-  std::vector<dealii::Vector<double>> eigenvectors;
-  std::vector<std::vector<ScalarType>> diag_elements;
-  std::vector<std::vector<dealii::types::global_dof_index>> dof_indices_maps;
-  std::vector<unsigned int> n_local_eigenvectors;
   LobpcgScratchData scratch_data;
   CopyData copy_data;
 
@@ -509,29 +1038,46 @@ void AMGe_host<dim, MeshEvaluator, VectorType>::setup_restrictor(
       agglomerate_ids.begin(), agglomerate_ids.end(),
       [&](std::vector<unsigned int>::iterator const &agg_id,
           LobpcgScratchData &local_scratch_data, CopyData &local_copy_data) {
-        this->local_worker(n_eigenvectors, tolerance, evaluator, agg_id,
-                           local_scratch_data, local_copy_data);
+        this->local_worker(n_agglomerate_eigenvectors[*agg_id - 1],
+                           tolerance, evaluator, agg_id, local_scratch_data,
+                           local_copy_data);
       },
       [&](CopyData const &local_copy_data) {
-        this->copy_local_to_global(local_copy_data, eigenvectors, diag_elements,
-                                   dof_indices_maps, n_local_eigenvectors);
+        if (drop_entries)
+          this->copy_local_to_dropped_rows(
+              local_copy_data, locally_relevant_global_diag, drop_tolerance,
+              drop_rescaling, dropped_rows);
+        else
+          this->copy_local_to_restriction(
+              local_copy_data, locally_relevant_global_diag, row,
+              restriction_sparse_matrix, nullptr, nullptr);
+#if MFMG_DEBUG
+        diag_elements.push_back(local_copy_data.diag_elements);
+        dof_indices_maps.push_back(local_copy_data.local_dof_indices_map);
+        n_local_eigenvectors.push_back(
+            local_copy_data.local_eigenvectors.size());
+#endif
       },
       scratch_data, copy_data);
 
-  AMGe<dim, VectorType>::compute_restriction_sparse_matrix(
-      eigenvectors, diag_elements, dof_indices_maps, n_local_eigenvectors,
-      locally_relevant_global_diag, restriction_sparse_matrix);
+  if (drop_entries)
+    build_dropped_matrices(dropped_rows, restriction_sp,
+                           restriction_sparse_matrix, nullptr, nullptr);
+  else
+    restriction_sparse_matrix.compress(dealii::VectorOperation::add);
 
+#if MFMG_DEBUG
   // When checking the restriction matrix, we check that the sum of the local
   // diagonals is the global diagonals. This is not true for matrix-free because
   // the constraints values are set arbitrarily.
   if (std::is_base_of<DealIIMatrixFreeMeshEvaluator<dim>,
                       MeshEvaluator>::value == false)
   {
-    check_restriction_matrix(this->_comm, eigenvectors, dof_indices_maps,
+    check_restriction_matrix(this->_comm, dof_indices_maps,
                              locally_relevant_global_diag, diag_elements,
                              n_local_eigenvectors);
   }
+#endif
 }
 
 template <int dim, typename MeshEvaluator, typename VectorType>
@@ -552,14 +1098,46 @@ void AMGe_host<dim, MeshEvaluator, VectorType>::setup_restrictor(
   // Flag the cells to build agglomerates.
   unsigned int const n_agglomerates =
       this->build_agglomerates(agglomerate_ptree);
+  std::vector<unsigned int> const n_agglomerate_eigenvectors =
+      compute_n_agglomerate_eigenvectors(n_agglomerates, n_eigenvectors,
+                                         evaluator);
+
+  // Build the sparse matrices before computing the eigenvectors, see above.
+  dealii::TrilinosWrappers::SparsityPattern restriction_sp =
+      this->compute_restriction_sparsity_pattern(n_agglomerate_eigenvectors);
+  double const drop_tolerance = _eigensolver_params.get("drop_tolerance", 0.);
+  bool const drop_entries = drop_tolerance > 0.;
+  DropRescaling const drop_rescaling = get_drop_rescaling(_eigensolver_params);
+  DroppedRows dropped_rows;
+  dropped_rows.store_eigenvectors = true;
+  if (drop_entries)
+  {
+    // All the matrices are built from the kept entries at the end
+    eigenvector_sparse_matrix.reset(
+        new dealii::TrilinosWrappers::SparseMatrix());
+    delta_eigenvector_matrix.reset(
+        new dealii::TrilinosWrappers::SparseMatrix());
+  }
+  else
+  {
+    restriction_sparse_matrix->reinit(restriction_sp);
+    eigenvector_sparse_matrix.reset(
+        new dealii::TrilinosWrappers::SparseMatrix(restriction_sp));
+    // The sparsity pattern is different than for the other sparse matrices
+    // because some of the entries that do not correspond to agglomerate
+    // boundary are zeros. Because reinit requires the SparsityPattern which is
+    // harder to compute, we instead use the constructor that computes the
+    // SparsityPattern when compress() is called).
+    delta_eigenvector_matrix.reset(new dealii::TrilinosWrappers::SparseMatrix(
+        restriction_sp.locally_owned_range_indices(),
+        restriction_sp.locally_owned_domain_indices(),
+        restriction_sp.get_mpi_communicator()));
+  }
+  dealii::types::global_dof_index row = restriction_sp.local_range().first;
 
   // Parallel part of the setup.
   std::vector<unsigned int> agglomerate_ids(n_agglomerates);
   std::iota(agglomerate_ids.begin(), agglomerate_ids.end(), 1);
-  std::vector<dealii::Vector<double>> eigenvectors;
-  std::vector<std::vector<ScalarType>> diag_elements;
-  std::vector<std::vector<dealii::types::global_dof_index>> dof_indices_maps;
-  std::vector<unsigned int> n_local_eigenvectors;
   LobpcgScratchData scratch_data;
   CopyData copy_data;
 
@@ -567,20 +1145,77 @@ void AMGe_host<dim, MeshEvaluator, VectorType>::setup_restrictor(
       agglomerate_ids.begin(), agglomerate_ids.end(),
       [&](std::vector<unsigned int>::iterator const &agg_id,
           LobpcgScratchData &local_scratch_data, CopyData &local_copy_data) {
-        this->local_worker(n_eigenvectors, tolerance, evaluator, agg_id,
-                           local_scratch_data, local_copy_data);
+        this->local_worker(n_agglomerate_eigenvectors[*agg_id - 1],
+                           tolerance, evaluator, agg_id, local_scratch_data,
+                           local_copy_data);
       },
       [&](CopyData const &local_copy_data) {
-        this->copy_local_to_global_eig(local_copy_data, eigenvalues,
-                                       eigenvectors, diag_elements,
-                                       dof_indices_maps, n_local_eigenvectors);
+        if (drop_entries)
+          this->copy_local_to_dropped_rows(
+              local_copy_data, locally_relevant_global_diag, drop_tolerance,
+              drop_rescaling, dropped_rows);
+        else
+          this->copy_local_to_restriction(
+              local_copy_data, locally_relevant_global_diag, row,
+              *restriction_sparse_matrix, eigenvector_sparse_matrix.get(),
+              delta_eigenvector_matrix.get());
+        std::transform(local_copy_data.local_eigenvalues.begin(),
+                       local_copy_data.local_eigenvalues.end(),
+                       std::back_inserter(eigenvalues),
+                       [](std::complex<double> const &z) { return z.real(); });
       },
       scratch_data, copy_data);
 
-  AMGe<dim, VectorType>::compute_restriction_sparse_matrix(
-      eigenvectors, diag_elements, dof_indices_maps, n_local_eigenvectors,
-      locally_relevant_global_diag, restriction_sparse_matrix,
-      eigenvector_sparse_matrix, delta_eigenvector_matrix);
+  // Compress the matrices
+  if (drop_entries)
+  {
+    build_dropped_matrices(dropped_rows, restriction_sp,
+                           *restriction_sparse_matrix,
+                           eigenvector_sparse_matrix.get(),
+                           delta_eigenvector_matrix.get());
+  }
+  else
+  {
+    restriction_sparse_matrix->compress(dealii::VectorOperation::add);
+    eigenvector_sparse_matrix->compress(dealii::VectorOperation::add);
+    delta_eigenvector_matrix->compress(dealii::VectorOperation::insert);
+  }
+}
+
+template <int dim, typename MeshEvaluator, typename VectorType>
+std::vector<unsigned int>
+AMGe_host<dim, MeshEvaluator, VectorType>::compute_n_agglomerate_eigenvectors(
+    unsigned int const n_agglomerates, unsigned int const n_eigenvectors,
+    MeshEvaluator const &evaluator) const
+{
+  // Collect the unconstrained dofs of the locally owned cells of each
+  // agglomerate.
+  auto const &constraints = evaluator.get_constraints();
+  std::vector<std::set<dealii::types::global_dof_index>> free_dofs(
+      n_agglomerates);
+  std::vector<dealii::types::global_dof_index> dof_indices(
+      this->_dof_handler.get_fe().dofs_per_cell);
+  for (auto cell : this->_dof_handler.active_cell_iterators())
+  {
+    if (!cell->is_locally_owned())
+      continue;
+
+    unsigned int const agglomerate_id = cell->user_index();
+    if ((agglomerate_id == 0) || (agglomerate_id > n_agglomerates))
+      continue;
+
+    cell->get_dof_indices(dof_indices);
+    for (auto const dof : dof_indices)
+      if (!constraints.is_constrained(dof))
+        free_dofs[agglomerate_id - 1].insert(dof);
+  }
+
+  std::vector<unsigned int> n_agglomerate_eigenvectors(n_agglomerates);
+  for (unsigned int i = 0; i < n_agglomerates; ++i)
+    n_agglomerate_eigenvectors[i] = std::min(
+        n_eigenvectors, static_cast<unsigned int>(free_dofs[i].size()));
+
+  return n_agglomerate_eigenvectors;
 }
 
 template <int dim, typename MeshEvaluator, typename VectorType>
@@ -615,39 +1250,147 @@ void AMGe_host<dim, MeshEvaluator, VectorType>::local_worker(
 }
 
 template <int dim, typename MeshEvaluator, typename VectorType>
-void AMGe_host<dim, MeshEvaluator, VectorType>::copy_local_to_global(
+void AMGe_host<dim, MeshEvaluator, VectorType>::copy_local_to_restriction(
     CopyData const &copy_data,
-    std::vector<dealii::Vector<double>> &eigenvectors,
-    std::vector<std::vector<typename VectorType::value_type>> &diag_elements,
-    std::vector<std::vector<dealii::types::global_dof_index>> &dof_indices_maps,
-    std::vector<unsigned int> &n_local_eigenvectors)
+    dealii::LinearAlgebra::distributed::Vector<
+        typename VectorType::value_type> const &locally_relevant_global_diag,
+    dealii::types::global_dof_index &row,
+    dealii::TrilinosWrappers::SparseMatrix &restriction_sparse_matrix,
+    dealii::TrilinosWrappers::SparseMatrix *eigenvector_sparse_matrix,
+    dealii::TrilinosWrappers::SparseMatrix *delta_eigenvector_matrix)
 {
-  eigenvectors.insert(eigenvectors.end(), copy_data.local_eigenvectors.begin(),
-                      copy_data.local_eigenvectors.end());
+  auto const &dof_indices_map = copy_data.local_dof_indices_map;
+  unsigned int const n_elem = dof_indices_map.size();
+  std::vector<double> const weights = compute_restriction_weights(
+      copy_data.diag_elements, dof_indices_map, locally_relevant_global_diag);
+
+  std::vector<dealii::TrilinosScalar> values(n_elem);
+  for (auto const &eigenvector : copy_data.local_eigenvectors)
+  {
+    ASSERT(eigenvector.size() == n_elem,
+           "The eigenvector has the wrong size: " +
+               std::to_string(eigenvector.size()) + " instead of " +
+               std::to_string(n_elem));
 
-  diag_elements.push_back(copy_data.diag_elements);
+    // Fill restriction sparse matrix
+    for (unsigned int j = 0; j < n_elem; ++j)
+      values[j] = weights[j] * eigenvector[j];
+    restriction_sparse_matrix.add(row, dof_indices_map, values, false);
 
-  dof_indices_maps.push_back(copy_data.local_dof_indices_map);
+    if (eigenvector_sparse_matrix != nullptr)
+    {
+      // Fill eigenvector sparse matrix
+      std::copy(eigenvector.begin(), eigenvector.end(), values.begin());
+      eigenvector_sparse_matrix->add(row, dof_indices_map, values, false);
+    }
+
+    if (delta_eigenvector_matrix != nullptr)
+    {
+      // Fill delta eigenvector sparse matrix
+      for (unsigned int j = 0; j < n_elem; ++j)
+        values[j] = (weights[j] - 1.) * eigenvector[j];
+      delta_eigenvector_matrix->set(row, dof_indices_map, values, false);
+    }
+
+    ++row;
+  }
+}
+
+template <int dim, typename MeshEvaluator, typename VectorType>
+void AMGe_host<dim, MeshEvaluator, VectorType>::copy_local_to_dropped_rows(
+    CopyData const &copy_data,
+    dealii::LinearAlgebra::distributed::Vector<
+        typename VectorType::value_type> const &locally_relevant_global_diag,
+    double const drop_tolerance, DropRescaling const drop_rescaling,
+    DroppedRows &dropped_rows) const
+{
+  auto const &dof_indices_map = copy_data.local_dof_indices_map;
+  std::vector<double> const weights = compute_restriction_weights(
+      copy_data.diag_elements, dof_indices_map, locally_relevant_global_diag);
 
-  n_local_eigenvectors.push_back(copy_data.local_eigenvectors.size());
+  for (auto const &eigenvector : copy_data.local_eigenvectors)
+  {
+    ASSERT(eigenvector.size() == dof_indices_map.size(),
+           "The eigenvector has the wrong size: " +
+               std::to_string(eigenvector.size()) + " instead of " +
+               std::to_string(dof_indices_map.size()));
+
+    std::vector<unsigned int> kept_entries;
+    double scaling = 1.;
+    std::tie(kept_entries, scaling) = drop_small_entries(
+        eigenvector, weights, drop_tolerance, drop_rescaling);
+    for (auto const j : kept_entries)
+    {
+      dropped_rows.indices.push_back(dof_indices_map[j]);
+      dropped_rows.restriction_values.push_back(weights[j] * scaling *
+                                                eigenvector[j]);
+      if (dropped_rows.store_eigenvectors)
+        dropped_rows.eigenvector_values.push_back(scaling * eigenvector[j]);
+    }
+    dropped_rows.offsets.push_back(dropped_rows.indices.size());
+  }
 }
 
 template <int dim, typename MeshEvaluator, typename VectorType>
-void AMGe_host<dim, MeshEvaluator, VectorType>::copy_local_to_global_eig(
-    CopyData const &copy_data, std::vector<double> &eigenvalues,
-    std::vector<dealii::Vector<double>> &eigenvectors,
-    std::vector<std::vector<typename VectorType::value_type>> &diag_elements,
-    std::vector<std::vector<dealii::types::global_dof_index>> &dof_indices_maps,
-    std::vector<unsigned int> &n_local_eigenvectors)
+void AMGe_host<dim, MeshEvaluator, VectorType>::build_dropped_matrices(
+    DroppedRows const &dropped_rows,
+    dealii::TrilinosWrappers::SparsityPattern const &restriction_sp,
+    dealii::TrilinosWrappers::SparseMatrix &restriction_sparse_matrix,
+    dealii::TrilinosWrappers::SparseMatrix *eigenvector_sparse_matrix,
+    dealii::TrilinosWrappers::SparseMatrix *delta_eigenvector_matrix) const
 {
-  copy_local_to_global(copy_data, eigenvectors, diag_elements, dof_indices_maps,
-                       n_local_eigenvectors);
+  using size_type = dealii::TrilinosWrappers::SparsityPattern::size_type;
+  auto const &offsets = dropped_rows.offsets;
+  unsigned int const n_rows = offsets.size() - 1;
+  dealii::types::global_dof_index const first_row =
+      restriction_sp.local_range().first;
+  ASSERT(first_row + n_rows == restriction_sp.local_range().second,
+         "The number of dropped rows does not match the number of locally "
+         "owned rows of the restriction");
+
+  // The length of the rows is known so the pattern is allocated once
+  std::vector<size_type> n_entries_per_row(n_rows);
+  for (unsigned int k = 0; k < n_rows; ++k)
+    n_entries_per_row[k] = offsets[k + 1] - offsets[k];
+  dealii::TrilinosWrappers::SparsityPattern dropped_sp(
+      restriction_sp.locally_owned_range_indices(),
+      restriction_sp.locally_owned_domain_indices(),
+      restriction_sp.get_mpi_communicator(), n_entries_per_row);
+  auto const indices = dropped_rows.indices.begin();
+  for (unsigned int k = 0; k < n_rows; ++k)
+    dropped_sp.add_entries(first_row + k, indices + offsets[k],
+                           indices + offsets[k + 1]);
+  dropped_sp.compress();
+
+  auto set_rows = [&](dealii::TrilinosWrappers::SparseMatrix &matrix,
+                      std::vector<double> const &values) {
+    matrix.reinit(dropped_sp);
+    for (unsigned int k = 0; k < n_rows; ++k)
+      matrix.set(first_row + k, n_entries_per_row[k],
+                 dropped_rows.indices.data() + offsets[k],
+                 values.data() + offsets[k], false);
+    matrix.compress(dealii::VectorOperation::insert);
+  };
+  set_rows(restriction_sparse_matrix, dropped_rows.restriction_values);
+
+  if (eigenvector_sparse_matrix != nullptr)
+  {
+    ASSERT(dropped_rows.store_eigenvectors,
+           "The values of the eigenvectors were not stored");
+    set_rows(*eigenvector_sparse_matrix, dropped_rows.eigenvector_values);
+  }
 
-  std::transform(copy_data.local_eigenvalues.begin(),
-                 copy_data.local_eigenvalues.end(),
-                 std::back_inserter(eigenvalues),
-                 [](std::complex<double> const &z) { return z.real(); });
+  if (delta_eigenvector_matrix != nullptr)
+  {
+    // The entries of the delta eigenvector matrix are the differences of the
+    // entries of the restriction and of the eigenvector matrices.
+    std::vector<double> delta_values(dropped_rows.restriction_values);
+    for (unsigned int i = 0; i < delta_values.size(); ++i)
+      delta_values[i] -= dropped_rows.eigenvector_values[i];
+    set_rows(*delta_eigenvector_matrix, delta_values);
+  }
 }
+
 } // namespace mfmg
 
 #endif
@@ -72,8 +72,13 @@ AnasaziSolver<OperatorType, VectorType>::solve(
   auto solver = Anasazi::Factory::create("LOBPCG", Teuchos::rcpFromRef(problem),
                                          solverParams);
 
+  // When partial convergence is allowed, the eigenpairs that have converged
+  // within the iteration budget are returned. There may be fewer than the
+  // requested number.
   Anasazi::ReturnType rr = solver->solve();
-  ASSERT(rr == Anasazi::Converged, "Anasazi could not solve the problem");
+  ASSERT(rr == Anasazi::Converged ||
+             params.get("allow_partial_convergence", false),
+         "Anasazi could not solve the problem");
 
   // Extract solution
   Anasazi::Eigensolution<double, MultiVectorType> solution =
@@ -94,7 +99,7 @@ AnasaziSolver<OperatorType, VectorType>::solve(
   std::vector<double> evals(num_converged);
   std::vector<VectorType> evecs(num_converged);
 
-  for (size_t i = 0; i < a_eigenvalues.size(); i++)
+  for (size_t i = 0; i < num_converged; i++)
   {
     ASSERT(a_index[i] == 0, "Encountered complex eigenvalue");
     evals[i] = a_eigenvalues[i].realpart;
@@ -0,0 +1,135 @@
+/**************************************************************************
+ * Copyright (c) 2017-2019 by the mfmg authors                            *
+ * All rights reserved.                                                   *
+ *                                                                        *
+ * This file is part of the mfmg library. mfmg is distributed under a BSD *
+ * 3-clause license. For the licensing terms see the LICENSE file in the  *
+ * top-level directory                                                    *
+ *                                                                        *
+ * SPDX-License-Identifier: BSD-3-Clause                                  *
+ *************************************************************************/
+
+#ifndef MFMG_DEALII_CELL_SCHWARZ_PRECONDITIONER_HPP
+#define MFMG_DEALII_CELL_SCHWARZ_PRECONDITIONER_HPP
+
+#include <deal.II/base/aligned_vector.h>
+#include <deal.II/base/vectorization.h>
+#include <deal.II/dofs/dof_handler.h>
+#include <deal.II/lac/affine_constraints.h>
+#include <deal.II/lac/full_matrix.h>
+
+#include <array>
+#include <vector>
+
+namespace mfmg
+{
+/**
+ * Overlapping additive Schwarz preconditioner whose subdomains are the cells
+ * of the mesh. The local problems are solved with the fast diagonalization
+ * method: on a box cell, the operator with a constant coefficient c is
+ *   c sum_d M_1 x ... x K_d x ... x M_dim
+ * where K_d and M_d are the one-dimensional stiffness and mass matrices. The
+ * inverse is applied with the eigenvectors of the one-dimensional generalized
+ * eigenproblem, i.e., with two small matrix products per direction, without
+ * assembling any matrix. The cells are processed in batches of the SIMD
+ * width: the lanes of a dealii::VectorizedArray hold the cells of a batch and
+ * the one-dimensional products are applied to the whole batch at once.
+ *
+ * The cell problems have natural boundary conditions so the constant mode is
+ * regularized with the smallest non-zero eigenvalue of the cell. The
+ * contributions of the cells are weighted by the square root of the inverse
+ * of the multiplicity of each dof so that the preconditioner is symmetric.
+ * The coefficient of each cell is estimated from the diagonal of the
+ * operator, and the length of the cell in each direction is the length of
+ * the corresponding edge, so that cells that are not axis-parallel boxes are
+ * approximated. Constrained dofs are left unchanged.
+ *
+ * Only scalar FE_Q elements are supported.
+ */
+template <int dim, typename VectorType>
+class CellSchwarzPreconditioner
+{
+public:
+  using vector_type = VectorType;
+
+  /**
+   * Constructor. @p diagonal_inverse is the inverse of the diagonal of the
+   * operator. It is used to estimate the coefficient on each cell.
+   */
+  CellSchwarzPreconditioner(
+      dealii::DoFHandler<dim> const &dof_handler,
+      dealii::AffineConstraints<double> const &constraints,
+      vector_type const &diagonal_inverse);
+
+  /**
+   * Apply the preconditioner.
+   */
+  void vmult(vector_type &dst, vector_type const &src) const;
+
+private:
+  using VectorizedArray = dealii::VectorizedArray<double>;
+
+  /**
+   * Apply the one-dimensional matrix @p matrix, or its transpose, in the
+   * direction @p direction to the tensor-product vectors of a cell batch
+   * @p src.
+   */
+  void apply_1d(dealii::FullMatrix<double> const &matrix,
+                bool const transpose, unsigned int const direction,
+                dealii::AlignedVector<VectorizedArray> const &src,
+                dealii::AlignedVector<VectorizedArray> &dst) const;
+
+  /**
+   * Number of dofs per direction in a cell.
+   */
+  unsigned int _n_1d;
+
+  /**
+   * Eigenvectors of the one-dimensional generalized eigenproblem on the unit
+   * interval, normalized for the mass matrix, stored by columns.
+   */
+  dealii::FullMatrix<double> _eigenvectors;
+
+  /**
+   * Eigenvalues of the one-dimensional generalized eigenproblem on the unit
+   * interval, in ascending order.
+   */
+  std::vector<double> _eigenvalues;
+
+  /**
+   * Global dof indices of the locally owned cells in lexicographic order.
+   * Constrained dofs are marked with dealii::numbers::invalid_dof_index.
+   */
+  std::vector<dealii::types::global_dof_index> _cell_dof_indices;
+
+  /**
+   * Number of locally owned cells.
+   */
+  unsigned int _n_cells;
+
+  /**
+   * Inverse of the square of the length of the cells of each batch in each
+   * direction. The lanes past the last cell are set to one.
+   */
+  dealii::AlignedVector<std::array<VectorizedArray, dim>> _inverse_h2;
+
+  /**
+   * Scaling of the local inverse of the cells of each batch, i.e., the
+   * inverse of the coefficient times the volume of the cell. The lanes past
+   * the last cell are set to zero.
+   */
+  dealii::AlignedVector<VectorizedArray> _scaling;
+
+  /**
+   * Square root of the inverse of the multiplicity of the dofs.
+   */
+  vector_type _weights;
+
+  std::vector<dealii::types::global_dof_index> _constrained_dofs;
+
+  mutable vector_type _ghosted_src;
+  mutable vector_type _ghosted_dst;
+};
+} // namespace mfmg
+
+#endif
@@ -0,0 +1,303 @@
+/**************************************************************************
+ * Copyright (c) 2017-2019 by the mfmg authors                            *
+ * All rights reserved.                                                   *
+ *                                                                        *
+ * This file is part of the mfmg library. mfmg is distributed under a BSD *
+ * 3-clause license. For the licensing terms see the LICENSE file in the  *
+ * top-level directory                                                    *
+ *                                                                        *
+ * SPDX-License-Identifier: BSD-3-Clause                                  *
+ *************************************************************************/
+
+#ifndef MFMG_DEALII_MATRIX_FREE_AGGLOMERATE_VIEW_HPP
+#define MFMG_DEALII_MATRIX_FREE_AGGLOMERATE_VIEW_HPP
+
+#include <mfmg/common/exceptions.hpp>
+
+#include <deal.II/dofs/dof_accessor.h>
+#include <deal.II/dofs/dof_handler.h>
+#include <deal.II/lac/affine_constraints.h>
+#include <deal.II/lac/la_parallel_vector.h>
+#include <deal.II/matrix_free/fe_evaluation.h>
+#include <deal.II/matrix_free/matrix_free.h>
+
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace mfmg
+{
+/**
+ * Map the active cells, identified by their level and their index, of a
+ * MatrixFree object to the cell batch and to the lane in the cell batch they
+ * are stored in.
+ */
+using CellBatchMap =
+    std::map<std::pair<int, int>, std::pair<unsigned int, unsigned int>>;
+
+template <int dim, typename ScalarType>
+CellBatchMap
+build_cell_batch_map(dealii::MatrixFree<dim, ScalarType> const &matrix_free,
+                     unsigned int const dof_handler_index = 0)
+{
+  CellBatchMap cell_batch_map;
+  unsigned int const n_cell_batches = matrix_free.n_macro_cells();
+  for (unsigned int batch = 0; batch < n_cell_batches; ++batch)
+    for (unsigned int lane = 0; lane < matrix_free.n_components_filled(batch);
+         ++lane)
+    {
+      auto const cell =
+          matrix_free.get_cell_iterator(batch, lane, dof_handler_index);
+      cell_batch_map[std::make_pair(cell->level(), cell->index())] =
+          std::make_pair(batch, lane);
+    }
+
+  return cell_batch_map;
+}
+
+/**
+ * Return true if all the global cells of an agglomerate are stored in the
+ * MatrixFree object described by @p cell_batch_map. This is not the case for
+ * agglomerates that contain ghost cells.
+ */
+template <int dim>
+bool is_in_cell_batch_map(
+    CellBatchMap const &cell_batch_map,
+    std::map<typename dealii::Triangulation<dim>::active_cell_iterator,
+             typename dealii::DoFHandler<dim>::active_cell_iterator> const
+        &patch_to_global_map)
+{
+  for (auto const &cells : patch_to_global_map)
+    if (cell_batch_map.count(std::make_pair(cells.second->level(),
+                                            cells.second->index())) == 0)
+      return false;
+
+  return true;
+}
+
+/**
+ * Operator on an agglomerate evaluated on the cells of the global MatrixFree
+ * object instead of on a MatrixFree object built for the agglomerate. The
+ * mapping data, the shape functions and any cell-wise data of the global
+ * operator are reused as is: the dofs of the agglomerate are gathered into the
+ * lanes of the cell batches that contain the agglomerate, the cell kernel is
+ * applied to the whole batch, and the lanes that belong to the agglomerate are
+ * scattered back. Only the cells of the agglomerate contribute, i.e., the
+ * operator has natural (Neumann) boundary conditions on the boundary of the
+ * agglomerate. Dofs constrained by @p agglomerate_constraints are treated as
+ * deal.II's MatrixFreeOperators::Base does.
+ *
+ * The cell kernel is called as `cell_kernel(fe_eval, cell_batch)` with the
+ * dof values of @p fe_eval set. It must evaluate, apply the operator at the
+ * quadrature points, and integrate.
+ *
+ * Vector-valued finite elements, e.g., an FESystem for elasticity, are
+ * supported through @p n_components. The dof values of the components are
+ * stored one after the other as in FEEvaluation.
+ */
+template <int dim, int fe_degree, int n_q_points_1d, typename ScalarType,
+          int n_components = 1>
+class MatrixFreeAgglomerateView
+{
+public:
+  using VectorType = dealii::LinearAlgebra::distributed::Vector<ScalarType>;
+  using FEEvaluation =
+      dealii::FEEvaluation<dim, fe_degree, n_q_points_1d, n_components,
+                           ScalarType>;
+
+  /**
+   * Constructor. @p cell_batch_map is the output of build_cell_batch_map() for
+   * @p matrix_free and @p patch_to_global_map associates the cells of the
+   * agglomerate to the cells of the global mesh.
+   */
+  MatrixFreeAgglomerateView(
+      dealii::MatrixFree<dim, ScalarType> const &matrix_free,
+      CellBatchMap const &cell_batch_map,
+      dealii::DoFHandler<dim> const &agglomerate_dof_handler,
+      std::map<typename dealii::Triangulation<dim>::active_cell_iterator,
+               typename dealii::DoFHandler<dim>::active_cell_iterator> const
+          &patch_to_global_map,
+      dealii::AffineConstraints<double> const &agglomerate_constraints);
+
+  /**
+   * Return the number of dofs of the agglomerate.
+   */
+  unsigned int n_dofs() const { return _n_dofs; }
+
+  /**
+   * Apply the operator on the agglomerate.
+   */
+  template <typename CellKernel>
+  void vmult(VectorType &dst, VectorType const &src,
+             CellKernel const &cell_kernel) const;
+
+  /**
+   * Compute the diagonal of the operator on the agglomerate, see
+   * compute_matrix_free_diagonal(). The entries associated with constrained
+   * dofs are set to one.
+   */
+  template <typename CellKernel>
+  void compute_diagonal(VectorType &diagonal,
+                        CellKernel const &cell_kernel) const;
+
+private:
+  /**
+   * Cell batch of the global MatrixFree object that contains cells of the
+   * agglomerate. For each lane used by the agglomerate, we store the dof
+   * indices of the agglomerate in the order of the FEEvaluation dof values.
+   */
+  struct CellBatch
+  {
+    unsigned int batch;
+    std::vector<unsigned int> lanes;
+    std::vector<std::vector<dealii::types::global_dof_index>> dof_indices;
+  };
+
+  dealii::MatrixFree<dim, ScalarType> const &_matrix_free;
+  dealii::AffineConstraints<double> const &_constraints;
+  unsigned int _n_dofs;
+  std::vector<CellBatch> _cell_batches;
+  mutable VectorType _constrained_src;
+};
+
+template <int dim, int fe_degree, int n_q_points_1d, typename ScalarType,
+          int n_components>
+MatrixFreeAgglomerateView<dim, fe_degree, n_q_points_1d, ScalarType,
+                          n_components>::
+    MatrixFreeAgglomerateView(
+        dealii::MatrixFree<dim, ScalarType> const &matrix_free,
+        CellBatchMap const &cell_batch_map,
+        dealii::DoFHandler<dim> const &agglomerate_dof_handler,
+        std::map<typename dealii::Triangulation<dim>::active_cell_iterator,
+                 typename dealii::DoFHandler<dim>::active_cell_iterator> const
+            &patch_to_global_map,
+        dealii::AffineConstraints<double> const &agglomerate_constraints)
+    : _matrix_free(matrix_free), _constraints(agglomerate_constraints),
+      _n_dofs(agglomerate_dof_handler.n_dofs()), _constrained_src(_n_dofs)
+{
+  ASSERT(agglomerate_dof_handler.get_fe().n_components() == n_components,
+         "The number of components of the finite element does not match");
+
+  std::vector<unsigned int> const &lexicographic_numbering =
+      matrix_free.get_shape_info().lexicographic_numbering;
+  unsigned int const dofs_per_cell =
+      agglomerate_dof_handler.get_fe().dofs_per_cell;
+  ASSERT(lexicographic_numbering.size() == dofs_per_cell,
+         "The agglomerate and the global finite elements do not match");
+
+  std::map<unsigned int, CellBatch> cell_batches;
+  std::vector<dealii::types::global_dof_index> agg_dof_indices(dofs_per_cell);
+  for (auto agg_cell : agglomerate_dof_handler.active_cell_iterators())
+  {
+    auto const global_cell = patch_to_global_map.at(agg_cell);
+    auto const batch_and_lane = cell_batch_map.at(
+        std::make_pair(global_cell->level(), global_cell->index()));
+
+    agg_cell->get_dof_indices(agg_dof_indices);
+    std::vector<dealii::types::global_dof_index> dof_indices(dofs_per_cell);
+    for (unsigned int i = 0; i < dofs_per_cell; ++i)
+      dof_indices[i] = agg_dof_indices[lexicographic_numbering[i]];
+
+    CellBatch &cell_batch = cell_batches[batch_and_lane.first];
+    cell_batch.batch = batch_and_lane.first;
+    cell_batch.lanes.push_back(batch_and_lane.second);
+    cell_batch.dof_indices.push_back(dof_indices);
+  }
+
+  _cell_batches.reserve(cell_batches.size());
+  for (auto &cell_batch : cell_batches)
+    _cell_batches.push_back(std::move(cell_batch.second));
+}
+
+template <int dim, int fe_degree, int n_q_points_1d, typename ScalarType,
+          int n_components>
+template <typename CellKernel>
+void MatrixFreeAgglomerateView<dim, fe_degree, n_q_points_1d, ScalarType,
+                               n_components>::vmult(VectorType &dst,
+                                                    VectorType const &src,
+                                                    CellKernel const
+                                                        &cell_kernel) const
+{
+  // Resolve the constraints on the source vector. The constraints have been
+  // closed so that they are not chained.
+  _constrained_src = src;
+  for (auto const &line : _constraints.get_lines())
+  {
+    ScalarType value = line.inhomogeneity;
+    for (auto const &entry : line.entries)
+      value += entry.second * src[entry.first];
+    _constrained_src[line.index] = value;
+  }
+
+  dst = 0.;
+  FEEvaluation fe_eval(_matrix_free);
+  unsigned int const dofs_per_cell = fe_eval.dofs_per_cell;
+  for (auto const &cell_batch : _cell_batches)
+  {
+    fe_eval.reinit(cell_batch.batch);
+    dealii::VectorizedArray<ScalarType> *dof_values =
+        fe_eval.begin_dof_values();
+    for (unsigned int i = 0; i < dofs_per_cell; ++i)
+      dof_values[i] = 0.;
+    for (unsigned int l = 0; l < cell_batch.lanes.size(); ++l)
+    {
+      auto const &dof_indices = cell_batch.dof_indices[l];
+      for (unsigned int i = 0; i < dofs_per_cell; ++i)
+        dof_values[i][cell_batch.lanes[l]] = _constrained_src[dof_indices[i]];
+    }
+
+    cell_kernel(fe_eval, cell_batch.batch);
+
+    for (unsigned int l = 0; l < cell_batch.lanes.size(); ++l)
+    {
+      auto const &dof_indices = cell_batch.dof_indices[l];
+      for (unsigned int i = 0; i < dofs_per_cell; ++i)
+        dst[dof_indices[i]] += dof_values[i][cell_batch.lanes[l]];
+    }
+  }
+
+  // Condense the result and keep the constrained values of the source.
+  for (auto const &line : _constraints.get_lines())
+  {
+    for (auto const &entry : line.entries)
+      dst[entry.first] += entry.second * dst[line.index];
+    dst[line.index] = src[line.index];
+  }
+}
+
+template <int dim, int fe_degree, int n_q_points_1d, typename ScalarType,
+          int n_components>
+template <typename CellKernel>
+void MatrixFreeAgglomerateView<dim, fe_degree, n_q_points_1d, ScalarType,
+                               n_components>::
+    compute_diagonal(VectorType &diagonal, CellKernel const &cell_kernel) const
+{
+  diagonal.reinit(_n_dofs);
+
+  FEEvaluation fe_eval(_matrix_free);
+  unsigned int const dofs_per_cell = fe_eval.dofs_per_cell;
+  for (auto const &cell_batch : _cell_batches)
+  {
+    fe_eval.reinit(cell_batch.batch);
+    dealii::VectorizedArray<ScalarType> *dof_values =
+        fe_eval.begin_dof_values();
+    for (unsigned int i = 0; i < dofs_per_cell; ++i)
+    {
+      for (unsigned int j = 0; j < dofs_per_cell; ++j)
+        dof_values[j] = 0.;
+      dof_values[i] = 1.;
+
+      cell_kernel(fe_eval, cell_batch.batch);
+
+      for (unsigned int l = 0; l < cell_batch.lanes.size(); ++l)
+        diagonal[cell_batch.dof_indices[l][i]] +=
+            dof_values[i][cell_batch.lanes[l]];
+    }
+  }
+
+  for (auto const &line : _constraints.get_lines())
+    diagonal[line.index] = 1.;
+}
+} // namespace mfmg
+
+#endif
@@ -0,0 +1,192 @@
+/**************************************************************************
+ * Copyright (c) 2017-2019 by the mfmg authors                            *
+ * All rights reserved.                                                   *
+ *                                                                        *
+ * This file is part of the mfmg library. mfmg is distributed under a BSD *
+ * 3-clause license. For the licensing terms see the LICENSE file in the  *
+ * top-level directory                                                    *
+ *                                                                        *
+ * SPDX-License-Identifier: BSD-3-Clause                                  *
+ *************************************************************************/
+
+#ifndef MFMG_DEALII_MATRIX_FREE_CELL_KERNEL_EVALUATOR_HPP
+#define MFMG_DEALII_MATRIX_FREE_CELL_KERNEL_EVALUATOR_HPP
+
+#include <mfmg/common/exceptions.hpp>
+#include <mfmg/dealii/dealii_matrix_free_agglomerate_view.hpp>
+#include <mfmg/dealii/dealii_matrix_free_diagonal.hpp>
+#include <mfmg/dealii/dealii_matrix_free_mesh_evaluator.hpp>
+
+#include <deal.II/lac/affine_constraints.h>
+#include <deal.II/lac/diagonal_matrix.h>
+#include <deal.II/lac/la_parallel_vector.h>
+#include <deal.II/matrix_free/fe_evaluation.h>
+#include <deal.II/matrix_free/matrix_free.h>
+
+#include <memory>
+#include <vector>
+
+namespace mfmg
+{
+/**
+ * A DealIIMatrixFreeMeshEvaluator for operators whose action on a cell batch
+ * is given by a cell kernel. Deriving from this class instead of directly from
+ * DealIIMatrixFreeMeshEvaluator provides the diagonals of the global operator
+ * and of the agglomerate operators. They are computed from the cell kernel
+ * with compute_matrix_free_diagonal() or
+ * MatrixFreeAgglomerateView::compute_diagonal(), so that nothing is ever
+ * assembled.
+ *
+ * The user must provide the global MatrixFree object, the cell kernel, and
+ * the constraints of the agglomerate. The agglomerate operator is either
+ * evaluated through a MatrixFreeAgglomerateView, see get_agglomerate_view(),
+ * or on a MatrixFree object built for the agglomerate, see
+ * get_agglomerate_matrix_free().
+ */
+template <int dim, int fe_degree, int n_q_points_1d = fe_degree + 1,
+          int n_components = 1>
+class DealIIMatrixFreeCellKernelEvaluator
+    : public DealIIMatrixFreeMeshEvaluator<dim>
+{
+public:
+  using VectorType = dealii::LinearAlgebra::distributed::Vector<double>;
+  using FEEvaluation = dealii::FEEvaluation<dim, fe_degree, n_q_points_1d,
+                                            n_components, double>;
+  using AgglomerateView =
+      MatrixFreeAgglomerateView<dim, fe_degree, n_q_points_1d, double,
+                                n_components>;
+
+  DealIIMatrixFreeCellKernelEvaluator(
+      dealii::DoFHandler<dim> &dof_handler,
+      dealii::AffineConstraints<double> &constraints)
+      : DealIIMatrixFreeMeshEvaluator<dim>(dof_handler, constraints)
+  {
+  }
+
+  virtual ~DealIIMatrixFreeCellKernelEvaluator() override = default;
+
+  /**
+   * Return the MatrixFree object of the global operator.
+   */
+  virtual dealii::MatrixFree<dim, double> const &get_matrix_free() const = 0;
+
+  /**
+   * Apply the operator on the cell batch @p cell of the global MatrixFree
+   * object. The dof values of @p fe_eval are set. The kernel must evaluate,
+   * apply the operator at the quadrature points, and integrate.
+   */
+  virtual void apply_cell(FEEvaluation &fe_eval,
+                          unsigned int const cell) const = 0;
+
+  /**
+   * Return the constraints of the agglomerate the evaluator was initialized
+   * on in matrix_free_initialize_agglomerate().
+   */
+  virtual dealii::AffineConstraints<double> const &
+  get_agglomerate_constraints() const = 0;
+
+  /**
+   * Return the view of the global MatrixFree object on the current
+   * agglomerate or nullptr if the agglomerate operator is evaluated on its own
+   * MatrixFree object.
+   */
+  virtual AgglomerateView const *get_agglomerate_view() const
+  {
+    return nullptr;
+  }
+
+  /**
+   * Return the MatrixFree object built for the current agglomerate. It is
+   * only used when get_agglomerate_view() returns nullptr.
+   */
+  virtual dealii::MatrixFree<dim, double> const *
+  get_agglomerate_matrix_free() const
+  {
+    return nullptr;
+  }
+
+  /**
+   * Apply the operator on the cell batch @p cell of the MatrixFree object
+   * returned by get_agglomerate_matrix_free(). By default, the kernel of the
+   * global operator is used, which is only correct if the kernel does not
+   * depend on cell data indexed by @p cell.
+   */
+  virtual void apply_agglomerate_cell(FEEvaluation &fe_eval,
+                                      unsigned int const cell) const
+  {
+    apply_cell(fe_eval, cell);
+  }
+
+  virtual std::vector<double> matrix_free_get_agglomerate_diagonal(
+      dealii::AffineConstraints<double> &constraints) const override
+  {
+    constraints.copy_from(get_agglomerate_constraints());
+
+    VectorType diagonal;
+    auto const agglomerate_view = get_agglomerate_view();
+    if (agglomerate_view != nullptr)
+    {
+      agglomerate_view->compute_diagonal(
+          diagonal, [&](FEEvaluation &fe_eval, unsigned int const cell) {
+            apply_cell(fe_eval, cell);
+          });
+    }
+    else
+    {
+      auto const agglomerate_matrix_free = get_agglomerate_matrix_free();
+      ASSERT(agglomerate_matrix_free != nullptr,
+             "The agglomerate has not been initialized");
+      compute_matrix_free_diagonal<dim, fe_degree, n_q_points_1d,
+                                   n_components>(
+          *agglomerate_matrix_free, diagonal,
+          [&](FEEvaluation &fe_eval, unsigned int const cell) {
+            apply_agglomerate_cell(fe_eval, cell);
+          });
+    }
+
+    return std::vector<double>(diagonal.begin(), diagonal.end());
+  }
+
+  virtual std::shared_ptr<dealii::DiagonalMatrix<VectorType>>
+  matrix_free_get_diagonal_inverse() const override
+  {
+    VectorType inverse_diagonal = compute_diagonal();
+    for (unsigned int i = 0; i < inverse_diagonal.local_size(); ++i)
+      inverse_diagonal.local_element(i) =
+          1. / inverse_diagonal.local_element(i);
+
+    auto diagonal_matrix =
+        std::make_shared<dealii::DiagonalMatrix<VectorType>>();
+    diagonal_matrix->reinit(inverse_diagonal);
+
+    return diagonal_matrix;
+  }
+
+  virtual VectorType get_diagonal() override
+  {
+    VectorType diagonal = compute_diagonal();
+    diagonal.update_ghost_values();
+
+    return diagonal;
+  }
+
+private:
+  /**
+   * Compute the diagonal of the global operator. The entries associated with
+   * constrained dofs are set to one.
+   */
+  VectorType compute_diagonal() const
+  {
+    VectorType diagonal;
+    compute_matrix_free_diagonal<dim, fe_degree, n_q_points_1d, n_components>(
+        get_matrix_free(), diagonal,
+        [&](FEEvaluation &fe_eval, unsigned int const cell) {
+          apply_cell(fe_eval, cell);
+        });
+
+    return diagonal;
+  }
+};
+} // namespace mfmg
+
+#endif
@@ -0,0 +1,97 @@
+/**************************************************************************
+ * Copyright (c) 2017-2019 by the mfmg authors                            *
+ * All rights reserved.                                                   *
+ *                                                                        *
+ * This file is part of the mfmg library. mfmg is distributed under a BSD *
+ * 3-clause license. For the licensing terms see the LICENSE file in the  *
+ * top-level directory                                                    *
+ *                                                                        *
+ * SPDX-License-Identifier: BSD-3-Clause                                  *
+ *************************************************************************/
+
+#ifndef MFMG_DEALII_MATRIX_FREE_DIAGONAL_HPP
+#define MFMG_DEALII_MATRIX_FREE_DIAGONAL_HPP
+
+#include <deal.II/base/aligned_vector.h>
+#include <deal.II/base/vectorization.h>
+#include <deal.II/lac/la_parallel_vector.h>
+#include <deal.II/matrix_free/fe_evaluation.h>
+#include <deal.II/matrix_free/matrix_free.h>
+
+#include <functional>
+#include <utility>
+
+namespace mfmg
+{
+/**
+ * Compute the diagonal of a matrix-free operator without assembling it. The
+ * cell operator is applied to each local unit vector and only the diagonal
+ * entry of the result is kept before being summed into the global vector, so
+ * the cost is proportional to the number of cells times the number of dofs
+ * per cell squared.
+ *
+ * @p cell_kernel is called as `cell_kernel(fe_eval, cell)` after the dof
+ * values of @p fe_eval have been set to a unit vector. It must evaluate,
+ * apply the operator at the quadrature points, and integrate, i.e., do
+ * everything the operator does on a cell except reading from and writing to
+ * global vectors. Since only the matrix-free data is used, the same function
+ * works for the global operator and for the operator on an agglomerate.
+ *
+ * The entries of @p diagonal associated with constrained dofs are set to one.
+ */
+template <int dim, int fe_degree, int n_q_points_1d, int n_components,
+          typename ScalarType, typename CellKernel>
+void compute_matrix_free_diagonal(
+    dealii::MatrixFree<dim, ScalarType> const &matrix_free,
+    dealii::LinearAlgebra::distributed::Vector<ScalarType> &diagonal,
+    CellKernel const &cell_kernel, unsigned int const dof_handler_index = 0,
+    unsigned int const quad_index = 0)
+{
+  using VectorType = dealii::LinearAlgebra::distributed::Vector<ScalarType>;
+  using FEEvaluation = dealii::FEEvaluation<dim, fe_degree, n_q_points_1d,
+                                            n_components, ScalarType>;
+
+  matrix_free.initialize_dof_vector(diagonal, dof_handler_index);
+
+  std::function<void(dealii::MatrixFree<dim, ScalarType> const &,
+                     VectorType &, unsigned int const &,
+                     std::pair<unsigned int, unsigned int> const &)>
+      local_compute_diagonal =
+          [&](dealii::MatrixFree<dim, ScalarType> const &data, VectorType &dst,
+              unsigned int const &,
+              std::pair<unsigned int, unsigned int> const &cell_range) {
+        FEEvaluation fe_eval(data, dof_handler_index, quad_index);
+        dealii::AlignedVector<dealii::VectorizedArray<ScalarType>>
+            local_diagonal(fe_eval.dofs_per_cell);
+
+        for (unsigned int cell = cell_range.first; cell < cell_range.second;
+             ++cell)
+        {
+          fe_eval.reinit(cell);
+          for (unsigned int i = 0; i < fe_eval.dofs_per_cell; ++i)
+          {
+            for (unsigned int j = 0; j < fe_eval.dofs_per_cell; ++j)
+              fe_eval.submit_dof_value(
+                  dealii::make_vectorized_array<ScalarType>(0.), j);
+            fe_eval.submit_dof_value(
+                dealii::make_vectorized_array<ScalarType>(1.), i);
+
+            cell_kernel(fe_eval, cell);
+
+            local_diagonal[i] = fe_eval.get_dof_value(i);
+          }
+          for (unsigned int i = 0; i < fe_eval.dofs_per_cell; ++i)
+            fe_eval.submit_dof_value(local_diagonal[i], i);
+          fe_eval.distribute_local_to_global(dst);
+        }
+      };
+
+  unsigned int const dummy = 0;
+  matrix_free.cell_loop(local_compute_diagonal, diagonal, dummy);
+
+  for (auto const dof : matrix_free.get_constrained_dofs(dof_handler_index))
+    diagonal.local_element(dof) = 1.;
+}
+} // namespace mfmg
+
+#endif
@@ -43,6 +43,20 @@ public:
   std::shared_ptr<Operator<vector_type>>
   fast_multiply_transpose() override final;
 
+  std::shared_ptr<MeshEvaluator> build_coarser_degree_evaluator(
+      std::shared_ptr<MeshEvaluator> mesh_evaluator) override final;
+
+  std::shared_ptr<Operator<vector_type>> build_degree_restrictor(
+      MPI_Comm comm, std::shared_ptr<MeshEvaluator> fine_evaluator,
+      std::shared_ptr<MeshEvaluator> coarse_evaluator) override final;
+
+  std::shared_ptr<MeshEvaluator> build_coarser_mesh_evaluator(
+      std::shared_ptr<MeshEvaluator> mesh_evaluator) override final;
+
+  std::shared_ptr<Operator<vector_type>> build_mesh_restrictor(
+      MPI_Comm comm, std::shared_ptr<MeshEvaluator> fine_evaluator,
+      std::shared_ptr<MeshEvaluator> coarse_evaluator) override final;
+
 private:
   std::shared_ptr<Operator<vector_type>> _ap_operator;
 };
@@ -23,6 +23,7 @@
 #include <deal.II/lac/trilinos_sparse_matrix.h>
 #include <deal.II/lac/vector.h>
 
+#include <map>
 #include <type_traits>
 
 namespace mfmg
@@ -70,6 +71,37 @@ public:
     return std::make_unique<DealIIMatrixFreeMeshEvaluator>(*this);
   }
 
+  /**
+   * Return an evaluator for the same operator discretized on the same
+   * triangulation with finite elements of lower polynomial degree, typically
+   * half the current degree. This is used to build the polynomial coarsening
+   * levels of the Hierarchy when "p-multigrid" is enabled. The returned
+   * evaluator must own the DoFHandler and the constraints it references.
+   */
+  virtual std::shared_ptr<DealIIMatrixFreeMeshEvaluator>
+  build_coarser_degree_evaluator() const
+  {
+    ASSERT_THROW_NOT_IMPLEMENTED();
+
+    return nullptr;
+  }
+
+  /**
+   * Return an evaluator for the same operator discretized with the same finite
+   * element on the triangulation coarsened once, i.e., on a triangulation built
+   * from the same coarse mesh with one less global refinement. This is used to
+   * build the geometric levels of the Hierarchy when "geometric levels" is
+   * positive. The returned evaluator must own the triangulation, the
+   * DoFHandler, and the constraints it references.
+   */
+  virtual std::shared_ptr<DealIIMatrixFreeMeshEvaluator>
+  build_coarser_mesh_evaluator() const
+  {
+    ASSERT_THROW_NOT_IMPLEMENTED();
+
+    return nullptr;
+  }
+
   /**
    * Return the class name as std::string.
    */
@@ -95,19 +127,40 @@ public:
     ASSERT_THROW_NOT_IMPLEMENTED();
   }
 
+  /**
+   * Same as above but @p patch_to_global_map, which associates the cells of
+   * the agglomerate to the cells of the global mesh, is also provided. This
+   * allows to evaluate the operator on the agglomerate using the cells of the
+   * global matrix-free data (see MatrixFreeAgglomerateView) instead of
+   * setting up new matrix-free data for every agglomerate. By default, the map
+   * is ignored.
+   */
+  virtual void matrix_free_initialize_agglomerate(
+      dealii::DoFHandler<dim> &dof_handler,
+      std::map<typename dealii::Triangulation<dim>::active_cell_iterator,
+               typename dealii::DoFHandler<dim>::active_cell_iterator> const
+          & /*patch_to_global_map*/) const
+  {
+    matrix_free_initialize_agglomerate(dof_handler);
+  }
+
   /**
    * Evaluate the operator on the agglomerate this object was initialized on in
-   * matrix_free_initialize_agglomerate().
+   * matrix_free_initialize_agglomerate(). The vectors are serial
+   * dealii::LinearAlgebra::distributed::Vector so that they can be passed
+   * directly to the deal.II matrix-free operators without any copy.
    */
-  virtual void
-  matrix_free_evaluate_agglomerate(dealii::Vector<double> const & /*src*/,
-                                   dealii::Vector<double> & /*dst*/) const
+  virtual void matrix_free_evaluate_agglomerate(
+      dealii::LinearAlgebra::distributed::Vector<double> const & /*src*/,
+      dealii::LinearAlgebra::distributed::Vector<double> & /*dst*/) const
   {
     ASSERT_THROW_NOT_IMPLEMENTED();
   }
 
   /**
    * Return the diagonal of the matrix the agglomerate operator conrresponds to.
+   * DealIIMatrixFreeCellKernelEvaluator computes it from the cell kernel of the
+   * operator.
    */
   virtual std::vector<double> matrix_free_get_agglomerate_diagonal(
       dealii::AffineConstraints<double> & /*constraints*/) const
@@ -129,7 +182,7 @@ public:
 
   /**
    * Return the inverse of the diagonal of the matrix the global operator
-   * corresponds to. Constrained degrees of freedom are set to zero.
+   * corresponds to. Constrained degrees of freedom are set to one.
    */
   virtual std::shared_ptr<dealii::DiagonalMatrix<
       dealii::LinearAlgebra::distributed::Vector<double>>>
@@ -142,7 +195,8 @@ public:
 
   /**
    * Return the diagonal of the matrix the global operator corresponds to.
-   * Constrained degrees of freedom are set to zero.
+   * Constrained degrees of freedom are set to one. As for the agglomerate
+   * diagonal, DealIIMatrixFreeCellKernelEvaluator avoids any assembly.
    */
   virtual dealii::LinearAlgebra::distributed::Vector<double>
   get_diagonal() override
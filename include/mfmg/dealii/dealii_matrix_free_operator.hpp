@@ -68,6 +68,12 @@ public:
   std::shared_ptr<dealii::DiagonalMatrix<vector_type>>
   get_diagonal_inverse() const;
 
+  /**
+   * Return the MeshEvaluator that evaluates the operator.
+   */
+  std::shared_ptr<DealIIMatrixFreeMeshEvaluator<dim>>
+  get_mesh_evaluator() const;
+
 private:
   std::shared_ptr<DealIIMatrixFreeMeshEvaluator<dim>> _mesh_evaluator;
 };
@@ -13,6 +13,7 @@
 #define MFMG_DEALII_MATRIX_FREE_SMOOTHER_HPP
 
 #include <mfmg/common/smoother.hpp>
+#include <mfmg/dealii/dealii_cell_schwarz_preconditioner.hpp>
 #include <mfmg/dealii/dealii_matrix_free_operator.hpp>
 
 #include <deal.II/lac/diagonal_matrix.h>
@@ -34,6 +35,11 @@ public:
   using chebyshev_preconditioner =
       dealii::PreconditionChebyshev<operator_type, vector_type,
                                     preconditioner_type>;
+  using schwarz_preconditioner_type =
+      CellSchwarzPreconditioner<dim, vector_type>;
+  using chebyshev_schwarz_preconditioner =
+      dealii::PreconditionChebyshev<operator_type, vector_type,
+                                    schwarz_preconditioner_type>;
 
   DealIIMatrixFreeSmoother(
       std::shared_ptr<Operator<vector_type> const> op,
@@ -43,8 +49,21 @@ public:
 
   void apply(vector_type const &b, vector_type &x) const override;
 
+  void apply_zero_initial_guess(vector_type const &b,
+                                vector_type &x) const override;
+
 private:
+  /**
+   * Chebyshev smoother preconditioned by the point diagonal, used when
+   * "smoother.preconditioner" is "diagonal".
+   */
   std::unique_ptr<chebyshev_preconditioner> _smoother;
+
+  /**
+   * Chebyshev smoother preconditioned by the cell-wise overlapping Schwarz
+   * method, used when "smoother.preconditioner" is "cell Schwarz".
+   */
+  std::unique_ptr<chebyshev_schwarz_preconditioner> _schwarz_smoother;
 };
 } // namespace mfmg
 
@@ -19,6 +19,9 @@
 #include <deal.II/lac/affine_constraints.h>
 #include <deal.II/lac/la_parallel_vector.h>
 #include <deal.II/lac/trilinos_sparse_matrix.h>
+#include <deal.II/lac/vector.h>
+
+#include <vector>
 
 namespace mfmg
 {
@@ -49,6 +52,30 @@ public:
 
   virtual dealii::LinearAlgebra::distributed::Vector<double> get_diagonal();
 
+  // Return the near-nullspace of the operator on an agglomerate, e.g., the
+  // rigid body modes for elasticity. @p dof_handler and @p constraints are
+  // the ones set up for the agglomerate. The vectors do not need to be
+  // orthonormal and their entries on the constrained dofs are ignored. AMGe
+  // puts them first in the coarse space of the agglomerate and fills the rest
+  // with the local eigenvectors orthogonalized against them. By default, the
+  // near-nullspace is empty and only the eigenvectors are used.
+  virtual std::vector<dealii::Vector<double>>
+  get_near_nullspace(dealii::DoFHandler<dim> const & /*dof_handler*/,
+                     dealii::AffineConstraints<double> const & /*constraints*/)
+      const
+  {
+    return std::vector<dealii::Vector<double>>();
+  }
+
+  // Return the rigid body modes of a finite element space with either one
+  // component, i.e., the constant, or dim components, i.e., the dim
+  // translations and the dim*(dim-1)/2 infinitesimal rotations. The finite
+  // element must have support points. The entries of the constrained dofs are
+  // set to zero. This can be used to implement get_near_nullspace().
+  static std::vector<dealii::Vector<double>> compute_rigid_body_modes(
+      dealii::DoFHandler<dim> const &dof_handler,
+      dealii::AffineConstraints<double> const &constraints);
+
   virtual void evaluate_agglomerate(dealii::DoFHandler<dim> &,
                                     dealii::AffineConstraints<double> &,
                                     dealii::SparsityPattern &,
@@ -68,6 +95,8 @@ public:
 
   dealii::AffineConstraints<double> &get_constraints();
 
+  dealii::AffineConstraints<double> const &get_constraints() const;
+
 protected:
   dealii::DoFHandler<dim> &_dof_handler;
   dealii::AffineConstraints<double> &_constraints;
@@ -36,6 +36,9 @@ public:
 
   void apply(vector_type const &b, vector_type &x) const override final;
 
+  void apply_zero_initial_guess(vector_type const &b,
+                                vector_type &x) const override final;
+
 private:
   std::unique_ptr<dealii::TrilinosWrappers::PreconditionBase> _smoother;
 };
@@ -13,9 +13,23 @@
 #define MFMG_DEALII_TRILINOS_MATRIX_OPERATOR_HPP
 
 #include <mfmg/common/operator.hpp>
+#ifdef MFMG_WITH_MPI_SHARED_MEMORY
+#include <mfmg/dealii/shared_memory_import.hpp>
+#endif
 
 #include <deal.II/lac/trilinos_sparse_matrix.h>
 
+#include <Epetra_Vector.h>
+
+#ifdef DEAL_II_WITH_THREADS
+#include <tbb/partitioner.h>
+#endif
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include <vector>
+
 namespace mfmg
 {
 template <typename VectorType>
@@ -27,11 +41,41 @@ public:
   DealIITrilinosMatrixOperator(
       std::shared_ptr<dealii::TrilinosWrappers::SparseMatrix> sparse_matrix);
 
-  virtual ~DealIITrilinosMatrixOperator() override = default;
+  virtual ~DealIITrilinosMatrixOperator() override;
 
   void apply(vector_type const &x, vector_type &y,
              OperatorMode mode = OperatorMode::NO_TRANS) const override;
 
+  /**
+   * Compute y = R (A x - b) with R the matrix of this operator. The product is
+   * computed by blocks of rows using the transpose of R so that each entry of
+   * the residual is scattered to the coarse vector as soon as it is computed.
+   * If \p a is also a DealIITrilinosMatrixOperator, the residual is never
+   * stored and \p residual is not used. Otherwise, A x is stored in \p
+   * residual. The blocks of rows are processed by different tasks and the
+   * rows that do not need ghost values are processed during the
+   * communication.
+   */
+  void restrict_residual(Operator<VectorType> const &a, vector_type const &x,
+                         vector_type const &b, vector_type &y,
+                         vector_type &residual) const override;
+
+  /**
+   * Compute y += alpha * op(x) in a single pass over the rows of y. When \p
+   * mode is TRANS, the cached transpose of the matrix is used so that no
+   * temporary vector of the size of \p y is needed.
+   */
+  void apply_add(vector_type const &x, vector_type &y, double const alpha,
+                 OperatorMode mode = OperatorMode::NO_TRANS) const override;
+
+  /**
+   * Build the row partition used with \p mode and, if \p mode is TRANS, the
+   * transpose of the matrix and the buffers of restrict_residual(). With
+   * MFMG_WITH_MPI_SHARED_MEMORY, this also creates the shared memory window
+   * used to import the ghost values.
+   */
+  void setup_transfer(OperatorMode const mode) const override;
+
   std::shared_ptr<Operator<VectorType>> transpose() const override;
 
   std::shared_ptr<Operator<VectorType>>
@@ -40,8 +84,31 @@ public:
   std::shared_ptr<Operator<VectorType>> multiply_transpose(
       std::shared_ptr<Operator<VectorType> const> b) const override;
 
+  /**
+   * The locally owned rows and columns of the matrix must be the same. The
+   * diagonal entries of the ghost columns are communicated once.
+   */
+  std::shared_ptr<Operator<VectorType>>
+  sparsify(double const drop_tolerance, double const safeguard) const override;
+
+  /**
+   * The rows of the matrix are copied to a matrix with the same distribution
+   * on \p comm.
+   */
+  std::shared_ptr<Operator<VectorType>>
+  copy_on_communicator(MPI_Comm comm) const override;
+
+  /**
+   * If the matrix is square, the vector is built like the range vectors.
+   */
   std::shared_ptr<vector_type> build_domain_vector() const override;
 
+  /**
+   * Once setup_transfer() has built the row partition of the matrix, the
+   * entries of the vector are zeroed by the same threads and blocks of rows
+   * as the ones processed by apply_add() and restrict_residual() so that its
+   * pages are first touched by the threads that use them.
+   */
   std::shared_ptr<vector_type> build_range_vector() const override;
 
   size_t grid_complexity() const override;
@@ -52,7 +119,78 @@ public:
   get_matrix() const;
 
 private:
+  /**
+   * Local rows of a matrix split between the rows that only use locally owned
+   * columns and the rows that also use ghost columns. The former can be
+   * processed while the ghost values are communicated.
+   */
+  struct RowPartition
+  {
+    std::vector<int> interior_rows;
+    std::vector<int> boundary_rows;
+    /**
+     * Partitioners of the interior and of the boundary rows. They are reused
+     * by every loop over these rows so that a block of rows is always
+     * processed by the same thread. A partitioner cannot be used by two loops
+     * at the same time, so the kernels of an operator must not be called
+     * concurrently.
+     */
+#ifdef DEAL_II_WITH_THREADS
+    mutable std::array<tbb::affinity_partitioner, 2> partitioners;
+#else
+    mutable std::array<int, 2> partitioners;
+#endif
+#ifdef MFMG_WITH_MPI_SHARED_MEMORY
+    /**
+     * Import of the ghost values that reads the values owned by processors on
+     * the same node from a shared memory window.
+     */
+    std::unique_ptr<SharedMemoryImport> ghost_import;
+#endif
+  };
+
+  /**
+   * Return the partition of the rows of the matrix or of its transpose. The
+   * partition is computed the first time this function is called and it is
+   * cached afterwards. The function can be called concurrently.
+   */
+  RowPartition const &get_row_partition(bool const transposed) const;
+
+  class AccumulatorPool;
+
+  /**
+   * Buffers of restrict_residual(): the accumulators of the contributions of
+   * the tasks and their sum, both on the column map of the transpose of the
+   * matrix. They are reused by every call.
+   */
+  struct RestrictionBuffers
+  {
+    std::unique_ptr<AccumulatorPool> accumulators;
+    std::unique_ptr<Epetra_Vector> y_col;
+  };
+
+  /**
+   * Return the buffers of restrict_residual(). They are allocated the first
+   * time this function is called and they are cached afterwards.
+   */
+  RestrictionBuffers &get_restriction_buffers() const;
+
+  /**
+   * Return the transpose of the matrix. The transpose is computed the first
+   * time this function is called and it is cached afterwards. The function
+   * can be called concurrently.
+   */
+  std::shared_ptr<dealii::TrilinosWrappers::SparseMatrix>
+  get_transposed_matrix() const;
+
   std::shared_ptr<dealii::TrilinosWrappers::SparseMatrix> _sparse_matrix;
+  mutable std::shared_ptr<dealii::TrilinosWrappers::SparseMatrix>
+      _transposed_matrix;
+  mutable std::once_flag _transposed_matrix_flag;
+  mutable std::array<std::unique_ptr<RowPartition>, 2> _row_partitions;
+  mutable std::array<std::once_flag, 2> _row_partition_flags;
+  mutable std::unique_ptr<RestrictionBuffers> _restriction_buffers;
+  mutable std::once_flag _restriction_buffers_flag;
 };
 } // namespace mfmg
 
@@ -0,0 +1,437 @@
+/**************************************************************************
+ * Copyright (c) 2017-2019 by the mfmg authors                            *
+ * All rights reserved.                                                   *
+ *                                                                        *
+ * This file is part of the mfmg library. mfmg is distributed under a BSD *
+ * 3-clause license. For the licensing terms see the LICENSE file in the  *
+ * top-level directory                                                    *
+ *                                                                        *
+ * SPDX-License-Identifier: BSD-3-Clause                                  *
+ *************************************************************************/
+
+#ifndef MFMG_DEALII_FAST_DIAGONALIZATION_HPP
+#define MFMG_DEALII_FAST_DIAGONALIZATION_HPP
+
+#include <deal.II/base/geometry_info.h>
+#include <deal.II/base/quadrature_lib.h>
+#include <deal.II/dofs/dof_accessor.h>
+#include <deal.II/dofs/dof_handler.h>
+#include <deal.II/fe/fe_q.h>
+#include <deal.II/lac/affine_constraints.h>
+#include <deal.II/lac/full_matrix.h>
+#include <deal.II/lac/lapack_full_matrix.h>
+#include <deal.II/lac/vector.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <complex>
+#include <numeric>
+#include <set>
+#include <vector>
+
+namespace mfmg
+{
+namespace internal
+{
+/**
+ * Return the index of @p x in the sorted vector @p points or
+ * dealii::numbers::invalid_unsigned_int if @p x is not one of the points.
+ */
+inline unsigned int find_point(std::vector<double> const &points,
+                               double const x, double const tolerance)
+{
+  auto const it = std::lower_bound(points.begin(), points.end(), x - tolerance);
+  if (it == points.end() || std::abs(*it - x) > tolerance)
+    return dealii::numbers::invalid_unsigned_int;
+
+  return it - points.begin();
+}
+
+/**
+ * Return the permutation that sorts the dofs of the one-dimensional FE_Q
+ * element of degree @p fe_degree by the coordinate of their support point.
+ */
+inline std::vector<unsigned int> sorted_to_fe_q_1d(unsigned int const fe_degree)
+{
+  dealii::FE_Q<1> const fe_1d(fe_degree);
+  std::vector<unsigned int> sorted_to_fe_1d(fe_degree + 1);
+  std::iota(sorted_to_fe_1d.begin(), sorted_to_fe_1d.end(), 0);
+  auto const &unit_points_1d = fe_1d.get_unit_support_points();
+  std::sort(sorted_to_fe_1d.begin(), sorted_to_fe_1d.end(),
+            [&](unsigned int const i, unsigned int const j) {
+              return unit_points_1d[i][0] < unit_points_1d[j][0];
+            });
+
+  return sorted_to_fe_1d;
+}
+
+/**
+ * Return the unit support points of the one-dimensional FE_Q element of
+ * degree @p fe_degree sorted by coordinate.
+ */
+inline std::vector<double>
+sorted_unit_support_points_1d(unsigned int const fe_degree)
+{
+  dealii::FE_Q<1> const fe_1d(fe_degree);
+  std::vector<unsigned int> const sorted_to_fe_1d =
+      sorted_to_fe_q_1d(fe_degree);
+  std::vector<double> sorted_unit_points_1d(fe_degree + 1);
+  for (unsigned int i = 0; i <= fe_degree; ++i)
+    sorted_unit_points_1d[i] =
+        fe_1d.get_unit_support_points()[sorted_to_fe_1d[i]][0];
+
+  return sorted_unit_points_1d;
+}
+
+/**
+ * Compute the stiffness and the mass matrices of the one-dimensional FE_Q
+ * element of degree @p fe_degree on the unit interval, with the dofs sorted by
+ * coordinate. On an interval of length h, the stiffness matrix is divided by h
+ * and the mass matrix is multiplied by h.
+ */
+inline void compute_unit_cell_matrices_1d(unsigned int const fe_degree,
+                                          dealii::FullMatrix<double> &stiffness,
+                                          dealii::FullMatrix<double> &mass)
+{
+  dealii::FE_Q<1> const fe_1d(fe_degree);
+  std::vector<unsigned int> const sorted_to_fe_1d =
+      sorted_to_fe_q_1d(fe_degree);
+  dealii::QGauss<1> const quadrature(fe_degree + 1);
+  stiffness.reinit(fe_degree + 1, fe_degree + 1);
+  mass.reinit(fe_degree + 1, fe_degree + 1);
+  for (unsigned int a = 0; a <= fe_degree; ++a)
+    for (unsigned int b = 0; b <= fe_degree; ++b)
+      for (unsigned int q = 0; q < quadrature.size(); ++q)
+      {
+        auto const &x = quadrature.point(q);
+        stiffness(a, b) += quadrature.weight(q) *
+                           fe_1d.shape_grad(sorted_to_fe_1d[a], x)[0] *
+                           fe_1d.shape_grad(sorted_to_fe_1d[b], x)[0];
+        mass(a, b) += quadrature.weight(q) *
+                      fe_1d.shape_value(sorted_to_fe_1d[a], x) *
+                      fe_1d.shape_value(sorted_to_fe_1d[b], x);
+      }
+}
+} // namespace internal
+
+/**
+ * Compute the eigenpairs of lowest eigenvalues of the operator on an
+ * agglomerate using the fast diagonalization method. If the agglomerate is a
+ * tensor-product grid of axis-parallel cells discretized with FE_Q elements
+ * and the coefficient of the operator is constant on the agglomerate, the
+ * stiffness matrix is the Kronecker sum of one-dimensional stiffness matrices
+ * weighted by one-dimensional mass matrices. The eigenvectors of the pencil
+ * (stiffness, mass) are then the tensor products of the eigenvectors of the
+ * one-dimensional generalized eigenproblems, and the eigenvalues are the sums
+ * of the one-dimensional eigenvalues. Only small dense eigenproblems are
+ * solved and the cost of building the eigenvectors is linear in the number of
+ * dofs.
+ *
+ * The tensor-product modes are eigenvectors of the generalized eigenproblem:
+ * they span the low-energy modes of the agglomerate but they are orthogonal
+ * for the mass matrix, not for the Euclidean inner product. Like the other
+ * eigensolvers, the function returns approximate eigenpairs of the standard
+ * eigenproblem @p op v = lambda v: the Ritz pairs of @p op on the span of the
+ * n_eigenvectors + 1 modes of lowest eigenvalues. The eigenvectors are
+ * orthonormal and the eigenvalues are their Rayleigh quotients.
+ *
+ * The structure of the agglomerate is detected from its cells and from its
+ * constraints, which must be homogeneous Dirichlet conditions on whole faces
+ * of the box. The coefficient is not known: it is estimated from the energy
+ * of the computed modes, and the modes are accepted only if their energies
+ * are consistent with a constant coefficient and if they are orthogonal for
+ * @p op, up to @p tolerance. This requires n_eigenvectors + 1 evaluations of
+ * @p op. If any check fails, the function returns false and the output
+ * arguments are left untouched.
+ */
+template <int dim, typename OperatorType, typename VectorType>
+bool fast_diagonalization_compute_eigenvalues_and_eigenvectors(
+    unsigned int const n_eigenvectors, double const tolerance,
+    dealii::DoFHandler<dim> const &dof_handler,
+    dealii::AffineConstraints<double> const &constraints,
+    OperatorType const &op, std::vector<std::complex<double>> &eigenvalues,
+    std::vector<VectorType> &eigenvectors)
+{
+  auto const &fe = dof_handler.get_fe();
+  if (fe.n_components() != 1 || fe.get_name().find("FE_Q<") != 0)
+    return false;
+  unsigned int const fe_degree = fe.degree;
+
+  // Check that the cells are axis-parallel boxes and collect the coordinates
+  // of the grid lines in each direction.
+  double const geometric_tolerance =
+      1e-10 * dof_handler.begin_active()->minimum_vertex_distance();
+  unsigned int const last_vertex =
+      dealii::GeometryInfo<dim>::vertices_per_cell - 1;
+  std::array<std::vector<double>, dim> grid_lines;
+  for (auto const &cell : dof_handler.active_cell_iterators())
+  {
+    for (unsigned int v = 0; v <= last_vertex; ++v)
+      for (unsigned int d = 0; d < dim; ++d)
+      {
+        unsigned int const corner = ((v >> d) & 1) ? last_vertex : 0;
+        if (std::abs(cell->vertex(v)[d] - cell->vertex(corner)[d]) >
+            geometric_tolerance)
+          return false;
+      }
+    for (unsigned int d = 0; d < dim; ++d)
+    {
+      grid_lines[d].push_back(cell->vertex(0)[d]);
+      grid_lines[d].push_back(cell->vertex(last_vertex)[d]);
+    }
+  }
+  for (auto &lines : grid_lines)
+  {
+    std::sort(lines.begin(), lines.end());
+    lines.erase(std::unique(lines.begin(), lines.end(),
+                            [&](double const a, double const b) {
+                              return std::abs(a - b) <= geometric_tolerance;
+                            }),
+                lines.end());
+  }
+
+  std::vector<double> const sorted_unit_points_1d =
+      internal::sorted_unit_support_points_1d(fe_degree);
+
+  // The cells must tile the box spanned by the grid lines.
+  std::array<unsigned int, dim> n_dofs_1d;
+  unsigned int n_cells = 1;
+  unsigned int n_dofs = 1;
+  for (unsigned int d = 0; d < dim; ++d)
+  {
+    n_cells *= grid_lines[d].size() - 1;
+    n_dofs_1d[d] = (grid_lines[d].size() - 1) * fe_degree + 1;
+    n_dofs *= n_dofs_1d[d];
+  }
+  if (n_cells != dof_handler.get_triangulation().n_active_cells() ||
+      n_dofs != dof_handler.n_dofs())
+    return false;
+
+  // Compute the position of each dof in the tensor-product grid of dofs.
+  std::vector<std::array<unsigned int, dim>> tensor_indices(n_dofs);
+  std::vector<bool> is_set(n_dofs, false);
+  std::vector<dealii::types::global_dof_index> dof_indices(fe.dofs_per_cell);
+  auto const &unit_points = fe.get_unit_support_points();
+  for (auto const &cell : dof_handler.active_cell_iterators())
+  {
+    std::array<unsigned int, dim> cell_index;
+    for (unsigned int d = 0; d < dim; ++d)
+    {
+      cell_index[d] = internal::find_point(
+          grid_lines[d], cell->vertex(0)[d], geometric_tolerance);
+      if (cell_index[d] + 1 >= grid_lines[d].size() ||
+          std::abs(grid_lines[d][cell_index[d] + 1] -
+                   cell->vertex(last_vertex)[d]) > geometric_tolerance)
+        return false;
+    }
+
+    cell->get_dof_indices(dof_indices);
+    for (unsigned int i = 0; i < fe.dofs_per_cell; ++i)
+    {
+      std::array<unsigned int, dim> tensor_index;
+      for (unsigned int d = 0; d < dim; ++d)
+      {
+        unsigned int const local_index = internal::find_point(
+            sorted_unit_points_1d, unit_points[i][d], 1e-10);
+        if (local_index == dealii::numbers::invalid_unsigned_int)
+          return false;
+        tensor_index[d] = cell_index[d] * fe_degree + local_index;
+      }
+      if (is_set[dof_indices[i]] &&
+          tensor_indices[dof_indices[i]] != tensor_index)
+        return false;
+      tensor_indices[dof_indices[i]] = tensor_index;
+      is_set[dof_indices[i]] = true;
+    }
+  }
+  std::set<std::array<unsigned int, dim>> const distinct_indices(
+      tensor_indices.begin(), tensor_indices.end());
+  if (distinct_indices.size() != n_dofs)
+    return false;
+
+  // The constraints must be homogeneous Dirichlet conditions on faces of the
+  // box. The one-dimensional problems are restricted to the free indices
+  // [begin, end).
+  std::array<unsigned int, dim> begin;
+  std::array<unsigned int, dim> end;
+  for (unsigned int d = 0; d < dim; ++d)
+  {
+    std::array<bool, 2> is_constrained_face = {{true, true}};
+    for (unsigned int dof = 0; dof < n_dofs; ++dof)
+    {
+      if (tensor_indices[dof][d] == 0 && !constraints.is_constrained(dof))
+        is_constrained_face[0] = false;
+      if (tensor_indices[dof][d] == n_dofs_1d[d] - 1 &&
+          !constraints.is_constrained(dof))
+        is_constrained_face[1] = false;
+    }
+    begin[d] = is_constrained_face[0] ? 1 : 0;
+    end[d] = is_constrained_face[1] ? n_dofs_1d[d] - 1 : n_dofs_1d[d];
+    if (begin[d] >= end[d])
+      return false;
+  }
+  auto const is_free = [&](unsigned int const dof) {
+    for (unsigned int d = 0; d < dim; ++d)
+      if (tensor_indices[dof][d] < begin[d] || tensor_indices[dof][d] >= end[d])
+        return false;
+    return true;
+  };
+  for (unsigned int dof = 0; dof < n_dofs; ++dof)
+  {
+    if (is_free(dof) == constraints.is_constrained(dof))
+      return false;
+    if (constraints.is_constrained(dof) &&
+        (constraints.get_constraint_entries(dof)->size() > 0 ||
+         constraints.get_inhomogeneity(dof) != 0.))
+      return false;
+  }
+
+  // Assemble and solve the one-dimensional generalized eigenproblems.
+  dealii::FullMatrix<double> unit_stiffness;
+  dealii::FullMatrix<double> unit_mass;
+  internal::compute_unit_cell_matrices_1d(fe_degree, unit_stiffness,
+                                          unit_mass);
+  std::array<std::vector<double>, dim> eigenvalues_1d;
+  std::array<std::vector<dealii::Vector<double>>, dim> eigenvectors_1d;
+  for (unsigned int d = 0; d < dim; ++d)
+  {
+    unsigned int const n = end[d] - begin[d];
+    dealii::LAPACKFullMatrix<double> stiffness(n, n);
+    dealii::LAPACKFullMatrix<double> mass(n, n);
+    for (unsigned int c = 0; c + 1 < grid_lines[d].size(); ++c)
+    {
+      double const h = grid_lines[d][c + 1] - grid_lines[d][c];
+      for (unsigned int a = 0; a <= fe_degree; ++a)
+        for (unsigned int b = 0; b <= fe_degree; ++b)
+        {
+          unsigned int const row = c * fe_degree + a;
+          unsigned int const col = c * fe_degree + b;
+          if (row < begin[d] || row >= end[d] || col < begin[d] ||
+              col >= end[d])
+            continue;
+          stiffness(row - begin[d], col - begin[d]) += unit_stiffness(a, b) / h;
+          mass(row - begin[d], col - begin[d]) += unit_mass(a, b) * h;
+        }
+    }
+
+    // The eigenvalues are sorted in ascending order and the eigenvectors are
+    // normalized for the mass matrix.
+    eigenvectors_1d[d].resize(n, dealii::Vector<double>(n));
+    stiffness.compute_generalized_eigenvalues_symmetric(mass,
+                                                        eigenvectors_1d[d]);
+    eigenvalues_1d[d].resize(n);
+    for (unsigned int i = 0; i < n; ++i)
+      eigenvalues_1d[d][i] = stiffness.eigenvalue(i).real();
+  }
+
+  // Select the combinations of one-dimensional modes with the lowest sums of
+  // eigenvalues. One more mode than requested is used to estimate the
+  // coefficient.
+  std::vector<std::pair<double, std::array<unsigned int, dim>>> modes;
+  std::array<unsigned int, dim> mode_index;
+  mode_index.fill(0);
+  std::array<unsigned int, dim> n_modes_1d;
+  for (unsigned int d = 0; d < dim; ++d)
+    n_modes_1d[d] =
+        std::min<unsigned int>(eigenvalues_1d[d].size(), n_eigenvectors + 1);
+  while (true)
+  {
+    double sum = 0.;
+    for (unsigned int d = 0; d < dim; ++d)
+      sum += eigenvalues_1d[d][mode_index[d]];
+    modes.emplace_back(sum, mode_index);
+
+    unsigned int d = 0;
+    while (d < dim && ++mode_index[d] == n_modes_1d[d])
+      mode_index[d++] = 0;
+    if (d == dim)
+      break;
+  }
+  if (modes.size() < n_eigenvectors)
+    return false;
+  std::sort(modes.begin(), modes.end(),
+            [](auto const &a, auto const &b) { return a.first < b.first; });
+  unsigned int const n_modes =
+      std::min<unsigned int>(modes.size(), n_eigenvectors + 1);
+
+  std::vector<VectorType> mode_vectors(n_modes);
+  std::vector<VectorType> op_mode_vectors(n_modes);
+  for (unsigned int k = 0; k < n_modes; ++k)
+  {
+    mode_vectors[k].reinit(n_dofs);
+    for (unsigned int dof = 0; dof < n_dofs; ++dof)
+    {
+      if (!is_free(dof))
+        continue;
+      double value = 1.;
+      for (unsigned int d = 0; d < dim; ++d)
+        value *= eigenvectors_1d[d][modes[k].second[d]]
+                                [tensor_indices[dof][d] - begin[d]];
+      mode_vectors[k][dof] = value;
+    }
+    op_mode_vectors[k].reinit(n_dofs);
+    op.vmult(op_mode_vectors[k], mode_vectors[k]);
+  }
+
+  // Since the modes are normalized for the mass matrix, their energy is the
+  // generalized eigenvalue times the coefficient.
+  double energy_sum = 0.;
+  double eigenvalue_sum = 0.;
+  for (unsigned int k = 0; k < n_modes; ++k)
+  {
+    energy_sum += mode_vectors[k] * op_mode_vectors[k];
+    eigenvalue_sum += modes[k].first;
+  }
+  if (!(eigenvalue_sum > 0.) || !(energy_sum > 0.))
+    return false;
+  double const coefficient = energy_sum / eigenvalue_sum;
+  double const scale = coefficient * modes[n_modes - 1].first;
+  for (unsigned int k = 0; k < n_modes; ++k)
+  {
+    if (std::abs(mode_vectors[k] * op_mode_vectors[k] -
+                 coefficient * modes[k].first) > tolerance * scale)
+      return false;
+    for (unsigned int j = 0; j < k; ++j)
+      if (std::abs(mode_vectors[j] * op_mode_vectors[k]) > tolerance * scale)
+        return false;
+  }
+
+  // Rayleigh-Ritz projection of the operator on the span of the modes. The
+  // products with the operator are already computed, so only the small dense
+  // generalized eigenproblem H c = theta G c, with G the Gram matrix of the
+  // modes, is left. The eigenvectors c are normalized for G, so the Ritz
+  // vectors have a unit l2 norm.
+  dealii::LAPACKFullMatrix<double> projected_op(n_modes, n_modes);
+  dealii::LAPACKFullMatrix<double> gram(n_modes, n_modes);
+  for (unsigned int i = 0; i < n_modes; ++i)
+    for (unsigned int j = 0; j <= i; ++j)
+    {
+      double const op_ij = 0.5 * (mode_vectors[i] * op_mode_vectors[j] +
+                                  mode_vectors[j] * op_mode_vectors[i]);
+      projected_op(i, j) = op_ij;
+      projected_op(j, i) = op_ij;
+      double const gram_ij = mode_vectors[i] * mode_vectors[j];
+      gram(i, j) = gram_ij;
+      gram(j, i) = gram_ij;
+    }
+  std::vector<dealii::Vector<double>> ritz_coefficients(
+      n_modes, dealii::Vector<double>(n_modes));
+  projected_op.compute_generalized_eigenvalues_symmetric(gram,
+                                                         ritz_coefficients);
+
+  eigenvalues.resize(n_eigenvectors);
+  eigenvectors.resize(n_eigenvectors);
+  for (unsigned int k = 0; k < n_eigenvectors; ++k)
+  {
+    eigenvalues[k] = projected_op.eigenvalue(k).real();
+    eigenvectors[k].reinit(n_dofs);
+    for (unsigned int j = 0; j < n_modes; ++j)
+      eigenvectors[k].add(ritz_coefficients[k][j], mode_vectors[j]);
+  }
+
+  return true;
+}
+} // namespace mfmg
+
+#endif
@@ -0,0 +1,98 @@
+/**************************************************************************
+ * Copyright (c) 2017-2019 by the mfmg authors                            *
+ * All rights reserved.                                                   *
+ *                                                                        *
+ * This file is part of the mfmg library. mfmg is distributed under a BSD *
+ * 3-clause license. For the licensing terms see the LICENSE file in the  *
+ * top-level directory                                                    *
+ *                                                                        *
+ * SPDX-License-Identifier: BSD-3-Clause                                  *
+ *************************************************************************/
+
+#ifndef MFMG_SHARED_MEMORY_IMPORT_HPP
+#define MFMG_SHARED_MEMORY_IMPORT_HPP
+
+#include <deal.II/base/mpi.h>
+
+#include <Epetra_Import.h>
+#include <Epetra_Map.h>
+#include <Epetra_Vector.h>
+
+#include <memory>
+#include <vector>
+
+namespace mfmg
+{
+/**
+ * Replacement for Epetra_Import that uses MPI-3 shared memory windows for the
+ * processors that are on the same node. Each processor copies its locally
+ * owned values in a shared memory window and the ghost values owned by a
+ * processor on the same node are read directly from that window. The ghost
+ * values owned by processors on other nodes are communicated using an
+ * Epetra_Import. The constructor and the destructor are collective.
+ */
+class SharedMemoryImport
+{
+public:
+  /**
+   * Build the communication pattern to import values distributed according to
+   * \p source_map into vectors distributed according to \p target_map. The
+   * processors that share memory are the ones of \p node_comm, which must be
+   * a subset of the processors on the same node. By default, all the
+   * processors on the same node share memory.
+   */
+  SharedMemoryImport(Epetra_Map const &source_map,
+                     Epetra_Map const &target_map,
+                     MPI_Comm node_comm = MPI_COMM_NULL);
+
+  ~SharedMemoryImport();
+
+  SharedMemoryImport(SharedMemoryImport const &) = delete;
+
+  SharedMemoryImport &operator=(SharedMemoryImport const &) = delete;
+
+  /**
+   * Import the values of \p source, which are the locally owned values of
+   * \p source_map, in \p target, which is distributed according to \p
+   * target_map. This function is collective over the processors of the node.
+   */
+  void import(double const *source, double *target);
+
+private:
+  MPI_Comm _node_comm;
+  MPI_Win _window;
+  unsigned int _n_owned;
+  double *_local_segment;
+  /**
+   * Beginning and size of the segment of every processor on the node.
+   */
+  std::vector<double const *> _segments;
+  std::vector<unsigned int> _segment_sizes;
+  /**
+   * The window contains two buffers so that only one synchronization is
+   * required per import.
+   */
+  unsigned int _buffer = 0;
+  /**
+   * Pairs (target index, source index) of values owned by this processor.
+   */
+  std::vector<std::pair<int, int>> _local_copies;
+  /**
+   * Target index, processor on the node, and index on that processor of the
+   * values owned by another processor on the node.
+   */
+  std::vector<int> _node_target_indices;
+  std::vector<int> _node_ranks;
+  std::vector<int> _node_source_indices;
+  /**
+   * Target index of the values owned by processors on other nodes.
+   */
+  std::vector<int> _off_node_target_indices;
+  std::unique_ptr<Epetra_Map> _off_node_map;
+  std::unique_ptr<Epetra_Import> _off_node_importer;
+  std::unique_ptr<Epetra_Vector> _off_node_values;
+  Epetra_Map _source_map;
+};
+} // namespace mfmg
+
+#endif
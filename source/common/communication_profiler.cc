@@ -0,0 +1,334 @@
+/**************************************************************************
+ * Copyright (c) 2017-2019 by the mfmg authors                            *
+ * All rights reserved.                                                   *
+ *                                                                        *
+ * This file is part of the mfmg library. mfmg is distributed under a BSD *
+ * 3-clause license. For the licensing terms see the LICENSE file in the  *
+ * top-level directory                                                    *
+ *                                                                        *
+ * SPDX-License-Identifier: BSD-3-Clause                                  *
+ *************************************************************************/
+
+#include <mfmg/common/communication_profiler.hpp>
+#include <mfmg/common/exceptions.hpp>
+
+#include <iomanip>
+#include <mutex>
+#include <vector>
+
+#include <mpi.h>
+
+namespace mfmg
+{
+namespace
+{
+// The data is created on first use because the MPI wrappers may be called
+// before the static objects of the library are initialized, e.g., in
+// MPI_Init.
+struct ProfilerData
+{
+  std::mutex mutex;
+  std::map<CommunicationProfiler::Key, CommunicationStatistics> statistics;
+};
+
+ProfilerData &get_profiler_data()
+{
+  static ProfilerData data;
+  return data;
+}
+
+// The stages are not shared between the threads, otherwise the communication
+// of concurrent tasks would be attributed to the stage entered last.
+std::vector<CommunicationProfiler::Key> &get_stages()
+{
+  thread_local std::vector<CommunicationProfiler::Key> stages;
+  return stages;
+}
+} // namespace
+
+void CommunicationProfiler::enter(int level, std::string const &stage)
+{
+  auto &stages = get_stages();
+  if (level < 0)
+    level = stages.empty() ? -1 : stages.back().first;
+  stages.emplace_back(level, stage);
+}
+
+void CommunicationProfiler::leave()
+{
+  auto &stages = get_stages();
+  ASSERT(!stages.empty(), "No stage to leave");
+  stages.pop_back();
+}
+
+void CommunicationProfiler::record(std::size_t n_messages,
+                                   std::size_t n_collectives,
+                                   std::size_t n_bytes, double time)
+{
+  auto const &stages = get_stages();
+  auto &data = get_profiler_data();
+  std::lock_guard<std::mutex> lock(data.mutex);
+  auto &statistics =
+      data.statistics[stages.empty() ? Key(-1, "") : stages.back()];
+  statistics.n_messages += n_messages;
+  statistics.n_collectives += n_collectives;
+  statistics.n_bytes += n_bytes;
+  statistics.time += time;
+}
+
+std::map<CommunicationProfiler::Key, CommunicationStatistics>
+CommunicationProfiler::get_statistics()
+{
+  auto &data = get_profiler_data();
+  std::lock_guard<std::mutex> lock(data.mutex);
+  return data.statistics;
+}
+
+void CommunicationProfiler::reset()
+{
+  auto &data = get_profiler_data();
+  std::lock_guard<std::mutex> lock(data.mutex);
+  data.statistics.clear();
+}
+
+void CommunicationProfiler::print(std::ostream &out)
+{
+  out << std::setw(6) << "level" << std::setw(12) << "messages"
+      << std::setw(12) << "collectives" << std::setw(14) << "bytes"
+      << std::setw(12) << "time [s]"
+      << "  stage" << std::endl;
+  for (auto const &entry : get_statistics())
+  {
+    auto const &statistics = entry.second;
+    out << std::setw(6) << entry.first.first << std::setw(12)
+        << statistics.n_messages << std::setw(12) << statistics.n_collectives
+        << std::setw(14) << statistics.n_bytes << std::setw(12)
+        << statistics.time << "  " << entry.first.second << std::endl;
+  }
+}
+} // namespace mfmg
+
+#ifdef MFMG_WITH_MPI_PROFILING
+// The wrappers are defined in the same object file as the profiler so that
+// they are linked in whenever the profiler is used, including with a static
+// library. They override the symbols of the MPI library and forward the calls
+// to the PMPI interface.
+namespace
+{
+std::size_t n_bytes(int count, MPI_Datatype datatype)
+{
+  int type_size = 0;
+  PMPI_Type_size(datatype, &type_size);
+  return static_cast<std::size_t>(count) * type_size;
+}
+} // namespace
+
+extern "C" {
+int MPI_Send(const void *buf, int count, MPI_Datatype datatype, int dest,
+             int tag, MPI_Comm comm)
+{
+  double const start = PMPI_Wtime();
+  int const ierr = PMPI_Send(buf, count, datatype, dest, tag, comm);
+  mfmg::CommunicationProfiler::record(1, 0, n_bytes(count, datatype),
+                                      PMPI_Wtime() - start);
+  return ierr;
+}
+
+int MPI_Rsend(const void *buf, int count, MPI_Datatype datatype, int dest,
+              int tag, MPI_Comm comm)
+{
+  double const start = PMPI_Wtime();
+  int const ierr = PMPI_Rsend(buf, count, datatype, dest, tag, comm);
+  mfmg::CommunicationProfiler::record(1, 0, n_bytes(count, datatype),
+                                      PMPI_Wtime() - start);
+  return ierr;
+}
+
+int MPI_Isend(const void *buf, int count, MPI_Datatype datatype, int dest,
+              int tag, MPI_Comm comm, MPI_Request *request)
+{
+  double const start = PMPI_Wtime();
+  int const ierr = PMPI_Isend(buf, count, datatype, dest, tag, comm, request);
+  mfmg::CommunicationProfiler::record(1, 0, n_bytes(count, datatype),
+                                      PMPI_Wtime() - start);
+  return ierr;
+}
+
+int MPI_Recv(void *buf, int count, MPI_Datatype datatype, int source, int tag,
+             MPI_Comm comm, MPI_Status *status)
+{
+  double const start = PMPI_Wtime();
+  int const ierr = PMPI_Recv(buf, count, datatype, source, tag, comm, status);
+  mfmg::CommunicationProfiler::record(1, 0, n_bytes(count, datatype),
+                                      PMPI_Wtime() - start);
+  return ierr;
+}
+
+int MPI_Irecv(void *buf, int count, MPI_Datatype datatype, int source, int tag,
+              MPI_Comm comm, MPI_Request *request)
+{
+  double const start = PMPI_Wtime();
+  int const ierr =
+      PMPI_Irecv(buf, count, datatype, source, tag, comm, request);
+  mfmg::CommunicationProfiler::record(1, 0, n_bytes(count, datatype),
+                                      PMPI_Wtime() - start);
+  return ierr;
+}
+
+// Both the sent and the received messages are counted.
+int MPI_Sendrecv(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                 int dest, int sendtag, void *recvbuf, int recvcount,
+                 MPI_Datatype recvtype, int source, int recvtag, MPI_Comm comm,
+                 MPI_Status *status)
+{
+  double const start = PMPI_Wtime();
+  int const ierr =
+      PMPI_Sendrecv(sendbuf, sendcount, sendtype, dest, sendtag, recvbuf,
+                    recvcount, recvtype, source, recvtag, comm, status);
+  mfmg::CommunicationProfiler::record(
+      2, 0, n_bytes(sendcount, sendtype) + n_bytes(recvcount, recvtype),
+      PMPI_Wtime() - start);
+  return ierr;
+}
+
+int MPI_Wait(MPI_Request *request, MPI_Status *status)
+{
+  double const start = PMPI_Wtime();
+  int const ierr = PMPI_Wait(request, status);
+  mfmg::CommunicationProfiler::record(0, 0, 0, PMPI_Wtime() - start);
+  return ierr;
+}
+
+int MPI_Waitall(int count, MPI_Request array_of_requests[],
+                MPI_Status array_of_statuses[])
+{
+  double const start = PMPI_Wtime();
+  int const ierr = PMPI_Waitall(count, array_of_requests, array_of_statuses);
+  mfmg::CommunicationProfiler::record(0, 0, 0, PMPI_Wtime() - start);
+  return ierr;
+}
+
+int MPI_Waitany(int count, MPI_Request array_of_requests[], int *index,
+                MPI_Status *status)
+{
+  double const start = PMPI_Wtime();
+  int const ierr = PMPI_Waitany(count, array_of_requests, index, status);
+  mfmg::CommunicationProfiler::record(0, 0, 0, PMPI_Wtime() - start);
+  return ierr;
+}
+
+// The requests are also progressed by the tests, so their time is recorded
+// like the one of the waits.
+int MPI_Test(MPI_Request *request, int *flag, MPI_Status *status)
+{
+  double const start = PMPI_Wtime();
+  int const ierr = PMPI_Test(request, flag, status);
+  mfmg::CommunicationProfiler::record(0, 0, 0, PMPI_Wtime() - start);
+  return ierr;
+}
+
+int MPI_Testall(int count, MPI_Request array_of_requests[], int *flag,
+                MPI_Status array_of_statuses[])
+{
+  double const start = PMPI_Wtime();
+  int const ierr =
+      PMPI_Testall(count, array_of_requests, flag, array_of_statuses);
+  mfmg::CommunicationProfiler::record(0, 0, 0, PMPI_Wtime() - start);
+  return ierr;
+}
+
+int MPI_Testany(int count, MPI_Request array_of_requests[], int *index,
+                int *flag, MPI_Status *status)
+{
+  double const start = PMPI_Wtime();
+  int const ierr =
+      PMPI_Testany(count, array_of_requests, index, flag, status);
+  mfmg::CommunicationProfiler::record(0, 0, 0, PMPI_Wtime() - start);
+  return ierr;
+}
+
+int MPI_Testsome(int incount, MPI_Request array_of_requests[], int *outcount,
+                 int array_of_indices[], MPI_Status array_of_statuses[])
+{
+  double const start = PMPI_Wtime();
+  int const ierr = PMPI_Testsome(incount, array_of_requests, outcount,
+                                 array_of_indices, array_of_statuses);
+  mfmg::CommunicationProfiler::record(0, 0, 0, PMPI_Wtime() - start);
+  return ierr;
+}
+
+int MPI_Allreduce(const void *sendbuf, void *recvbuf, int count,
+                  MPI_Datatype datatype, MPI_Op op, MPI_Comm comm)
+{
+  double const start = PMPI_Wtime();
+  int const ierr = PMPI_Allreduce(sendbuf, recvbuf, count, datatype, op, comm);
+  mfmg::CommunicationProfiler::record(0, 1, n_bytes(count, datatype),
+                                      PMPI_Wtime() - start);
+  return ierr;
+}
+
+int MPI_Reduce(const void *sendbuf, void *recvbuf, int count,
+               MPI_Datatype datatype, MPI_Op op, int root, MPI_Comm comm)
+{
+  double const start = PMPI_Wtime();
+  int const ierr =
+      PMPI_Reduce(sendbuf, recvbuf, count, datatype, op, root, comm);
+  mfmg::CommunicationProfiler::record(0, 1, n_bytes(count, datatype),
+                                      PMPI_Wtime() - start);
+  return ierr;
+}
+
+int MPI_Bcast(void *buffer, int count, MPI_Datatype datatype, int root,
+              MPI_Comm comm)
+{
+  double const start = PMPI_Wtime();
+  int const ierr = PMPI_Bcast(buffer, count, datatype, root, comm);
+  mfmg::CommunicationProfiler::record(0, 1, n_bytes(count, datatype),
+                                      PMPI_Wtime() - start);
+  return ierr;
+}
+
+// The bytes of the gathers are the contribution of the calling process.
+int MPI_Allgather(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                  void *recvbuf, int recvcount, MPI_Datatype recvtype,
+                  MPI_Comm comm)
+{
+  double const start = PMPI_Wtime();
+  int const ierr = PMPI_Allgather(sendbuf, sendcount, sendtype, recvbuf,
+                                  recvcount, recvtype, comm);
+  std::size_t const bytes = (sendbuf == MPI_IN_PLACE)
+                                ? n_bytes(recvcount, recvtype)
+                                : n_bytes(sendcount, sendtype);
+  mfmg::CommunicationProfiler::record(0, 1, bytes, PMPI_Wtime() - start);
+  return ierr;
+}
+
+int MPI_Allgatherv(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                   void *recvbuf, const int recvcounts[], const int displs[],
+                   MPI_Datatype recvtype, MPI_Comm comm)
+{
+  double const start = PMPI_Wtime();
+  int const ierr = PMPI_Allgatherv(sendbuf, sendcount, sendtype, recvbuf,
+                                   recvcounts, displs, recvtype, comm);
+  std::size_t bytes = 0;
+  if (sendbuf == MPI_IN_PLACE)
+  {
+    int rank = 0;
+    PMPI_Comm_rank(comm, &rank);
+    bytes = n_bytes(recvcounts[rank], recvtype);
+  }
+  else
+    bytes = n_bytes(sendcount, sendtype);
+  mfmg::CommunicationProfiler::record(0, 1, bytes, PMPI_Wtime() - start);
+  return ierr;
+}
+
+int MPI_Barrier(MPI_Comm comm)
+{
+  double const start = PMPI_Wtime();
+  int const ierr = PMPI_Barrier(comm);
+  mfmg::CommunicationProfiler::record(0, 1, 0, PMPI_Wtime() - start);
+  return ierr;
+}
+}
+#endif
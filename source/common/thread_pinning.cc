@@ -0,0 +1,105 @@
+/**************************************************************************
+ * Copyright (c) 2017-2019 by the mfmg authors                            *
+ * All rights reserved.                                                   *
+ *                                                                        *
+ * This file is part of the mfmg library. mfmg is distributed under a BSD *
+ * 3-clause license. For the licensing terms see the LICENSE file in the  *
+ * top-level directory                                                    *
+ *                                                                        *
+ * SPDX-License-Identifier: BSD-3-Clause                                  *
+ *************************************************************************/
+
+#include <mfmg/common/exceptions.hpp>
+#include <mfmg/common/thread_pinning.hpp>
+
+#include <deal.II/base/config.h>
+
+#if defined(DEAL_II_WITH_THREADS) && defined(__linux__)
+#include <tbb/task_scheduler_observer.h>
+
+#include <atomic>
+#include <vector>
+
+#include <sched.h>
+#endif
+
+namespace mfmg
+{
+#if defined(DEAL_II_WITH_THREADS) && defined(__linux__)
+namespace
+{
+class PinningObserver : public tbb::task_scheduler_observer
+{
+public:
+  PinningObserver()
+  {
+    // The cores are the ones of the initial affinity mask of the process so
+    // that several processes on the same node do not use the same cores.
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    ASSERT_THROW(sched_getaffinity(0, sizeof(mask), &mask) == 0,
+                 "Cannot read the affinity mask of the process");
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+      if (CPU_ISSET(cpu, &mask))
+        _cpus.push_back(cpu);
+    ASSERT_THROW(!_cpus.empty(), "The affinity mask of the process is empty");
+  }
+
+  /**
+   * Pin the calling thread to the next core. A thread is only pinned once.
+   * Return false if the affinity of the thread could not be set.
+   */
+  bool pin_current_thread()
+  {
+    thread_local bool is_pinned = false;
+    if (is_pinned)
+      return true;
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    CPU_SET(_cpus[_n_threads++ % _cpus.size()], &mask);
+    is_pinned = (sched_setaffinity(0, sizeof(mask), &mask) == 0);
+    if (!is_pinned)
+      ++_n_failures;
+    return is_pinned;
+  }
+
+  void on_scheduler_entry(bool) override
+  {
+    // The callback cannot report an error, so the failures are counted
+    pin_current_thread();
+  }
+
+  unsigned int get_n_failures() const { return _n_failures; }
+
+private:
+  std::vector<int> _cpus;
+  std::atomic<unsigned int> _n_threads{0};
+  std::atomic<unsigned int> _n_failures{0};
+};
+
+PinningObserver &get_observer()
+{
+  static PinningObserver observer;
+  return observer;
+}
+} // namespace
+
+bool pin_threads()
+{
+  auto &observer = get_observer();
+  ASSERT_THROW(observer.pin_current_thread(),
+               "Cannot set the affinity of the calling thread");
+  observer.observe(true);
+  return true;
+}
+
+unsigned int get_n_unpinned_threads()
+{
+  return get_observer().get_n_failures();
+}
+#else
+bool pin_threads() { return false; }
+
+unsigned int get_n_unpinned_threads() { return 0; }
+#endif
+} // namespace mfmg
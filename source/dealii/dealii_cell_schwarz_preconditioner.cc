@@ -0,0 +1,302 @@
+/**************************************************************************
+ * Copyright (c) 2017-2019 by the mfmg authors                            *
+ * All rights reserved.                                                   *
+ *                                                                        *
+ * This file is part of the mfmg library. mfmg is distributed under a BSD *
+ * 3-clause license. For the licensing terms see the LICENSE file in the  *
+ * top-level directory                                                    *
+ *                                                                        *
+ * SPDX-License-Identifier: BSD-3-Clause                                  *
+ *************************************************************************/
+
+#include <mfmg/common/exceptions.hpp>
+#include <mfmg/common/instantiation.hpp>
+#include <mfmg/dealii/dealii_cell_schwarz_preconditioner.hpp>
+#include <mfmg/dealii/fast_diagonalization.hpp>
+
+#include <deal.II/dofs/dof_accessor.h>
+#include <deal.II/dofs/dof_tools.h>
+#include <deal.II/lac/lapack_full_matrix.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace mfmg
+{
+template <int dim, typename VectorType>
+CellSchwarzPreconditioner<dim, VectorType>::CellSchwarzPreconditioner(
+    dealii::DoFHandler<dim> const &dof_handler,
+    dealii::AffineConstraints<double> const &constraints,
+    vector_type const &diagonal_inverse)
+{
+  auto const &fe = dof_handler.get_fe();
+  ASSERT_THROW(fe.n_components() == 1 && fe.get_name().find("FE_Q<") == 0,
+               "The cell Schwarz preconditioner requires a scalar FE_Q "
+               "element");
+  unsigned int const fe_degree = fe.degree;
+  unsigned int const dofs_per_cell = fe.dofs_per_cell;
+  _n_1d = fe_degree + 1;
+
+  // Compute the lexicographic numbering of the dofs of a cell.
+  std::vector<double> const sorted_unit_points_1d =
+      internal::sorted_unit_support_points_1d(fe_degree);
+  std::vector<unsigned int> lexicographic_to_hierarchic(dofs_per_cell);
+  auto const &unit_points = fe.get_unit_support_points();
+  for (unsigned int i = 0; i < dofs_per_cell; ++i)
+  {
+    unsigned int lexicographic_index = 0;
+    for (int d = dim - 1; d >= 0; --d)
+    {
+      unsigned int const index_1d = internal::find_point(
+          sorted_unit_points_1d, unit_points[i][d], 1e-10);
+      ASSERT(index_1d != dealii::numbers::invalid_unsigned_int,
+             "The support points are not those of FE_Q");
+      lexicographic_index = lexicographic_index * _n_1d + index_1d;
+    }
+    lexicographic_to_hierarchic[lexicographic_index] = i;
+  }
+
+  // Solve the one-dimensional generalized eigenproblem on the unit interval.
+  dealii::FullMatrix<double> unit_stiffness;
+  dealii::FullMatrix<double> unit_mass;
+  internal::compute_unit_cell_matrices_1d(fe_degree, unit_stiffness,
+                                          unit_mass);
+  dealii::LAPACKFullMatrix<double> stiffness(_n_1d);
+  dealii::LAPACKFullMatrix<double> mass(_n_1d);
+  stiffness = unit_stiffness;
+  mass = unit_mass;
+  std::vector<dealii::Vector<double>> eigenvectors(
+      _n_1d, dealii::Vector<double>(_n_1d));
+  stiffness.compute_generalized_eigenvalues_symmetric(mass, eigenvectors);
+  _eigenvalues.resize(_n_1d);
+  _eigenvectors.reinit(_n_1d, _n_1d);
+  for (unsigned int i = 0; i < _n_1d; ++i)
+  {
+    _eigenvalues[i] = std::max(0., stiffness.eigenvalue(i).real());
+    for (unsigned int j = 0; j < _n_1d; ++j)
+      _eigenvectors(j, i) = eigenvectors[i][j];
+  }
+
+  // Diagonal of the operator on a cell with a unit coefficient.
+  auto const reference_cell_diagonal = [&](unsigned int lexicographic_index,
+                                           std::array<double, dim> const &h) {
+    std::array<unsigned int, dim> index_1d;
+    for (unsigned int d = 0; d < dim; ++d)
+    {
+      index_1d[d] = lexicographic_index % _n_1d;
+      lexicographic_index /= _n_1d;
+    }
+    double value = 0.;
+    for (unsigned int d = 0; d < dim; ++d)
+    {
+      double term = unit_stiffness(index_1d[d], index_1d[d]) / h[d];
+      for (unsigned int e = 0; e < dim; ++e)
+        if (e != d)
+          term *= unit_mass(index_1d[e], index_1d[e]) * h[e];
+      value += term;
+    }
+    return value;
+  };
+
+  MPI_Comm comm = diagonal_inverse.get_partitioner()->get_mpi_communicator();
+  dealii::IndexSet locally_relevant_dofs;
+  dealii::DoFTools::extract_locally_relevant_dofs(dof_handler,
+                                                  locally_relevant_dofs);
+  _weights.reinit(dof_handler.locally_owned_dofs(), locally_relevant_dofs,
+                  comm);
+  _ghosted_src.reinit(_weights);
+  _ghosted_dst.reinit(_weights);
+  vector_type reference_diagonal(_weights);
+  vector_type diagonal(_weights);
+  for (unsigned int i = 0; i < diagonal_inverse.local_size(); ++i)
+    diagonal.local_element(i) = diagonal_inverse.local_element(i);
+  diagonal.update_ghost_values();
+
+  std::vector<dealii::types::global_dof_index> dof_indices(dofs_per_cell);
+  std::vector<std::array<double, dim>> cell_h;
+  std::vector<std::array<double, dim>> cell_inverse_h2;
+  for (auto const &cell : dof_handler.active_cell_iterators())
+  {
+    if (!cell->is_locally_owned())
+      continue;
+
+    std::array<double, dim> h;
+    std::array<double, dim> inverse_h2;
+    for (unsigned int d = 0; d < dim; ++d)
+    {
+      h[d] = cell->vertex(1 << d).distance(cell->vertex(0));
+      inverse_h2[d] = 1. / (h[d] * h[d]);
+    }
+    cell_h.push_back(h);
+    cell_inverse_h2.push_back(inverse_h2);
+
+    cell->get_dof_indices(dof_indices);
+    for (unsigned int i = 0; i < dofs_per_cell; ++i)
+    {
+      auto const dof = dof_indices[lexicographic_to_hierarchic[i]];
+      if (constraints.is_constrained(dof))
+      {
+        _cell_dof_indices.push_back(dealii::numbers::invalid_dof_index);
+        continue;
+      }
+      _cell_dof_indices.push_back(dof);
+      _weights(dof) += 1.;
+      reference_diagonal(dof) += reference_cell_diagonal(i, h);
+    }
+  }
+  _weights.compress(dealii::VectorOperation::add);
+  reference_diagonal.compress(dealii::VectorOperation::add);
+  for (unsigned int i = 0; i < _weights.local_size(); ++i)
+    if (_weights.local_element(i) > 0.)
+      _weights.local_element(i) = 1. / std::sqrt(_weights.local_element(i));
+  _weights.update_ghost_values();
+  reference_diagonal.update_ghost_values();
+
+  // The coefficient of a cell is the average ratio between the diagonal of
+  // the operator and the diagonal with a unit coefficient.
+  _n_cells = cell_h.size();
+  std::vector<double> cell_scaling(_n_cells);
+  for (unsigned int c = 0; c < _n_cells; ++c)
+  {
+    double coefficient = 0.;
+    unsigned int n_free_dofs = 0;
+    for (unsigned int i = 0; i < dofs_per_cell; ++i)
+    {
+      auto const dof = _cell_dof_indices[c * dofs_per_cell + i];
+      if (dof == dealii::numbers::invalid_dof_index)
+        continue;
+      coefficient += 1. / (diagonal(dof) * reference_diagonal(dof));
+      ++n_free_dofs;
+    }
+    coefficient = n_free_dofs > 0 ? coefficient / n_free_dofs : 1.;
+
+    double volume = 1.;
+    for (unsigned int d = 0; d < dim; ++d)
+      volume *= cell_h[c][d];
+    cell_scaling[c] = 1. / (coefficient * volume);
+  }
+
+  // Group the cells in batches of the SIMD width. The lanes past the last cell
+  // have a zero scaling so that they do not contribute.
+  unsigned int constexpr n_lanes = VectorizedArray::n_array_elements;
+  unsigned int const n_batches = (_n_cells + n_lanes - 1) / n_lanes;
+  _inverse_h2.resize(n_batches);
+  _scaling.resize(n_batches);
+  for (unsigned int b = 0; b < n_batches; ++b)
+    for (unsigned int lane = 0; lane < n_lanes; ++lane)
+    {
+      unsigned int const c = b * n_lanes + lane;
+      for (unsigned int d = 0; d < dim; ++d)
+        _inverse_h2[b][d][lane] = c < _n_cells ? cell_inverse_h2[c][d] : 1.;
+      _scaling[b][lane] = c < _n_cells ? cell_scaling[c] : 0.;
+    }
+
+  for (auto const dof : dof_handler.locally_owned_dofs())
+    if (constraints.is_constrained(dof))
+      _constrained_dofs.push_back(dof);
+}
+
+template <int dim, typename VectorType>
+void CellSchwarzPreconditioner<dim, VectorType>::vmult(
+    vector_type &dst, vector_type const &src) const
+{
+  for (unsigned int i = 0; i < src.local_size(); ++i)
+    _ghosted_src.local_element(i) = src.local_element(i);
+  _ghosted_src.update_ghost_values();
+  _ghosted_dst = 0.;
+
+  unsigned int dofs_per_cell = 1;
+  for (unsigned int d = 0; d < dim; ++d)
+    dofs_per_cell *= _n_1d;
+  unsigned int constexpr n_lanes = VectorizedArray::n_array_elements;
+  dealii::AlignedVector<VectorizedArray> local(dofs_per_cell);
+  dealii::AlignedVector<VectorizedArray> tmp(dofs_per_cell);
+  unsigned int const n_batches = _scaling.size();
+  for (unsigned int b = 0; b < n_batches; ++b)
+  {
+    unsigned int const n_filled_lanes =
+        std::min(n_lanes, _n_cells - b * n_lanes);
+    auto const *const dof_indices =
+        &_cell_dof_indices[b * n_lanes * dofs_per_cell];
+    for (unsigned int i = 0; i < dofs_per_cell; ++i)
+    {
+      local[i] = 0.;
+      for (unsigned int lane = 0; lane < n_filled_lanes; ++lane)
+      {
+        auto const dof = dof_indices[lane * dofs_per_cell + i];
+        if (dof != dealii::numbers::invalid_dof_index)
+          local[i][lane] = _weights(dof) * _ghosted_src(dof);
+      }
+    }
+
+    // Go to the eigenbasis, divide by the eigenvalues, and come back.
+    for (unsigned int d = 0; d < dim; ++d)
+    {
+      apply_1d(_eigenvectors, true, d, local, tmp);
+      local.swap(tmp);
+    }
+    auto const &inverse_h2 = _inverse_h2[b];
+    VectorizedArray regularization = _eigenvalues[1] * inverse_h2[0];
+    for (unsigned int d = 1; d < dim; ++d)
+      regularization =
+          std::min(regularization, _eigenvalues[1] * inverse_h2[d]);
+    local[0] *= _scaling[b] / regularization;
+    for (unsigned int i = 1; i < dofs_per_cell; ++i)
+    {
+      VectorizedArray eigenvalue = dealii::make_vectorized_array(0.);
+      unsigned int index = i;
+      for (unsigned int d = 0; d < dim; ++d)
+      {
+        eigenvalue += _eigenvalues[index % _n_1d] * inverse_h2[d];
+        index /= _n_1d;
+      }
+      local[i] *= _scaling[b] / eigenvalue;
+    }
+    for (unsigned int d = 0; d < dim; ++d)
+    {
+      apply_1d(_eigenvectors, false, d, local, tmp);
+      local.swap(tmp);
+    }
+
+    for (unsigned int lane = 0; lane < n_filled_lanes; ++lane)
+      for (unsigned int i = 0; i < dofs_per_cell; ++i)
+      {
+        auto const dof = dof_indices[lane * dofs_per_cell + i];
+        if (dof != dealii::numbers::invalid_dof_index)
+          _ghosted_dst(dof) += _weights(dof) * local[i][lane];
+      }
+  }
+  _ghosted_dst.compress(dealii::VectorOperation::add);
+
+  for (unsigned int i = 0; i < dst.local_size(); ++i)
+    dst.local_element(i) = _ghosted_dst.local_element(i);
+  for (auto const dof : _constrained_dofs)
+    dst(dof) = src(dof);
+}
+
+template <int dim, typename VectorType>
+void CellSchwarzPreconditioner<dim, VectorType>::apply_1d(
+    dealii::FullMatrix<double> const &matrix, bool const transpose,
+    unsigned int const direction,
+    dealii::AlignedVector<VectorizedArray> const &src,
+    dealii::AlignedVector<VectorizedArray> &dst) const
+{
+  unsigned int stride = 1;
+  for (unsigned int d = 0; d < direction; ++d)
+    stride *= _n_1d;
+  unsigned int const n_dofs = src.size();
+  for (unsigned int offset = 0; offset < n_dofs; offset += stride * _n_1d)
+    for (unsigned int s = 0; s < stride; ++s)
+      for (unsigned int i = 0; i < _n_1d; ++i)
+      {
+        VectorizedArray sum = dealii::make_vectorized_array(0.);
+        for (unsigned int j = 0; j < _n_1d; ++j)
+          sum += (transpose ? matrix(j, i) : matrix(i, j)) *
+                 src[offset + s + j * stride];
+        dst[offset + s + i * stride] = sum;
+      }
+}
+} // namespace mfmg
+
+// Explicit Instantiation
+INSTANTIATE_DIM_VECTORTYPE(TUPLE(CellSchwarzPreconditioner))
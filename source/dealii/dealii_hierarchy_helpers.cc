@@ -117,8 +117,14 @@ DealIIHierarchyHelpers<dim, VectorType>::build_restrictor(
     for (auto const &agglomerates_vector :
          {interior_agglomerates, halo_agglomerates})
     {
+      // The buffers are reused from one agglomerate to the next by the thread
+      // that owns the scratch data.
       struct ScratchData
       {
+        dealii::Vector<ScalarType> delta_eig;
+        dealii::Vector<ScalarType> correction;
+        dealii::SparsityPattern agglomerate_sparsity_pattern;
+        dealii::SparseMatrix<ScalarType> agglomerate_system_matrix;
       } scratch_data;
       struct CopyData
       {
@@ -130,7 +136,7 @@ DealIIHierarchyHelpers<dim, VectorType>::build_restrictor(
       auto worker =
           [&](const std::vector<std::vector<unsigned int>>::const_iterator
                   &agglomerate_it,
-              ScratchData &, CopyData &local_copy_data) {
+              ScratchData &local_scratch_data, CopyData &local_copy_data) {
             dealii::Triangulation<dim> agglomerate_triangulation;
             std::map<typename dealii::Triangulation<dim>::active_cell_iterator,
                      typename dealii::DoFHandler<dim>::active_cell_iterator>
@@ -148,8 +154,10 @@ DealIIHierarchyHelpers<dim, VectorType>::build_restrictor(
             dealii::DoFHandler<dim> agglomerate_dof_handler(
                 agglomerate_triangulation);
             dealii::AffineConstraints<double> agglomerate_constraints;
-            dealii::SparsityPattern agglomerate_sparsity_pattern;
-            dealii::SparseMatrix<ScalarType> agglomerate_system_matrix;
+            auto &agglomerate_sparsity_pattern =
+                local_scratch_data.agglomerate_sparsity_pattern;
+            auto &agglomerate_system_matrix =
+                local_scratch_data.agglomerate_system_matrix;
             // Call user function to build the system matrix
             dealii_mesh_evaluator->evaluate_agglomerate(
                 agglomerate_dof_handler, agglomerate_constraints,
@@ -168,9 +176,8 @@ DealIIHierarchyHelpers<dim, VectorType>::build_restrictor(
             // Otherwise, we would accumulate values across patches
             // corresponding to different degrees of freedom.
             local_copy_data.values_per_row.resize(n_local_eigenvectors);
-            std::fill(local_copy_data.values_per_row.begin(),
-                      local_copy_data.values_per_row.end(),
-                      std::vector<dealii::TrilinosScalar>(n_elem));
+            for (auto &values : local_copy_data.values_per_row)
+              values.assign(n_elem, 0.);
 
             unsigned int const i = agglomerate_it - agglomerates_vector.begin();
 
@@ -181,7 +188,8 @@ DealIIHierarchyHelpers<dim, VectorType>::build_restrictor(
                   eigenvector_matrix->locally_owned_range_indices()
                       .nth_index_in_set(local_row);
               // Get the vector used for the matrix-vector multiplication
-              dealii::Vector<ScalarType> delta_eig(n_elem);
+              auto &delta_eig = local_scratch_data.delta_eig;
+              delta_eig.reinit(n_elem, true);
               if (is_halo_agglomerate)
               {
                 for (unsigned int k = 0; k < n_elem; ++k)
@@ -202,7 +210,8 @@ DealIIHierarchyHelpers<dim, VectorType>::build_restrictor(
               }
 
               // Perform the matrix-vector multiplication
-              dealii::Vector<ScalarType> correction(n_elem);
+              auto &correction = local_scratch_data.correction;
+              correction.reinit(n_elem, true);
               agglomerate_system_matrix.vmult(correction, delta_eig);
 
               // Store the values the delta correction matrix is to be filled
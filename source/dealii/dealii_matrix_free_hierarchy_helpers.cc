@@ -24,7 +24,10 @@
 
 #include <deal.II/base/work_stream.h>
 #include <deal.II/dofs/dof_accessor.h>
+#include <deal.II/fe/fe_tools.h>
+#include <deal.II/lac/full_matrix.h>
 #include <deal.II/lac/trilinos_precondition.h>
+#include <deal.II/lac/trilinos_sparsity_pattern.h>
 
 #include <EpetraExt_MatrixMatrix.h>
 
@@ -77,6 +80,12 @@ DealIIMatrixFreeHierarchyHelpers<dim, VectorType>::build_restrictor(
   bool fast_ap = params->get("fast_ap", false);
   if (fast_ap)
   {
+    // The fast diagonalization returns the eigenpairs of the generalized
+    // eigenproblem which cannot be used to compute A P.
+    ASSERT_THROW(eigensolver_params.get<std::string>("type", "lanczos") !=
+                     "fast_diagonalization",
+                 "fast_ap is not compatible with the fast_diagonalization "
+                 "eigensolver");
     AMGe_host<dim, DealIIMatrixFreeMeshEvaluator<dim>, VectorType> amge(
         comm, dealii_mesh_evaluator->get_dof_handler(), eigensolver_params);
     std::vector<double> eigenvalues;
@@ -119,8 +128,14 @@ DealIIMatrixFreeHierarchyHelpers<dim, VectorType>::build_restrictor(
     for (auto const &agglomerates_vector :
          {interior_agglomerates, halo_agglomerates})
     {
+      using AgglomerateOperator =
+          MatrixFreeAgglomerateOperator<DealIIMatrixFreeMeshEvaluator<dim>>;
+      // The buffers are reused from one agglomerate to the next by the thread
+      // that owns the scratch data.
       struct ScratchData
       {
+        typename AgglomerateOperator::vector_type delta_eig;
+        typename AgglomerateOperator::vector_type correction;
       } scratch_data;
       struct CopyData
       {
@@ -131,7 +146,8 @@ DealIIMatrixFreeHierarchyHelpers<dim, VectorType>::build_restrictor(
 
       auto worker = [&](const std::vector<std::vector<unsigned int>>::
                             const_iterator &agglomerate_it,
-                        ScratchData &, CopyData &local_copy_data) {
+                        ScratchData &local_scratch_data,
+                        CopyData &local_copy_data) {
         dealii::Triangulation<dim> agglomerate_triangulation;
         std::map<typename dealii::Triangulation<dim>::active_cell_iterator,
                  typename dealii::DoFHandler<dim>::active_cell_iterator>
@@ -163,9 +179,19 @@ DealIIMatrixFreeHierarchyHelpers<dim, VectorType>::build_restrictor(
         // Otherwise, we would accumulate values across patches
         // corresponding to different degrees of freedom.
         local_copy_data.values_per_row.resize(n_local_eigenvectors);
-        std::fill(local_copy_data.values_per_row.begin(),
-                  local_copy_data.values_per_row.end(),
-                  std::vector<dealii::TrilinosScalar>(n_elem));
+        for (auto &values : local_copy_data.values_per_row)
+          values.assign(n_elem, 0.);
+
+        // The operator on the agglomerate does not depend on the eigenvector
+        // so we only build it once.
+        dealii::AffineConstraints<double> agglomerate_constraints;
+        AgglomerateOperator agglomerate_operator(
+            *dealii_mesh_evaluator, agglomerate_dof_handler,
+            agglomerate_constraints, patch_to_global_map);
+        auto &delta_eig = local_scratch_data.delta_eig;
+        auto &correction = local_scratch_data.correction;
+        delta_eig.reinit(n_elem, true);
+        correction.reinit(n_elem, true);
 
         unsigned int const i = agglomerate_it - agglomerates_vector.begin();
 
@@ -176,7 +202,6 @@ DealIIMatrixFreeHierarchyHelpers<dim, VectorType>::build_restrictor(
               eigenvector_matrix->locally_owned_range_indices()
                   .nth_index_in_set(local_row);
           // Get the vector used for the matrix-vector multiplication
-          dealii::Vector<ScalarType> delta_eig(n_elem);
           if (is_halo_agglomerate)
           {
             for (unsigned int k = 0; k < n_elem; ++k)
@@ -196,13 +221,6 @@ DealIIMatrixFreeHierarchyHelpers<dim, VectorType>::build_restrictor(
           }
 
           // Perform the matrix-vector multiplication
-          dealii::Vector<ScalarType> correction(n_elem);
-          dealii::AffineConstraints<double> agglomerate_constraints;
-          using AgglomerateOperator =
-              MatrixFreeAgglomerateOperator<DealIIMatrixFreeMeshEvaluator<dim>>;
-          AgglomerateOperator agglomerate_operator(*dealii_mesh_evaluator,
-                                                   agglomerate_dof_handler,
-                                                   agglomerate_constraints);
           agglomerate_operator.vmult(correction, delta_eig);
 
           // Store the values the delta correction matrix is to be filled
@@ -328,6 +346,244 @@ DealIIMatrixFreeHierarchyHelpers<dim, VectorType>::fast_multiply_transpose()
   return _ap_operator;
 }
 
+template <int dim, typename VectorType>
+std::shared_ptr<MeshEvaluator>
+DealIIMatrixFreeHierarchyHelpers<dim, VectorType>::
+    build_coarser_degree_evaluator(
+        std::shared_ptr<MeshEvaluator> mesh_evaluator)
+{
+  auto dealii_mesh_evaluator =
+      std::dynamic_pointer_cast<DealIIMatrixFreeMeshEvaluator<dim>>(
+          mesh_evaluator);
+  ASSERT(dealii_mesh_evaluator != nullptr, "downcasting failed");
+
+  if (dealii_mesh_evaluator->get_dof_handler().get_fe().degree <= 1)
+    return nullptr;
+
+  auto coarser_evaluator =
+      dealii_mesh_evaluator->build_coarser_degree_evaluator();
+  ASSERT(coarser_evaluator->get_dof_handler().get_fe().degree <
+             dealii_mesh_evaluator->get_dof_handler().get_fe().degree,
+         "The coarser evaluator does not have a lower polynomial degree");
+
+  return coarser_evaluator;
+}
+
+template <int dim, typename VectorType>
+std::shared_ptr<Operator<VectorType>>
+DealIIMatrixFreeHierarchyHelpers<dim, VectorType>::build_degree_restrictor(
+    MPI_Comm comm, std::shared_ptr<MeshEvaluator> fine_evaluator,
+    std::shared_ptr<MeshEvaluator> coarse_evaluator)
+{
+  auto fine_mesh_evaluator =
+      std::dynamic_pointer_cast<DealIIMatrixFreeMeshEvaluator<dim>>(
+          fine_evaluator);
+  auto coarse_mesh_evaluator =
+      std::dynamic_pointer_cast<DealIIMatrixFreeMeshEvaluator<dim>>(
+          coarse_evaluator);
+  ASSERT(fine_mesh_evaluator != nullptr, "downcasting failed");
+  ASSERT(coarse_mesh_evaluator != nullptr, "downcasting failed");
+
+  auto const &fine_dof_handler = fine_mesh_evaluator->get_dof_handler();
+  auto const &coarse_dof_handler = coarse_mesh_evaluator->get_dof_handler();
+  auto const &fine_constraints = fine_mesh_evaluator->get_constraints();
+  auto const &coarse_constraints = coarse_mesh_evaluator->get_constraints();
+  ASSERT(&fine_dof_handler.get_triangulation() ==
+             &coarse_dof_handler.get_triangulation(),
+         "The polynomial levels must share the same triangulation");
+
+  // The prolongation interpolates the coarse finite element function on the
+  // fine finite element space. This is done cell-wise and, because the finite
+  // element spaces are conforming, the contributions of different cells to a
+  // given entry are identical. We directly build the restriction, i.e., the
+  // transpose of the prolongation. As for the matrix-free operators,
+  // constrained dofs are kept out of the transfer.
+  auto const &fine_fe = fine_dof_handler.get_fe();
+  auto const &coarse_fe = coarse_dof_handler.get_fe();
+  dealii::FullMatrix<double> interpolation_matrix(fine_fe.dofs_per_cell,
+                                                  coarse_fe.dofs_per_cell);
+  dealii::FETools::get_interpolation_matrix(coarse_fe, fine_fe,
+                                            interpolation_matrix);
+
+  dealii::IndexSet const &coarse_owned_dofs =
+      coarse_dof_handler.locally_owned_dofs();
+  std::vector<dealii::types::global_dof_index> fine_dof_indices(
+      fine_fe.dofs_per_cell);
+  std::vector<dealii::types::global_dof_index> coarse_dof_indices(
+      coarse_fe.dofs_per_cell);
+  // Ghost cells are needed to get all the fine dofs coupled to the locally
+  // owned coarse dofs.
+  auto for_each_entry = [&](auto const &function) {
+    auto coarse_cell = coarse_dof_handler.begin_active();
+    for (auto fine_cell = fine_dof_handler.begin_active();
+         fine_cell != fine_dof_handler.end(); ++fine_cell, ++coarse_cell)
+    {
+      if (fine_cell->is_artificial())
+        continue;
+
+      fine_cell->get_dof_indices(fine_dof_indices);
+      coarse_cell->get_dof_indices(coarse_dof_indices);
+      for (unsigned int j = 0; j < coarse_fe.dofs_per_cell; ++j)
+      {
+        if (!coarse_owned_dofs.is_element(coarse_dof_indices[j]) ||
+            coarse_constraints.is_constrained(coarse_dof_indices[j]))
+          continue;
+        for (unsigned int i = 0; i < fine_fe.dofs_per_cell; ++i)
+          if (!fine_constraints.is_constrained(fine_dof_indices[i]) &&
+              std::abs(interpolation_matrix(i, j)) > 1e-14)
+            function(coarse_dof_indices[j], fine_dof_indices[i],
+                     interpolation_matrix(i, j));
+      }
+    }
+  };
+
+  dealii::TrilinosWrappers::SparsityPattern sparsity_pattern(
+      coarse_owned_dofs, fine_dof_handler.locally_owned_dofs(), comm);
+  for_each_entry([&](dealii::types::global_dof_index const row,
+                     dealii::types::global_dof_index const col,
+                     double const) { sparsity_pattern.add(row, col); });
+  sparsity_pattern.compress();
+
+  auto restrictor_matrix =
+      std::make_shared<dealii::TrilinosWrappers::SparseMatrix>();
+  restrictor_matrix->reinit(sparsity_pattern);
+  for_each_entry([&](dealii::types::global_dof_index const row,
+                     dealii::types::global_dof_index const col,
+                     double const value) {
+    restrictor_matrix->set(row, col, value);
+  });
+  restrictor_matrix->compress(dealii::VectorOperation::insert);
+
+  return std::make_shared<DealIITrilinosMatrixOperator<VectorType>>(
+      restrictor_matrix);
+}
+
+template <int dim, typename VectorType>
+std::shared_ptr<MeshEvaluator>
+DealIIMatrixFreeHierarchyHelpers<dim, VectorType>::build_coarser_mesh_evaluator(
+    std::shared_ptr<MeshEvaluator> mesh_evaluator)
+{
+  auto dealii_mesh_evaluator =
+      std::dynamic_pointer_cast<DealIIMatrixFreeMeshEvaluator<dim>>(
+          mesh_evaluator);
+  ASSERT(dealii_mesh_evaluator != nullptr, "downcasting failed");
+
+  auto const &triangulation =
+      dealii_mesh_evaluator->get_dof_handler().get_triangulation();
+  ASSERT_THROW(triangulation.n_global_levels() > 1,
+               "The mesh cannot be coarsened any further");
+
+  auto coarser_evaluator =
+      dealii_mesh_evaluator->build_coarser_mesh_evaluator();
+  ASSERT(coarser_evaluator->get_dof_handler()
+                 .get_triangulation()
+                 .n_global_levels() == triangulation.n_global_levels() - 1,
+         "The coarser evaluator is not on the triangulation coarsened once");
+
+  return coarser_evaluator;
+}
+
+template <int dim, typename VectorType>
+std::shared_ptr<Operator<VectorType>>
+DealIIMatrixFreeHierarchyHelpers<dim, VectorType>::build_mesh_restrictor(
+    MPI_Comm comm, std::shared_ptr<MeshEvaluator> fine_evaluator,
+    std::shared_ptr<MeshEvaluator> coarse_evaluator)
+{
+  auto fine_mesh_evaluator =
+      std::dynamic_pointer_cast<DealIIMatrixFreeMeshEvaluator<dim>>(
+          fine_evaluator);
+  auto coarse_mesh_evaluator =
+      std::dynamic_pointer_cast<DealIIMatrixFreeMeshEvaluator<dim>>(
+          coarse_evaluator);
+  ASSERT(fine_mesh_evaluator != nullptr, "downcasting failed");
+  ASSERT(coarse_mesh_evaluator != nullptr, "downcasting failed");
+
+  auto const &fine_dof_handler = fine_mesh_evaluator->get_dof_handler();
+  auto const &coarse_dof_handler = coarse_mesh_evaluator->get_dof_handler();
+  auto const &fine_constraints = fine_mesh_evaluator->get_constraints();
+  auto const &coarse_constraints = coarse_mesh_evaluator->get_constraints();
+  auto const &fe = fine_dof_handler.get_fe();
+  ASSERT(fe.get_name() == coarse_dof_handler.get_fe().get_name(),
+         "The geometric levels must use the same finite element");
+
+  // The two levels live on different triangulations. The parent of a fine
+  // cell is matched with the coarse cell that has the same CellId and the
+  // prolongation is given cell-wise by the embedding matrices of the finite
+  // element. Unlike for the polynomial levels, we loop over the locally owned
+  // fine cells and build the prolongation: the children of a ghost coarse cell
+  // may be artificial on the fine triangulation while the parent of a locally
+  // owned fine cell is available on the coarse triangulation as long as both
+  // triangulations are partitioned consistently, e.g., for uniformly refined
+  // p4est meshes. Since the finite element spaces are nested, the
+  // contributions of different cells to a given entry are identical.
+  auto const &coarse_triangulation = coarse_dof_handler.get_triangulation();
+  dealii::IndexSet const &fine_owned_dofs =
+      fine_dof_handler.locally_owned_dofs();
+  std::vector<dealii::types::global_dof_index> fine_dof_indices(
+      fe.dofs_per_cell);
+  std::vector<dealii::types::global_dof_index> coarse_dof_indices(
+      fe.dofs_per_cell);
+  auto for_each_entry = [&](auto const &function) {
+    for (auto const &fine_cell : fine_dof_handler.active_cell_iterators())
+    {
+      if (!fine_cell->is_locally_owned())
+        continue;
+
+      ASSERT_THROW(fine_cell->level() > 0,
+                   "The fine cells must have a parent");
+      auto const parent = fine_cell->parent();
+      unsigned int child = 0;
+      while (parent->child(child) != fine_cell)
+        ++child;
+
+      auto const coarse_tria_cell = parent->id().to_cell(coarse_triangulation);
+      ASSERT_THROW(coarse_tria_cell->active() &&
+                       !coarse_tria_cell->is_artificial(),
+                   "The triangulations are not partitioned consistently");
+      typename dealii::DoFHandler<dim>::active_cell_iterator coarse_cell(
+          &coarse_triangulation, coarse_tria_cell->level(),
+          coarse_tria_cell->index(), &coarse_dof_handler);
+
+      dealii::FullMatrix<double> const &prolongation_matrix =
+          fe.get_prolongation_matrix(child, parent->refinement_case());
+      fine_cell->get_dof_indices(fine_dof_indices);
+      coarse_cell->get_dof_indices(coarse_dof_indices);
+      for (unsigned int i = 0; i < fe.dofs_per_cell; ++i)
+      {
+        if (!fine_owned_dofs.is_element(fine_dof_indices[i]) ||
+            fine_constraints.is_constrained(fine_dof_indices[i]))
+          continue;
+        for (unsigned int j = 0; j < fe.dofs_per_cell; ++j)
+          if (!coarse_constraints.is_constrained(coarse_dof_indices[j]) &&
+              std::abs(prolongation_matrix(i, j)) > 1e-14)
+            function(fine_dof_indices[i], coarse_dof_indices[j],
+                     prolongation_matrix(i, j));
+      }
+    }
+  };
+
+  dealii::TrilinosWrappers::SparsityPattern sparsity_pattern(
+      fine_owned_dofs, coarse_dof_handler.locally_owned_dofs(), comm);
+  for_each_entry([&](dealii::types::global_dof_index const row,
+                     dealii::types::global_dof_index const col,
+                     double const) { sparsity_pattern.add(row, col); });
+  sparsity_pattern.compress();
+
+  auto prolongator_matrix =
+      std::make_shared<dealii::TrilinosWrappers::SparseMatrix>();
+  prolongator_matrix->reinit(sparsity_pattern);
+  for_each_entry([&](dealii::types::global_dof_index const row,
+                     dealii::types::global_dof_index const col,
+                     double const value) {
+    prolongator_matrix->set(row, col, value);
+  });
+  prolongator_matrix->compress(dealii::VectorOperation::insert);
+
+  return std::make_shared<DealIITrilinosMatrixOperator<VectorType>>(
+             prolongator_matrix)
+      ->transpose();
+}
+
 } // namespace mfmg
 
 // Explicit Instantiation
@@ -148,6 +148,13 @@ DealIIMatrixFreeOperator<dim, VectorType>::get_diagonal_inverse() const
 {
   return _mesh_evaluator->matrix_free_get_diagonal_inverse();
 }
+
+template <int dim, typename VectorType>
+std::shared_ptr<DealIIMatrixFreeMeshEvaluator<dim>>
+DealIIMatrixFreeOperator<dim, VectorType>::get_mesh_evaluator() const
+{
+  return _mesh_evaluator;
+}
 } // namespace mfmg
 
 // Explicit Instantiation
@@ -15,6 +15,32 @@
 
 namespace mfmg
 {
+namespace
+{
+template <typename ChebyshevType>
+typename ChebyshevType::AdditionalData
+chebyshev_data(std::shared_ptr<boost::property_tree::ptree const> params)
+{
+  typename ChebyshevType::AdditionalData data;
+  if (auto degree = params->get_optional<int>("smoother.degree"))
+  {
+    data.degree = *degree;
+  }
+  if (auto smoothing_range =
+          params->get_optional<double>("smoother.smoothing_range"))
+  {
+    data.smoothing_range = *smoothing_range;
+  }
+  if (auto max_eigenvalue =
+          params->get_optional<double>("smoother.max_eigenvalue"))
+  {
+    data.max_eigenvalue = *max_eigenvalue;
+  }
+
+  return data;
+}
+} // namespace
+
 template <int dim, typename VectorType>
 DealIIMatrixFreeSmoother<dim, VectorType>::DealIIMatrixFreeSmoother(
     std::shared_ptr<Operator<vector_type> const> op,
@@ -33,26 +59,31 @@ DealIIMatrixFreeSmoother<dim, VectorType>::DealIIMatrixFreeSmoother(
                  ::tolower);
   if (prec_name == "chebyshev")
   {
-    _smoother.reset(new chebyshev_preconditioner());
-    typename chebyshev_preconditioner::AdditionalData data;
-    if (auto degree = params->get_optional<int>("smoother.degree"))
+    std::string const preconditioner =
+        params->get("smoother.preconditioner", "diagonal");
+    ASSERT_THROW(preconditioner == "diagonal" ||
+                     preconditioner == "cell Schwarz",
+                 "Unknown Chebyshev preconditioner: \"" + preconditioner +
+                     "\"");
+    if (preconditioner == "diagonal")
     {
-      data.degree = *degree;
+      _smoother.reset(new chebyshev_preconditioner());
+      auto data = chebyshev_data<chebyshev_preconditioner>(params);
+      data.preconditioner = matrix_free_operator->get_diagonal_inverse();
+      _smoother->initialize(*matrix_free_operator, data);
     }
-    if (auto smoothing_range =
-            params->get_optional<double>("smoother.smoothing_range"))
+    else
     {
-      data.smoothing_range = *smoothing_range;
+      // The cell problems are solved with the fast diagonalization method.
+      // The point diagonal is only used to estimate the coefficient.
+      auto mesh_evaluator = matrix_free_operator->get_mesh_evaluator();
+      _schwarz_smoother.reset(new chebyshev_schwarz_preconditioner());
+      auto data = chebyshev_data<chebyshev_schwarz_preconditioner>(params);
+      data.preconditioner = std::make_shared<schwarz_preconditioner_type>(
+          mesh_evaluator->get_dof_handler(), mesh_evaluator->get_constraints(),
+          matrix_free_operator->get_diagonal_inverse()->get_vector());
+      _schwarz_smoother->initialize(*matrix_free_operator, data);
     }
-    if (auto max_eigenvalue =
-            params->get_optional<double>("smoother.max_eigenvalue"))
-    {
-      data.max_eigenvalue = *max_eigenvalue;
-    }
-
-    data.preconditioner = matrix_free_operator->get_diagonal_inverse();
-
-    _smoother->initialize(*matrix_free_operator, data);
   }
   else
   {
@@ -71,10 +102,24 @@ void DealIIMatrixFreeSmoother<dim, VectorType>::apply(VectorType const &b,
 
   // x = x + B^{-1} (-r)
   vector_type tmp(x);
-  _smoother->vmult(tmp, r);
+  if (_smoother)
+    _smoother->vmult(tmp, r);
+  else
+    _schwarz_smoother->vmult(tmp, r);
   x.add(-1., tmp);
 }
 
+template <int dim, typename VectorType>
+void DealIIMatrixFreeSmoother<dim, VectorType>::apply_zero_initial_guess(
+    VectorType const &b, VectorType &x) const
+{
+  // x = B^{-1} b
+  if (_smoother)
+    _smoother->vmult(x, b);
+  else
+    _schwarz_smoother->vmult(x, b);
+}
+
 } // namespace mfmg
 
 // Explicit Instantiation
@@ -12,7 +12,9 @@
 #include <mfmg/common/instantiation.hpp>
 #include <mfmg/dealii/dealii_mesh_evaluator.hpp>
 
+#include <deal.II/dofs/dof_accessor.h>
 #include <deal.II/dofs/dof_tools.h>
+#include <deal.II/fe/mapping_q_generic.h>
 
 #include <algorithm>
 #include <random>
@@ -85,6 +87,62 @@ DealIIMeshEvaluator<dim>::get_diagonal()
   return locally_relevant_global_diag;
 }
 
+template <int dim>
+std::vector<dealii::Vector<double>>
+DealIIMeshEvaluator<dim>::compute_rigid_body_modes(
+    dealii::DoFHandler<dim> const &dof_handler,
+    dealii::AffineConstraints<double> const &constraints)
+{
+  auto const &fe = dof_handler.get_fe();
+  unsigned int const n_components = fe.n_components();
+  ASSERT_THROW(n_components == 1 || n_components == dim,
+               "Rigid body modes require a finite element with one or dim "
+               "components");
+  ASSERT_THROW(fe.has_support_points(),
+               "Rigid body modes require a finite element with support points");
+
+  // Component of each dof
+  unsigned int const n_dofs = dof_handler.n_dofs();
+  std::vector<unsigned int> dof_components(n_dofs);
+  std::vector<dealii::types::global_dof_index> dof_indices(fe.dofs_per_cell);
+  for (auto cell : dof_handler.active_cell_iterators())
+  {
+    cell->get_dof_indices(dof_indices);
+    for (unsigned int i = 0; i < fe.dofs_per_cell; ++i)
+      dof_components[dof_indices[i]] = fe.system_to_component_index(i).first;
+  }
+
+  std::vector<dealii::Point<dim>> support_points(n_dofs);
+  dealii::DoFTools::map_dofs_to_support_points(
+      dealii::MappingQGeneric<dim>(1), dof_handler, support_points);
+
+  // The translations first, then the rotations in the plane of each pair of
+  // components.
+  unsigned int const n_rotations =
+      (n_components == 1) ? 0 : n_components * (n_components - 1) / 2;
+  std::vector<dealii::Vector<double>> modes(
+      n_components + n_rotations, dealii::Vector<double>(n_dofs));
+  for (unsigned int i = 0; i < n_dofs; ++i)
+  {
+    if (constraints.is_constrained(i))
+      continue;
+
+    unsigned int const component = dof_components[i];
+    modes[component][i] = 1.;
+    unsigned int mode = n_components;
+    for (unsigned int a = 0; a < n_components; ++a)
+      for (unsigned int b = a + 1; b < n_components; ++b, ++mode)
+      {
+        if (component == a)
+          modes[mode][i] = -support_points[i][b];
+        else if (component == b)
+          modes[mode][i] = support_points[i][a];
+      }
+  }
+
+  return modes;
+}
+
 template <int dim>
 dealii::DoFHandler<dim> &DealIIMeshEvaluator<dim>::get_dof_handler()
 {
@@ -96,6 +154,13 @@ dealii::AffineConstraints<double> &DealIIMeshEvaluator<dim>::get_constraints()
 {
   return _constraints;
 }
+
+template <int dim>
+dealii::AffineConstraints<double> const &
+DealIIMeshEvaluator<dim>::get_constraints() const
+{
+  return _constraints;
+}
 } // namespace mfmg
 
 // Explicit Instantiation
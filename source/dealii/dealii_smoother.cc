@@ -80,6 +80,14 @@ void DealIISmoother<VectorType>::apply(VectorType const &b, VectorType &x) const
   x.add(-1., tmp);
 }
 
+template <typename VectorType>
+void DealIISmoother<VectorType>::apply_zero_initial_guess(VectorType const &b,
+                                                          VectorType &x) const
+{
+  // x = B^{-1} b
+  _smoother->vmult(x, b);
+}
+
 } // namespace mfmg
 
 // Explicit Instantiation
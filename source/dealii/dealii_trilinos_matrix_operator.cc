@@ -13,11 +13,215 @@
 #include <mfmg/common/instantiation.hpp>
 #include <mfmg/dealii/dealii_trilinos_matrix_operator.hpp>
 
+#include <deal.II/base/parallel.h>
+#include <deal.II/base/thread_management.h>
+#include <deal.II/lac/la_parallel_vector.h>
+
 #include <EpetraExt_MatrixMatrix.h>
 #include <EpetraExt_Transpose_RowMatrix.h>
+#include <Epetra_Import.h>
+#include <Epetra_Vector.h>
+
+#ifdef DEAL_II_WITH_THREADS
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#endif
+
+#include <cmath>
+#include <mutex>
 
 namespace mfmg
 {
+namespace
+{
+// Number of rows processed by a single task
+unsigned int constexpr row_block_size = 512;
+
+/**
+ * Split the local rows of \p matrix between the rows that only use locally
+ * owned columns and the rows that use ghost columns.
+ */
+void partition_rows(Epetra_CrsMatrix const &matrix,
+                    std::vector<int> &interior_rows,
+                    std::vector<int> &boundary_rows)
+{
+  int const n_rows = matrix.NumMyRows();
+  // When FillComplete() builds the column map, the locally owned columns come
+  // first and in the same order as in the domain map. Then the interior rows
+  // can read the locally owned values directly. If the column map does not
+  // have this layout, every row goes through the ghosted vector.
+  int const n_owned_columns = matrix.DomainMap().NumMyElements();
+  bool local_columns_first =
+      (matrix.ColMap().NumMyElements() >= n_owned_columns);
+  for (int j = 0; (j < n_owned_columns) && local_columns_first; ++j)
+    local_columns_first =
+        (matrix.ColMap().GID(j) == matrix.DomainMap().GID(j));
+
+  for (int i = 0; i < n_rows; ++i)
+  {
+    bool is_interior = local_columns_first;
+    if (is_interior)
+    {
+      int n_entries = 0;
+      double *values = nullptr;
+      int *indices = nullptr;
+      matrix.ExtractMyRowView(i, n_entries, values, indices);
+      for (int k = 0; k < n_entries; ++k)
+        if (indices[k] >= n_owned_columns)
+        {
+          is_interior = false;
+          break;
+        }
+    }
+    (is_interior ? interior_rows : boundary_rows).push_back(i);
+  }
+}
+
+/**
+ * Call \p block_function with the bounds of blocks of \p rows. The blocks are
+ * processed by different tasks. \p partitioner records which thread
+ * processed which block. Since the partitioner of a set of rows is reused by
+ * every loop over these rows, a block is processed by the same thread each
+ * time, and thus the data of the block stay in the caches and on the NUMA
+ * node of that thread.
+ */
+template <typename Partitioner, typename BlockFunction>
+void for_each_block(std::vector<int> const &rows, Partitioner &partitioner,
+                    BlockFunction const &block_function)
+{
+#ifdef DEAL_II_WITH_THREADS
+  tbb::parallel_for(
+      tbb::blocked_range<std::size_t>(0, rows.size(), row_block_size),
+      [&](tbb::blocked_range<std::size_t> const &range) {
+        block_function(rows.data() + range.begin(),
+                       rows.data() + range.end());
+      },
+      partitioner);
+#else
+  (void)partitioner;
+  block_function(rows.data(), rows.data() + rows.size());
+#endif
+}
+
+/**
+ * Apply \p block_kernel to blocks of rows of \p matrix. \p x is distributed
+ * like the domain of \p matrix. The kernel is called with a range of local row
+ * indices and the values of \p x on the column map of \p matrix. The blocks
+ * of rows are processed by different tasks. The blocks of rows that only use
+ * locally owned columns are processed while the ghost values are received.
+ */
+template <typename RowPartition, typename BlockKernel>
+void for_each_row_block(Epetra_CrsMatrix const &matrix,
+                        RowPartition const &partition, double const *x,
+                        BlockKernel const &block_kernel)
+{
+  auto process = [&](unsigned int const k, double const *x_values) {
+    for_each_block(
+        k == 0 ? partition.interior_rows : partition.boundary_rows,
+        partition.partitioners[k],
+        [&](int const *rows_begin, int const *rows_end) {
+          block_kernel(rows_begin, rows_end, x_values);
+        });
+  };
+
+  std::unique_ptr<Epetra_Vector> x_ghosted;
+  dealii::Threads::Task<void> import_task;
+  if (matrix.Importer() != nullptr)
+  {
+    x_ghosted.reset(new Epetra_Vector(matrix.ColMap(), false));
+    auto import_ghosts = [&]() {
+#ifdef MFMG_WITH_MPI_SHARED_MEMORY
+      partition.ghost_import->import(x, x_ghosted->Values());
+#else
+      Epetra_Vector x_view(View, matrix.DomainMap(), const_cast<double *>(x));
+      x_ghosted->Import(x_view, *matrix.Importer(), Insert);
+#endif
+    };
+    // The communication can only be done by a task if MPI allows another
+    // thread than the main one to communicate.
+    int thread_support = MPI_THREAD_SINGLE;
+    MPI_Query_thread(&thread_support);
+    if (thread_support >= MPI_THREAD_SERIALIZED)
+      import_task = dealii::Threads::new_task(import_ghosts);
+    else
+      import_ghosts();
+  }
+
+  process(0, x);
+  if (import_task.joinable())
+    import_task.join();
+  process(1, x_ghosted ? x_ghosted->Values() : x);
+}
+
+/**
+ * Zero the entries of \p values associated with the local rows of \p
+ * partition by the same blocks of rows as for_each_row_block() so that the
+ * pages of a new vector are first touched by the tasks that use them.
+ */
+template <typename RowPartition>
+void zero_row_blocks(RowPartition const &partition, double *values)
+{
+  auto zero_rows = [&](int const *rows_begin, int const *rows_end) {
+    for (auto row = rows_begin; row != rows_end; ++row)
+      values[*row] = 0.;
+  };
+  for_each_block(partition.interior_rows, partition.partitioners[0],
+                 zero_rows);
+  for_each_block(partition.boundary_rows, partition.partitioners[1],
+                 zero_rows);
+}
+} // namespace
+
+/**
+ * Pool of accumulators of a given size. A task borrows an accumulator for the
+ * duration of a block of rows so that it can add its contributions without
+ * synchronization. Since an accumulator is returned to the pool when the
+ * block is done, at most one accumulator per thread is allocated.
+ */
+template <typename VectorType>
+class DealIITrilinosMatrixOperator<VectorType>::AccumulatorPool
+{
+public:
+  AccumulatorPool(unsigned int const size) : _size(size) {}
+
+  std::unique_ptr<std::vector<double>> acquire()
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_accumulators.empty())
+      return std::unique_ptr<std::vector<double>>(
+          new std::vector<double>(_size, 0.));
+    auto accumulator = std::move(_accumulators.back());
+    _accumulators.pop_back();
+    return accumulator;
+  }
+
+  void release(std::unique_ptr<std::vector<double>> accumulator)
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _accumulators.push_back(std::move(accumulator));
+  }
+
+  /**
+   * Add the sum of the accumulators to \p y and zero the accumulators so that
+   * they can be reused. This function must be called once every accumulator
+   * was released.
+   */
+  void reduce(double *y)
+  {
+    for (auto const &accumulator : _accumulators)
+      for (unsigned int i = 0; i < _size; ++i)
+      {
+        y[i] += (*accumulator)[i];
+        (*accumulator)[i] = 0.;
+      }
+  }
+
+private:
+  unsigned int const _size;
+  std::mutex _mutex;
+  std::vector<std::unique_ptr<std::vector<double>>> _accumulators;
+};
+
 template <typename VectorType>
 DealIITrilinosMatrixOperator<VectorType>::DealIITrilinosMatrixOperator(
     std::shared_ptr<dealii::TrilinosWrappers::SparseMatrix> sparse_matrix)
@@ -25,6 +229,10 @@ DealIITrilinosMatrixOperator<VectorType>::DealIITrilinosMatrixOperator(
 {
 }
 
+template <typename VectorType>
+DealIITrilinosMatrixOperator<VectorType>::~DealIITrilinosMatrixOperator() =
+    default;
+
 template <typename VectorType>
 void DealIITrilinosMatrixOperator<VectorType>::apply(VectorType const &x,
                                                      VectorType &y,
@@ -35,21 +243,146 @@ void DealIITrilinosMatrixOperator<VectorType>::apply(VectorType const &x,
 }
 
 template <typename VectorType>
-std::shared_ptr<Operator<VectorType>>
-DealIITrilinosMatrixOperator<VectorType>::transpose() const
+void DealIITrilinosMatrixOperator<VectorType>::restrict_residual(
+    Operator<VectorType> const &a, VectorType const &x, VectorType const &b,
+    VectorType &y, VectorType &residual) const
+{
+  // We use R (A x - b) = P^T (A x - b) with P = R^T. The rows of P are the
+  // locally owned fine rows, so each entry of the residual can be scattered to
+  // the coarse vector as soon as it is computed. The contributions to coarse
+  // entries owned by other processors are accumulated in a vector built on
+  // the column map of P and they are sent at the end.
+  auto const &prolongator = get_transposed_matrix()->trilinos_matrix();
+  int const n_local_rows = prolongator.NumMyRows();
+  ASSERT(static_cast<unsigned int>(n_local_rows) == b.local_size(),
+         "The row distribution of the transposed restriction does not match "
+         "the distribution of the right-hand side");
+
+  // Each block of rows scatters its contributions to an accumulator of the
+  // size of the column map of P that is only used by one task at a time. The
+  // accumulators are summed at the end. They are kept by the operator and
+  // zeroed by the summation.
+  auto &buffers = get_restriction_buffers();
+  auto &accumulators = *buffers.accumulators;
+  auto scatter = [&](int const row, double const residual,
+                     std::vector<double> &y_col) {
+    int n_entries = 0;
+    double *values = nullptr;
+    int *indices = nullptr;
+    prolongator.ExtractMyRowView(row, n_entries, values, indices);
+    for (int k = 0; k < n_entries; ++k)
+      y_col[indices[k]] += values[k] * residual;
+  };
+
+  auto trilinos_a =
+      dynamic_cast<DealIITrilinosMatrixOperator<VectorType> const *>(&a);
+  if (trilinos_a != nullptr)
+  {
+    // Fully fused path: the residual is computed one block of rows at a time.
+    auto const &a_matrix = trilinos_a->get_matrix()->trilinos_matrix();
+    ASSERT(a_matrix.NumMyRows() == n_local_rows,
+           "The row distribution of the operator does not match the "
+           "distribution of the transposed restriction");
+    auto restrict_rows = [&](int const *rows_begin, int const *rows_end,
+                             double const *x_values) {
+      auto y_col = accumulators.acquire();
+      for (auto row = rows_begin; row != rows_end; ++row)
+      {
+        int n_entries = 0;
+        double *values = nullptr;
+        int *indices = nullptr;
+        a_matrix.ExtractMyRowView(*row, n_entries, values, indices);
+        double residual = -b.local_element(*row);
+        for (int k = 0; k < n_entries; ++k)
+          residual += values[k] * x_values[indices[k]];
+        scatter(*row, residual, *y_col);
+      }
+      accumulators.release(std::move(y_col));
+    };
+    for_each_row_block(a_matrix, trilinos_a->get_row_partition(false),
+                       x.begin(), restrict_rows);
+  }
+  else
+  {
+    // The operator is only available through its action, so we still need
+    // A x but the subtraction of b is fused with the restriction.
+    a.apply(x, residual);
+    dealii::parallel::apply_to_subranges(
+        0, n_local_rows,
+        [&](int const begin, int const end) {
+          auto y_col = accumulators.acquire();
+          for (int i = begin; i < end; ++i)
+            scatter(i, residual.local_element(i) - b.local_element(i),
+                    *y_col);
+          accumulators.release(std::move(y_col));
+        },
+        row_block_size);
+  }
+
+  auto &y_col = *buffers.y_col;
+  y_col.PutScalar(0.);
+  accumulators.reduce(y_col.Values());
+
+  Epetra_Vector y_view(View, prolongator.DomainMap(), y.begin());
+  if (prolongator.Importer() != nullptr)
+  {
+    y_view.PutScalar(0.);
+    y_view.Export(y_col, *prolongator.Importer(), Add);
+  }
+  else
+  {
+    y_view.Update(1., y_col, 0.);
+  }
+}
+
+template <typename VectorType>
+void DealIITrilinosMatrixOperator<VectorType>::apply_add(
+    VectorType const &x, VectorType &y, double const alpha,
+    OperatorMode mode) const
 {
-  auto epetra_matrix = _sparse_matrix->trilinos_matrix();
+  // The rows of the matrix are the locally owned entries of y, so y can be
+  // updated in place once x is available on the column map.
+  auto const &matrix = (mode == OperatorMode::NO_TRANS)
+                           ? _sparse_matrix->trilinos_matrix()
+                           : get_transposed_matrix()->trilinos_matrix();
+  int const n_local_rows = matrix.NumMyRows();
+  ASSERT(static_cast<unsigned int>(n_local_rows) == y.local_size(),
+         "The row distribution of the matrix does not match the distribution "
+         "of the output vector");
 
-  EpetraExt::RowMatrix_Transpose transposer;
-  auto transposed_epetra_matrix =
-      dynamic_cast<Epetra_CrsMatrix &>(transposer(epetra_matrix));
+  auto apply_rows = [&](int const *rows_begin, int const *rows_end,
+                        double const *x_values) {
+    for (auto row = rows_begin; row != rows_end; ++row)
+    {
+      int n_entries = 0;
+      double *values = nullptr;
+      int *indices = nullptr;
+      matrix.ExtractMyRowView(*row, n_entries, values, indices);
+      double value = 0.;
+      for (int k = 0; k < n_entries; ++k)
+        value += values[k] * x_values[indices[k]];
+      y.local_element(*row) += alpha * value;
+    }
+  };
+  for_each_row_block(matrix, get_row_partition(mode == OperatorMode::TRANS),
+                     x.begin(), apply_rows);
+}
 
-  auto transposed_matrix =
-      std::make_shared<dealii::TrilinosWrappers::SparseMatrix>();
-  transposed_matrix->reinit(transposed_epetra_matrix);
+template <typename VectorType>
+void DealIITrilinosMatrixOperator<VectorType>::setup_transfer(
+    OperatorMode const mode) const
+{
+  get_row_partition(mode == OperatorMode::TRANS);
+  if (mode == OperatorMode::TRANS)
+    get_restriction_buffers();
+}
 
+template <typename VectorType>
+std::shared_ptr<Operator<VectorType>>
+DealIITrilinosMatrixOperator<VectorType>::transpose() const
+{
   return std::make_shared<DealIITrilinosMatrixOperator<VectorType>>(
-      transposed_matrix);
+      get_transposed_matrix());
 }
 
 template <typename VectorType>
@@ -95,10 +428,143 @@ DealIITrilinosMatrixOperator<VectorType>::multiply_transpose(
   return std::make_shared<DealIITrilinosMatrixOperator<VectorType>>(c_mat);
 }
 
+template <typename VectorType>
+std::shared_ptr<Operator<VectorType>>
+DealIITrilinosMatrixOperator<VectorType>::sparsify(
+    double const drop_tolerance, double const safeguard) const
+{
+  auto const &matrix = *_sparse_matrix;
+  dealii::IndexSet const &locally_owned_rows =
+      matrix.locally_owned_range_indices();
+  ASSERT(locally_owned_rows == matrix.locally_owned_domain_indices(),
+         "The locally owned rows and columns of the matrix must be the same");
+  MPI_Comm comm = matrix.get_mpi_communicator();
+
+  // The diagonal entries of the columns are needed to decide which entries
+  // are weak. Whether the rows of the columns can be sparsified is
+  // communicated in the same way.
+  dealii::IndexSet locally_relevant_columns = locally_owned_rows;
+  for (auto const row : locally_owned_rows)
+    for (auto entry = matrix.begin(row); entry != matrix.end(row); ++entry)
+      locally_relevant_columns.add_index(entry->column());
+  dealii::LinearAlgebra::distributed::Vector<double> diagonal(
+      locally_owned_rows, locally_relevant_columns, comm);
+  dealii::LinearAlgebra::distributed::Vector<double> is_sparsifiable(
+      locally_owned_rows, locally_relevant_columns, comm);
+  for (auto const row : locally_owned_rows)
+    diagonal[row] = matrix.diag_element(row);
+  diagonal.update_ghost_values();
+
+  auto is_weak = [&](dealii::types::global_dof_index const row,
+                     dealii::types::global_dof_index const column,
+                     double const value) {
+    return (row != column) &&
+           (std::abs(value) <
+            drop_tolerance * std::sqrt(std::abs(diagonal[row] *
+                                                diagonal[column])));
+  };
+
+  // Safeguard: the difference E between the sparsified matrix and the matrix
+  // is positive semidefinite. With D the diagonal of the matrix, the row i of
+  // D^{-1/2} E D^{-1/2} has the diagonal entry sum_j |a_ij| / |a_ii| and the
+  // off-diagonal entries |a_ij| / sqrt(|a_ii a_jj|), j running over the
+  // dropped entries of the row. The row is only sparsified if the Gershgorin
+  // bound of this row, computed with all of its weak entries, is at most
+  // safeguard. Then E <= safeguard D.
+  for (auto const row : locally_owned_rows)
+  {
+    double gershgorin_bound = 0.;
+    for (auto entry = matrix.begin(row); entry != matrix.end(row); ++entry)
+    {
+      auto const column = entry->column();
+      if (is_weak(row, column, entry->value()))
+        gershgorin_bound +=
+            std::abs(entry->value()) / std::abs(diagonal[row]) +
+            std::abs(entry->value()) /
+                std::sqrt(std::abs(diagonal[row] * diagonal[column]));
+    }
+    is_sparsifiable[row] = (gershgorin_bound <= safeguard) ? 1. : 0.;
+  }
+  is_sparsifiable.update_ghost_values();
+
+  // The entries are dropped symmetrically because the criteria are
+  // symmetric: the entry (j, i) is dropped whenever (i, j) is. The magnitude
+  // of a dropped entry is added to the diagonal entries of both rows, so E is
+  // the sum of the positive semidefinite matrices
+  // |a_ij| (e_i - sign(a_ij) e_j) (e_i - sign(a_ij) e_j)^T.
+  auto sparsified_matrix =
+      std::make_shared<dealii::TrilinosWrappers::SparseMatrix>(
+          locally_owned_rows, matrix.locally_owned_domain_indices(), comm);
+  std::vector<dealii::types::global_dof_index> columns;
+  std::vector<dealii::TrilinosScalar> values;
+  for (auto const row : locally_owned_rows)
+  {
+    columns.clear();
+    values.clear();
+    double diagonal_value = diagonal[row];
+    for (auto entry = matrix.begin(row); entry != matrix.end(row); ++entry)
+    {
+      auto const column = entry->column();
+      if (column == row)
+        continue;
+      if ((is_sparsifiable[row] > 0.) && (is_sparsifiable[column] > 0.) &&
+          is_weak(row, column, entry->value()))
+      {
+        diagonal_value += std::abs(entry->value());
+      }
+      else
+      {
+        columns.push_back(column);
+        values.push_back(entry->value());
+      }
+    }
+    columns.push_back(row);
+    values.push_back(diagonal_value);
+    sparsified_matrix->set(row, columns, values, false);
+  }
+  sparsified_matrix->compress(dealii::VectorOperation::insert);
+
+  return std::make_shared<DealIITrilinosMatrixOperator<VectorType>>(
+      sparsified_matrix);
+}
+
+template <typename VectorType>
+std::shared_ptr<Operator<VectorType>>
+DealIITrilinosMatrixOperator<VectorType>::copy_on_communicator(
+    MPI_Comm comm) const
+{
+  auto const &matrix = *_sparse_matrix;
+  auto matrix_copy = std::make_shared<dealii::TrilinosWrappers::SparseMatrix>(
+      matrix.locally_owned_range_indices(),
+      matrix.locally_owned_domain_indices(), comm);
+  std::vector<dealii::types::global_dof_index> columns;
+  std::vector<dealii::TrilinosScalar> values;
+  for (auto const row : matrix.locally_owned_range_indices())
+  {
+    columns.clear();
+    values.clear();
+    for (auto entry = matrix.begin(row); entry != matrix.end(row); ++entry)
+    {
+      columns.push_back(entry->column());
+      values.push_back(entry->value());
+    }
+    matrix_copy->set(row, columns, values, false);
+  }
+  matrix_copy->compress(dealii::VectorOperation::insert);
+
+  return std::make_shared<DealIITrilinosMatrixOperator<VectorType>>(
+      matrix_copy);
+}
+
 template <typename VectorType>
 std::shared_ptr<VectorType>
 DealIITrilinosMatrixOperator<VectorType>::build_domain_vector() const
 {
+  // The rows of a square matrix also describe the domain vectors
+  if (_sparse_matrix->locally_owned_domain_indices() ==
+      _sparse_matrix->locally_owned_range_indices())
+    return build_range_vector();
+
   return std::make_shared<vector_type>(
       _sparse_matrix->locally_owned_domain_indices(),
       _sparse_matrix->get_mpi_communicator());
@@ -108,9 +574,22 @@ template <typename VectorType>
 std::shared_ptr<VectorType>
 DealIITrilinosMatrixOperator<VectorType>::build_range_vector() const
 {
-  return std::make_shared<vector_type>(
-      _sparse_matrix->locally_owned_range_indices(),
-      _sparse_matrix->get_mpi_communicator());
+  // The constructor zeroes the vector with the threaded vector operations of
+  // deal.II whose ranges do not match the blocks of rows of the matrix
+  // kernels. If the row partition has been built, the vector is thus
+  // reinitialized from a template without being zeroed and it is zeroed by
+  // blocks of rows. The partition is not built here because building it may
+  // be collective.
+  vector_type const layout(_sparse_matrix->locally_owned_range_indices(),
+                           _sparse_matrix->get_mpi_communicator());
+  if (_row_partitions[0] == nullptr)
+    return std::make_shared<vector_type>(layout);
+
+  auto vector = std::make_shared<vector_type>();
+  vector->reinit(layout, true);
+  zero_row_blocks(*_row_partitions[0], vector->begin());
+
+  return vector;
 }
 
 template <typename VectorType>
@@ -131,6 +610,66 @@ DealIITrilinosMatrixOperator<VectorType>::get_matrix() const
 {
   return _sparse_matrix;
 }
+
+template <typename VectorType>
+std::shared_ptr<dealii::TrilinosWrappers::SparseMatrix>
+DealIITrilinosMatrixOperator<VectorType>::get_transposed_matrix() const
+{
+  // The cycles may use the operator from several tasks, so the transpose must
+  // only be built once.
+  std::call_once(_transposed_matrix_flag, [this]() {
+    auto epetra_matrix = _sparse_matrix->trilinos_matrix();
+
+    EpetraExt::RowMatrix_Transpose transposer;
+    auto transposed_epetra_matrix =
+        dynamic_cast<Epetra_CrsMatrix &>(transposer(epetra_matrix));
+
+    _transposed_matrix =
+        std::make_shared<dealii::TrilinosWrappers::SparseMatrix>();
+    _transposed_matrix->reinit(transposed_epetra_matrix);
+  });
+
+  return _transposed_matrix;
+}
+
+template <typename VectorType>
+typename DealIITrilinosMatrixOperator<VectorType>::RestrictionBuffers &
+DealIITrilinosMatrixOperator<VectorType>::get_restriction_buffers() const
+{
+  std::call_once(_restriction_buffers_flag, [this]() {
+    auto const &col_map = get_transposed_matrix()->trilinos_matrix().ColMap();
+    std::unique_ptr<RestrictionBuffers> buffers(new RestrictionBuffers());
+    buffers->accumulators.reset(new AccumulatorPool(col_map.NumMyElements()));
+    buffers->y_col.reset(new Epetra_Vector(col_map));
+    _restriction_buffers = std::move(buffers);
+  });
+
+  return *_restriction_buffers;
+}
+
+template <typename VectorType>
+typename DealIITrilinosMatrixOperator<VectorType>::RowPartition const &
+DealIITrilinosMatrixOperator<VectorType>::get_row_partition(
+    bool const transposed) const
+{
+  unsigned int const k = transposed ? 1 : 0;
+  std::call_once(_row_partition_flags[k], [this, k, transposed]() {
+    std::unique_ptr<RowPartition> row_partition(new RowPartition());
+    auto const &matrix = transposed
+                             ? get_transposed_matrix()->trilinos_matrix()
+                             : _sparse_matrix->trilinos_matrix();
+    partition_rows(matrix, row_partition->interior_rows,
+                   row_partition->boundary_rows);
+#ifdef MFMG_WITH_MPI_SHARED_MEMORY
+    if (matrix.Importer() != nullptr)
+      row_partition->ghost_import.reset(new SharedMemoryImport(
+          matrix.DomainMap(), matrix.ColMap()));
+#endif
+    _row_partitions[k] = std::move(row_partition);
+  });
+
+  return *_row_partitions[k];
+}
 } // namespace mfmg
 
 // Explicit Instantiation
@@ -0,0 +1,160 @@
+/**************************************************************************
+ * Copyright (c) 2017-2019 by the mfmg authors                            *
+ * All rights reserved.                                                   *
+ *                                                                        *
+ * This file is part of the mfmg library. mfmg is distributed under a BSD *
+ * 3-clause license. For the licensing terms see the LICENSE file in the  *
+ * top-level directory                                                    *
+ *                                                                        *
+ * SPDX-License-Identifier: BSD-3-Clause                                  *
+ *************************************************************************/
+
+#include <mfmg/common/exceptions.hpp>
+#include <mfmg/dealii/shared_memory_import.hpp>
+
+#include <Epetra_MpiComm.h>
+
+#include <algorithm>
+
+namespace mfmg
+{
+SharedMemoryImport::SharedMemoryImport(Epetra_Map const &source_map,
+                                       Epetra_Map const &target_map,
+                                       MPI_Comm node_comm)
+    : _source_map(source_map)
+{
+  auto const &epetra_comm =
+      dynamic_cast<Epetra_MpiComm const &>(source_map.Comm());
+  MPI_Comm comm = epetra_comm.Comm();
+  if (node_comm == MPI_COMM_NULL)
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL,
+                        &_node_comm);
+  else
+    MPI_Comm_dup(node_comm, &_node_comm);
+
+  // Allocate the shared memory window and get the segments of the other
+  // processors on the node
+  _n_owned = source_map.NumMyElements();
+  MPI_Win_allocate_shared(2 * _n_owned * sizeof(double), sizeof(double),
+                          MPI_INFO_NULL, _node_comm, &_local_segment,
+                          &_window);
+  MPI_Win_lock_all(MPI_MODE_NOCHECK, _window);
+  int node_size = 0;
+  MPI_Comm_size(_node_comm, &node_size);
+  _segments.resize(node_size);
+  _segment_sizes.resize(node_size);
+  for (int r = 0; r < node_size; ++r)
+  {
+    MPI_Aint size = 0;
+    int disp_unit = 0;
+    double *segment = nullptr;
+    MPI_Win_shared_query(_window, r, &size, &disp_unit, &segment);
+    _segments[r] = segment;
+    _segment_sizes[r] = size / (2 * sizeof(double));
+  }
+
+  // Sort the target values between the values owned by this processor and
+  // the values owned by other processors
+  std::vector<int> remote_gids;
+  std::vector<int> remote_target_indices;
+  int const n_targets = target_map.NumMyElements();
+  for (int i = 0; i < n_targets; ++i)
+  {
+    int const gid = target_map.GID(i);
+    int const lid = source_map.LID(gid);
+    if (lid >= 0)
+    {
+      _local_copies.emplace_back(i, lid);
+    }
+    else
+    {
+      remote_gids.push_back(gid);
+      remote_target_indices.push_back(i);
+    }
+  }
+
+  // Find the owners of the remote values and their local indices on the owner
+  unsigned int const n_remote = remote_gids.size();
+  std::vector<int> remote_pids(n_remote);
+  std::vector<int> remote_lids(n_remote);
+  int error_code =
+      source_map.RemoteIDList(n_remote, remote_gids.data(),
+                              remote_pids.data(), remote_lids.data());
+  ASSERT_THROW(error_code == 0, "Epetra_Map::RemoteIDList() returned a "
+                                "non-zero error code in SharedMemoryImport");
+
+  // Find which owners are on the same node
+  MPI_Group group;
+  MPI_Group node_group;
+  MPI_Comm_group(comm, &group);
+  MPI_Comm_group(_node_comm, &node_group);
+  std::vector<int> remote_node_ranks(n_remote);
+  MPI_Group_translate_ranks(group, n_remote, remote_pids.data(), node_group,
+                            remote_node_ranks.data());
+  MPI_Group_free(&node_group);
+  MPI_Group_free(&group);
+
+  std::vector<int> off_node_gids;
+  for (unsigned int k = 0; k < n_remote; ++k)
+  {
+    if (remote_node_ranks[k] != MPI_UNDEFINED)
+    {
+      _node_target_indices.push_back(remote_target_indices[k]);
+      _node_ranks.push_back(remote_node_ranks[k]);
+      _node_source_indices.push_back(remote_lids[k]);
+    }
+    else
+    {
+      _off_node_target_indices.push_back(remote_target_indices[k]);
+      off_node_gids.push_back(remote_gids[k]);
+    }
+  }
+
+  // The values owned by processors on other nodes go through Epetra
+  _off_node_map.reset(new Epetra_Map(-1, off_node_gids.size(),
+                                     off_node_gids.data(),
+                                     source_map.IndexBase(),
+                                     source_map.Comm()));
+  _off_node_importer.reset(new Epetra_Import(*_off_node_map, source_map));
+  _off_node_values.reset(new Epetra_Vector(*_off_node_map, false));
+}
+
+SharedMemoryImport::~SharedMemoryImport()
+{
+  MPI_Win_unlock_all(_window);
+  MPI_Win_free(&_window);
+  MPI_Comm_free(&_node_comm);
+}
+
+void SharedMemoryImport::import(double const *source, double *target)
+{
+  // Expose the locally owned values to the other processors of the node. The
+  // two buffers are used alternatively: a processor can only overwrite a
+  // buffer after every processor of the node has reached the barrier of the
+  // next import, i.e., after they are done reading the buffer.
+  std::copy(source, source + _n_owned, _local_segment + _buffer * _n_owned);
+  MPI_Win_sync(_window);
+  MPI_Barrier(_node_comm);
+  MPI_Win_sync(_window);
+
+  Epetra_Vector source_view(View, _source_map, const_cast<double *>(source));
+  _off_node_values->Import(source_view, *_off_node_importer, Insert);
+  unsigned int const n_off_node = _off_node_target_indices.size();
+  for (unsigned int k = 0; k < n_off_node; ++k)
+    target[_off_node_target_indices[k]] = (*_off_node_values)[k];
+
+  for (auto const &local_copy : _local_copies)
+    target[local_copy.first] = source[local_copy.second];
+
+  unsigned int const n_node = _node_target_indices.size();
+  for (unsigned int k = 0; k < n_node; ++k)
+  {
+    int const rank = _node_ranks[k];
+    target[_node_target_indices[k]] =
+        _segments[rank][_buffer * _segment_sizes[rank] +
+                        _node_source_indices[k]];
+  }
+
+  _buffer = 1 - _buffer;
+}
+} // namespace mfmg
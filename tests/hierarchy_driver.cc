@@ -10,6 +10,7 @@
  *************************************************************************/
 
 #include <mfmg/common/exceptions.hpp>
+#include <mfmg/common/thread_pinning.hpp>
 
 #include <deal.II/base/timer.h>
 
@@ -228,6 +229,8 @@ int main(int argc, char *argv[])
                     "use matrix-free algorithm");
   cmd.add_options()("tolerance,t", boost_po::value<double>(),
                     "tolerance to use for the solver");
+  cmd.add_options()("pin_threads,p", boost_po::value<bool>(),
+                    "pin the threads to the cores of the process");
 
   boost_po::variables_map vm;
   boost_po::store(boost_po::parse_command_line(argc, argv, cmd), vm);
@@ -253,6 +256,13 @@ int main(int argc, char *argv[])
   if (vm.count("matrix_free"))
     matrix_free = vm["matrix_free"].as<bool>();
 
+  // The threads are pinned before anything is allocated so that the pages are
+  // first touched by the threads that use them.
+  bool const pin_threads =
+      vm.count("pin_threads") && vm["pin_threads"].as<bool>();
+  if (pin_threads && !mfmg::pin_threads())
+    std::cerr << "Thread pinning is not supported" << std::endl;
+
   auto const params = std::make_shared<boost::property_tree::ptree>();
   boost::property_tree::info_parser::read_info(filename, *params);
 
@@ -435,5 +445,9 @@ int main(int argc, char *argv[])
       matrix_based_two_grids<3>(params);
   }
 
+  if (pin_threads && mfmg::get_n_unpinned_threads() > 0)
+    std::cerr << mfmg::get_n_unpinned_threads()
+              << " threads could not be pinned" << std::endl;
+
   return 0;
 }
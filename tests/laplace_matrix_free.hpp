@@ -12,6 +12,8 @@
 #ifndef MFMG_LAPLACE_MATRIX_FREE_HPP
 #define MFMG_LAPLACE_MATRIX_FREE_HPP
 
+#include <mfmg/dealii/dealii_matrix_free_diagonal.hpp>
+
 #include <deal.II/base/index_set.h>
 #include <deal.II/distributed/tria.h>
 #include <deal.II/dofs/dof_renumbering.h>
@@ -44,6 +46,10 @@ public:
   template <typename MaterialPropertyType>
   void evaluate_coefficient(MaterialPropertyType const &material_property);
 
+  // Apply the operator on a cell batch whose dof values have been set.
+  template <typename FEEvaluationType>
+  void apply_cell(FEEvaluationType &fe_eval, unsigned int const cell) const;
+
   // private:
   virtual void
   apply_add(dealii::LinearAlgebra::distributed::Vector<ScalarType> &dst,
@@ -56,12 +62,6 @@ public:
               dealii::LinearAlgebra::distributed::Vector<ScalarType> const &src,
               std::pair<unsigned int, unsigned int> const &cell_range) const;
 
-  void local_compute_diagonal(
-      dealii::MatrixFree<dim, ScalarType> const &matrix_free_data,
-      dealii::LinearAlgebra::distributed::Vector<ScalarType> &dst,
-      unsigned int const &dummy,
-      std::pair<unsigned int, unsigned int> const &cell_range) const;
-
   dealii::Table<2, dealii::VectorizedArray<ScalarType>> _coefficient;
 };
 
@@ -80,12 +80,12 @@ void LaplaceOperator<dim, fe_degree, ScalarType>::compute_diagonal()
           dealii::LinearAlgebra::distributed::Vector<ScalarType>>());
   dealii::LinearAlgebra::distributed::Vector<ScalarType> &diagonal =
       this->diagonal_entries->get_vector();
-  this->data->initialize_dof_vector(diagonal);
-  unsigned int const dummy = 0;
-  this->data->cell_loop(&LaplaceOperator::local_compute_diagonal, this,
-                        diagonal, dummy);
-
-  this->set_constrained_entries_to_one(diagonal);
+  int constexpr n_q_points = fe_degree + 1;
+  int constexpr n_components = 1;
+  mfmg::compute_matrix_free_diagonal<dim, fe_degree, n_q_points, n_components>(
+      *this->data, diagonal, [&](auto &fe_eval, unsigned int const cell) {
+        apply_cell(fe_eval, cell);
+      });
 
   this->inverse_diagonal_entries.reset(
       new dealii::DiagonalMatrix<
@@ -138,64 +138,28 @@ void LaplaceOperator<dim, fe_degree, ScalarType>::local_apply(
   dealii::FEEvaluation<dim, fe_degree, n_q_points, n_components, ScalarType>
       fe_eval(matrix_free_data);
 
-  bool const evaluate_values = false;
-  bool const evaluate_gradients = true;
-  bool const integrate_values = false;
-  bool const integrate_gradients = true;
   for (unsigned int cell = cell_range.first; cell < cell_range.second; ++cell)
   {
     fe_eval.reinit(cell);
     fe_eval.read_dof_values(src);
-    fe_eval.evaluate(evaluate_values, evaluate_gradients);
-    for (unsigned int q = 0; q < fe_eval.n_q_points; ++q)
-      fe_eval.submit_gradient(_coefficient(cell, q) * fe_eval.get_gradient(q),
-                              q);
-    fe_eval.integrate(integrate_values, integrate_gradients);
+    apply_cell(fe_eval, cell);
     fe_eval.distribute_local_to_global(dst);
   }
 }
 
 template <int dim, int fe_degree, typename ScalarType>
-void LaplaceOperator<dim, fe_degree, ScalarType>::local_compute_diagonal(
-    dealii::MatrixFree<dim, ScalarType> const &matrix_free_data,
-    dealii::LinearAlgebra::distributed::Vector<ScalarType> &dst,
-    unsigned int const &,
-    std::pair<unsigned int, unsigned int> const &cell_range) const
+template <typename FEEvaluationType>
+void LaplaceOperator<dim, fe_degree, ScalarType>::apply_cell(
+    FEEvaluationType &fe_eval, unsigned int const cell) const
 {
-  int constexpr n_q_points = fe_degree + 1;
-  int constexpr n_components = 1;
-  dealii::FEEvaluation<dim, fe_degree, n_q_points, n_components, ScalarType>
-      fe_eval(matrix_free_data);
-
-  dealii::AlignedVector<dealii::VectorizedArray<ScalarType>> diagonal(
-      fe_eval.dofs_per_cell);
-
   bool const evaluate_values = false;
   bool const evaluate_gradients = true;
   bool const integrate_values = false;
   bool const integrate_gradients = true;
-  for (unsigned int cell = cell_range.first; cell < cell_range.second; ++cell)
-  {
-    fe_eval.reinit(cell);
-    for (unsigned int i = 0; i < fe_eval.dofs_per_cell; ++i)
-    {
-      for (unsigned int j = 0; j < fe_eval.dofs_per_cell; ++j)
-        fe_eval.submit_dof_value(dealii::VectorizedArray<ScalarType>(), j);
-      fe_eval.submit_dof_value(dealii::make_vectorized_array<ScalarType>(1.),
-                               i);
-
-      fe_eval.evaluate(evaluate_values, evaluate_gradients);
-      for (unsigned int q = 0; q < fe_eval.n_q_points; ++q)
-        fe_eval.submit_gradient(_coefficient(cell, q) * fe_eval.get_gradient(q),
-                                q);
-
-      fe_eval.integrate(integrate_values, integrate_gradients);
-      diagonal[i] = fe_eval.get_dof_value(i);
-    }
-    for (unsigned int i = 0; i < fe_eval.dofs_per_cell; ++i)
-      fe_eval.submit_dof_value(diagonal[i], i);
-    fe_eval.distribute_local_to_global(dst);
-  }
+  fe_eval.evaluate(evaluate_values, evaluate_gradients);
+  for (unsigned int q = 0; q < fe_eval.n_q_points; ++q)
+    fe_eval.submit_gradient(_coefficient(cell, q) * fe_eval.get_gradient(q), q);
+  fe_eval.integrate(integrate_values, integrate_gradients);
 }
 
 template <int dim, int fe_degree, typename ScalarType>
@@ -12,6 +12,15 @@
 #define BOOST_TEST_NO_MAIN
 
 #include <deal.II/base/mpi.h>
+#ifdef MFMG_TEST_MPI_THREAD_MULTIPLE
+#include <deal.II/base/multithread_info.h>
+#ifdef DEAL_II_WITH_P4EST
+#include <deal.II/distributed/p4est_wrappers.h>
+#endif
+#include <deal.II/lac/la_parallel_vector.h>
+#include <deal.II/lac/trilinos_vector.h>
+#include <deal.II/lac/vector_memory.h>
+#endif
 
 #include <boost/test/unit_test.hpp>
 
@@ -19,10 +28,40 @@ bool init_function() { return true; }
 
 int main(int argc, char *argv[])
 {
+#ifdef MFMG_TEST_MPI_THREAD_MULTIPLE
+  // MPI_InitFinalize only asks for MPI_THREAD_SERIALIZED. The tests of the
+  // code paths that call MPI from several threads at the same time initialize
+  // MPI themselves.
+  int thread_support = MPI_THREAD_SINGLE;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &thread_support);
+#ifdef DEAL_II_WITH_P4EST
+  sc_init(MPI_COMM_WORLD, 0, 0, nullptr, SC_LP_SILENT);
+  p4est_init(nullptr, SC_LP_SILENT);
+#endif
+  dealii::MultithreadInfo::set_thread_limit(
+      dealii::numbers::invalid_unsigned_int);
+
+  int const result =
+      boost::unit_test::unit_test_main(&init_function, argc, argv);
+
+  // The vectors kept by the memory pools must be released before MPI is
+  // finalized.
+  dealii::GrowingVectorMemory<dealii::LinearAlgebra::distributed::Vector<
+      double>>::release_unused_memory();
+  dealii::GrowingVectorMemory<
+      dealii::TrilinosWrappers::MPI::Vector>::release_unused_memory();
+#ifdef DEAL_II_WITH_P4EST
+  sc_finalize();
+#endif
+  MPI_Finalize();
+
+  return result;
+#else
   // Set the maximum number of threads used to the minimum of the number of
   // cores reported by TBB and the environment variable DEAL_II_NUM_THREADS.
   dealii::Utilities::MPI::MPI_InitFinalize mpi_init(
       argc, argv, dealii::numbers::invalid_unsigned_int);
 
   return boost::unit_test::unit_test_main(&init_function, argc, argv);
+#endif
 }
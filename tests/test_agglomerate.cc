@@ -360,6 +360,61 @@ BOOST_AUTO_TEST_CASE(zoltan_agglomerate_2d)
   BOOST_TEST(agglomerates == ref_agglomerates);
 }
 
+BOOST_AUTO_TEST_CASE(balanced_agglomerate_2d)
+{
+  int constexpr dim = 2;
+  dealii::parallel::distributed::Triangulation<dim> triangulation(
+      MPI_COMM_WORLD);
+  dealii::FE_Q<dim> fe(1);
+  dealii::DoFHandler<dim> dof_handler(triangulation);
+
+  dealii::GridGenerator::hyper_cube(triangulation);
+  triangulation.refine_global(3);
+  dof_handler.distribute_dofs(fe);
+
+  using Vector = dealii::LinearAlgebra::distributed::Vector<double>;
+  using DummyMeshEvaluator = mfmg::DealIIMeshEvaluator<dim>;
+
+  mfmg::AMGe_host<dim, DummyMeshEvaluator, Vector> amge(MPI_COMM_WORLD,
+                                                        dof_handler);
+  unsigned int const n_local_cells =
+      triangulation.n_locally_owned_active_cells();
+
+  // Merge the undersized agglomerates
+  boost::property_tree::ptree partitioner_params;
+  partitioner_params.put("partitioner", "zoltan");
+  partitioner_params.put("n_agglomerates", 3);
+  partitioner_params.put("balance", true);
+  partitioner_params.put("min_size_ratio", 0.5);
+  unsigned int n_agglomerates = amge.build_agglomerates(partitioner_params);
+
+  auto statistics = amge.compute_agglomerate_statistics();
+  BOOST_TEST(statistics.n_agglomerates == n_agglomerates);
+  BOOST_TEST(statistics.mean_size * n_agglomerates == n_local_cells,
+             boost::test_tools::tolerance(1e-12));
+  BOOST_TEST(statistics.min_size >= 0.5 * n_local_cells / 3);
+
+  // Split the oversized agglomerates
+  partitioner_params.put("n_agglomerates", 2);
+  partitioner_params.put("min_size_ratio", 0.);
+  partitioner_params.put("max_size_ratio", 0.5);
+  n_agglomerates = amge.build_agglomerates(partitioner_params);
+
+  statistics = amge.compute_agglomerate_statistics();
+  BOOST_TEST(n_agglomerates >= 4);
+  BOOST_TEST(statistics.max_size <= n_local_cells / 4);
+  std::vector<unsigned int> sizes(n_agglomerates, 0);
+  for (auto cell : dof_handler.active_cell_iterators())
+    if (cell->is_locally_owned())
+    {
+      BOOST_TEST(cell->user_index() >= 1);
+      BOOST_TEST(cell->user_index() <= n_agglomerates);
+      ++sizes[cell->user_index() - 1];
+    }
+  for (auto const size : sizes)
+    BOOST_TEST(size > 0);
+}
+
 BOOST_AUTO_TEST_CASE(boundary_agglomerate_2d)
 {
   bool const boundary = true;
@@ -126,3 +126,39 @@ BOOST_DATA_TEST_CASE(anasazi,
     BOOST_TEST(result.l2_norm() < tolerance);
   }
 }
+
+BOOST_AUTO_TEST_CASE(anasazi_partial_convergence)
+{
+  using namespace mfmg;
+
+  using VectorType = dealii::Vector<double>;
+  using OperatorType = SimpleOperator<VectorType>;
+
+  int const n = 1000;
+  int const n_eigenvectors = 5;
+
+  OperatorType op(n);
+
+  // The tolerance cannot be reached in two iterations. With partial
+  // convergence allowed, the solver returns the eigenpairs that have
+  // converged, if any, instead of failing.
+  boost::property_tree::ptree anasazi_params;
+  anasazi_params.put("number of eigenvectors", n_eigenvectors);
+  anasazi_params.put("max_iterations", 2);
+  anasazi_params.put("tolerance", 1e-14);
+  anasazi_params.put("allow_partial_convergence", true);
+
+  mfmg::AnasaziSolver<OperatorType, VectorType> solver(op);
+
+  VectorType initial_guess_vector(n);
+  initial_guess_vector = 1.;
+  std::vector<std::shared_ptr<VectorType>> initial_guess(
+      1, std::make_shared<VectorType>(initial_guess_vector));
+  std::vector<double> computed_evals;
+  std::vector<VectorType> computed_evecs;
+  std::tie(computed_evals, computed_evecs) =
+      solver.solve(anasazi_params, initial_guess);
+
+  BOOST_TEST(computed_evals.size() < static_cast<size_t>(n_eigenvectors));
+  BOOST_TEST(computed_evecs.size() == computed_evals.size());
+}
@@ -0,0 +1,122 @@
+/**************************************************************************
+ * Copyright (c) 2017-2019 by the mfmg authors                            *
+ * All rights reserved.                                                   *
+ *                                                                        *
+ * This file is part of the mfmg library. mfmg is distributed under a BSD *
+ * 3-clause license. For the licensing terms see the LICENSE file in the  *
+ * top-level directory                                                    *
+ *                                                                        *
+ * SPDX-License-Identifier: BSD-3-Clause                                  *
+ *************************************************************************/
+
+#define BOOST_TEST_MODULE communication_profiler
+
+#include <mfmg/common/communication_profiler.hpp>
+
+#include <deal.II/base/mpi.h>
+
+#include <thread>
+#include <vector>
+
+#include "main.cc"
+
+// This test is only built when the MPI wrappers are enabled
+BOOST_AUTO_TEST_CASE(mpi_wrappers)
+{
+  using mfmg::CommunicationProfiler;
+
+  MPI_Comm comm = MPI_COMM_WORLD;
+  int const n_procs = dealii::Utilities::MPI::n_mpi_processes(comm);
+  int const rank = dealii::Utilities::MPI::this_mpi_process(comm);
+  int const left = (rank + n_procs - 1) % n_procs;
+  int const right = (rank + 1) % n_procs;
+
+  CommunicationProfiler::reset();
+
+  // The ready send requires the matching receive to be posted, which the
+  // barrier guarantees.
+  CommunicationProfiler::enter(0, "point-to-point");
+  std::vector<double> send(4, rank);
+  std::vector<double> recv(4);
+  MPI_Request request;
+  MPI_Irecv(recv.data(), 4, MPI_DOUBLE, left, 0, comm, &request);
+  MPI_Barrier(comm);
+  MPI_Rsend(send.data(), 4, MPI_DOUBLE, right, 0, comm);
+  int index = 0;
+  MPI_Waitany(1, &request, &index, MPI_STATUS_IGNORE);
+  BOOST_TEST(recv[0] == left);
+  MPI_Sendrecv(send.data(), 4, MPI_DOUBLE, right, 1, recv.data(), 4,
+               MPI_DOUBLE, left, 1, comm, MPI_STATUS_IGNORE);
+  MPI_Irecv(recv.data(), 4, MPI_DOUBLE, left, 2, comm, &request);
+  MPI_Send(send.data(), 4, MPI_DOUBLE, right, 2, comm);
+  int flag = 0;
+  while (!flag)
+    MPI_Test(&request, &flag, MPI_STATUS_IGNORE);
+  CommunicationProfiler::leave();
+
+  CommunicationProfiler::enter(1, "collectives");
+  std::vector<int> gathered(n_procs);
+  MPI_Allgather(&rank, 1, MPI_INT, gathered.data(), 1, MPI_INT, comm);
+  for (int p = 0; p < n_procs; ++p)
+    BOOST_TEST(gathered[p] == p);
+  std::vector<int> counts(n_procs, 1);
+  std::vector<int> displacements(n_procs);
+  for (int p = 0; p < n_procs; ++p)
+    displacements[p] = p;
+  MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_INT, gathered.data(), counts.data(),
+                 displacements.data(), MPI_INT, comm);
+  CommunicationProfiler::leave();
+
+  auto const statistics = CommunicationProfiler::get_statistics();
+  auto const &point_to_point =
+      statistics.at(std::make_pair(0, "point-to-point"));
+  // Irecv, Rsend, Sendrecv (two messages), Irecv, and Send
+  BOOST_TEST(point_to_point.n_messages == 6);
+  // The barrier
+  BOOST_TEST(point_to_point.n_collectives == 1);
+  BOOST_TEST(point_to_point.n_bytes == 6 * 4 * sizeof(double));
+  auto const &collectives = statistics.at(std::make_pair(1, "collectives"));
+  BOOST_TEST(collectives.n_messages == 0);
+  BOOST_TEST(collectives.n_collectives == 2);
+  BOOST_TEST(collectives.n_bytes == 2 * sizeof(int));
+
+  CommunicationProfiler::reset();
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_stages)
+{
+  using mfmg::CommunicationProfiler;
+
+  // Each thread attributes its communication to its own stage, even when the
+  // stages of the threads overlap. The communication is recorded by hand
+  // because MPI may not support concurrent calls.
+  CommunicationProfiler::reset();
+  CommunicationProfiler::enter(0, "main");
+  std::vector<std::thread> threads;
+  for (int level = 1; level <= 4; ++level)
+    threads.emplace_back([level]() {
+      CommunicationProfiler::enter(level, "task");
+      for (int i = 0; i < 1000; ++i)
+        CommunicationProfiler::record(1, 0, level, 0.);
+      CommunicationProfiler::leave();
+      CommunicationProfiler::record(0, 1, 0, 0.);
+    });
+  CommunicationProfiler::record(1, 0, 0, 0.);
+  for (auto &thread : threads)
+    thread.join();
+  CommunicationProfiler::leave();
+
+  auto const statistics = CommunicationProfiler::get_statistics();
+  BOOST_TEST(statistics.size() == 6);
+  BOOST_TEST(statistics.at(std::make_pair(0, "main")).n_messages == 1);
+  for (int level = 1; level <= 4; ++level)
+  {
+    auto const &task = statistics.at(std::make_pair(level, "task"));
+    BOOST_TEST(task.n_messages == 1000);
+    BOOST_TEST(task.n_bytes == 1000 * level);
+  }
+  // The communication outside of the stages of the threads
+  BOOST_TEST(statistics.at(std::make_pair(-1, "")).n_collectives == 4);
+
+  CommunicationProfiler::reset();
+}
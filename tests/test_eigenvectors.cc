@@ -230,3 +230,315 @@ BOOST_AUTO_TEST_CASE(diagonal_constraint, *ut::tolerance(1e-12))
       BOOST_TEST(std::abs(eigenvectors[i][j]) == ref_eigenvectors[i][j]);
   }
 }
+
+template <int dim>
+class NearNullspaceTestMeshEvaluator : public DiagonalTestMeshEvaluator<dim>
+{
+public:
+  NearNullspaceTestMeshEvaluator(dealii::DoFHandler<dim> &dof_handler,
+                                 dealii::AffineConstraints<double> &constraints)
+      : DiagonalTestMeshEvaluator<dim>(dof_handler, constraints)
+  {
+  }
+
+  // The near-nullspace of a scalar problem is the constant.
+  std::vector<dealii::Vector<double>> get_near_nullspace(
+      dealii::DoFHandler<dim> const &dof_handler,
+      dealii::AffineConstraints<double> const &constraints) const override
+  {
+    return this->compute_rigid_body_modes(dof_handler, constraints);
+  }
+};
+
+BOOST_AUTO_TEST_CASE(near_nullspace, *ut::tolerance(1e-12))
+{
+  int const dim = 2;
+  using Vector = dealii::LinearAlgebra::distributed::Vector<double>;
+  using MeshEvaluator = mfmg::DealIIMeshEvaluator<2>;
+
+  dealii::parallel::distributed::Triangulation<2> triangulation(MPI_COMM_WORLD);
+  dealii::GridGenerator::hyper_cube(triangulation);
+  triangulation.refine_global(3);
+  dealii::FE_Q<2> fe(1);
+  dealii::DoFHandler<2> dof_handler(triangulation);
+  dof_handler.distribute_dofs(fe);
+  mfmg::AMGe_host<2, MeshEvaluator, Vector> amge(MPI_COMM_WORLD, dof_handler);
+
+  unsigned int const n_eigenvectors = 5;
+  std::map<typename dealii::Triangulation<2>::active_cell_iterator,
+           typename dealii::DoFHandler<2>::active_cell_iterator>
+      patch_to_global_map;
+  for (auto cell : dof_handler.active_cell_iterators())
+    patch_to_global_map[cell] = cell;
+
+  dealii::AffineConstraints<double> constraints;
+  NearNullspaceTestMeshEvaluator<dim> evaluator(dof_handler, constraints);
+  std::vector<std::complex<double>> eigenvalues;
+  std::vector<dealii::Vector<double>> eigenvectors;
+  std::vector<double> diag_elements;
+  std::vector<dealii::types::global_dof_index> dof_indices_map;
+  std::tie(eigenvalues, eigenvectors, diag_elements, dof_indices_map) =
+      amge.compute_local_eigenvectors(n_eigenvectors, 1e-13, triangulation,
+                                      patch_to_global_map, evaluator,
+                                      mfmg::LobpcgScratchData());
+
+  // The first vector is the normalized constant and its Rayleigh quotient is
+  // the average of the diagonal. The other vectors are orthonormal to it.
+  unsigned int const eigenvector_size = eigenvectors[0].size();
+  BOOST_TEST(eigenvectors.size() == n_eigenvectors);
+  BOOST_TEST(eigenvalues[0].real() == (eigenvector_size + 1) / 2.);
+  for (unsigned int j = 0; j < eigenvector_size; ++j)
+    BOOST_TEST(std::abs(eigenvectors[0][j]) ==
+               1. / std::sqrt(eigenvector_size));
+  for (unsigned int i = 0; i < n_eigenvectors; ++i)
+    for (unsigned int j = 0; j < n_eigenvectors; ++j)
+      BOOST_TEST(std::abs(eigenvectors[i] * eigenvectors[j] -
+                          (i == j ? 1. : 0.)) < 1e-10);
+}
+
+BOOST_AUTO_TEST_CASE(anasazi_partial_convergence)
+{
+  int const dim = 2;
+  using Vector = dealii::LinearAlgebra::distributed::Vector<double>;
+  using MeshEvaluator = mfmg::DealIIMeshEvaluator<2>;
+
+  dealii::parallel::distributed::Triangulation<2> triangulation(MPI_COMM_WORLD);
+  dealii::GridGenerator::hyper_cube(triangulation);
+  triangulation.refine_global(3);
+  dealii::FE_Q<2> fe(1);
+  dealii::DoFHandler<2> dof_handler(triangulation);
+  dof_handler.distribute_dofs(fe);
+
+  // LOBPCG cannot converge in one iteration. The missing eigenpairs are
+  // completed by complete_eigenpairs().
+  unsigned int const n_eigenvectors = 5;
+  boost::property_tree::ptree eigensolver_params;
+  eigensolver_params.put("type", "anasazi");
+  eigensolver_params.put("number of eigenvectors", n_eigenvectors);
+  eigensolver_params.put("max_iterations", 1);
+  eigensolver_params.put("tolerance", 1e-14);
+  eigensolver_params.put("allow_partial_convergence", true);
+  mfmg::AMGe_host<2, MeshEvaluator, Vector> amge(MPI_COMM_WORLD, dof_handler,
+                                                 eigensolver_params);
+
+  std::map<typename dealii::Triangulation<2>::active_cell_iterator,
+           typename dealii::DoFHandler<2>::active_cell_iterator>
+      patch_to_global_map;
+  for (auto cell : dof_handler.active_cell_iterators())
+    patch_to_global_map[cell] = cell;
+
+  dealii::AffineConstraints<double> constraints;
+  DiagonalTestMeshEvaluator<dim> evaluator(dof_handler, constraints);
+  std::vector<std::complex<double>> eigenvalues;
+  std::vector<dealii::Vector<double>> eigenvectors;
+  std::vector<double> diag_elements;
+  std::vector<dealii::types::global_dof_index> dof_indices_map;
+  std::tie(eigenvalues, eigenvectors, diag_elements, dof_indices_map) =
+      amge.compute_local_eigenvectors(n_eigenvectors, 1e-14, triangulation,
+                                      patch_to_global_map, evaluator,
+                                      mfmg::LobpcgScratchData());
+
+  // The vectors are orthonormal and the eigenvalues are their Rayleigh
+  // quotients. The diagonal entry of the dof j is j + 1.
+  BOOST_TEST(eigenvalues.size() == n_eigenvectors);
+  BOOST_TEST(eigenvectors.size() == n_eigenvectors);
+  unsigned int const eigenvector_size = eigenvectors[0].size();
+  for (unsigned int i = 0; i < n_eigenvectors; ++i)
+  {
+    for (unsigned int j = 0; j < n_eigenvectors; ++j)
+      BOOST_TEST(std::abs(eigenvectors[i] * eigenvectors[j] -
+                          (i == j ? 1. : 0.)) < 1e-10);
+
+    double rayleigh_quotient = 0.;
+    for (unsigned int j = 0; j < eigenvector_size; ++j)
+      rayleigh_quotient += (j + 1) * eigenvectors[i][j] * eigenvectors[i][j];
+    BOOST_TEST(std::abs(eigenvalues[i].real() - rayleigh_quotient) <
+               1e-10 * eigenvector_size);
+    BOOST_TEST(eigenvalues[i].imag() == 0.);
+  }
+}
+
+template <int dim>
+class MostlyConstrainedTestMeshEvaluator
+    : public mfmg::DealIIMeshEvaluator<dim>
+{
+public:
+  MostlyConstrainedTestMeshEvaluator(
+      dealii::DoFHandler<dim> &dof_handler,
+      dealii::AffineConstraints<double> &constraints,
+      unsigned int const n_free_dofs = 2)
+      : mfmg::DealIIMeshEvaluator<dim>(dof_handler, constraints),
+        _n_free_dofs(n_free_dofs)
+  {
+  }
+
+  virtual ~MostlyConstrainedTestMeshEvaluator() override = default;
+
+  // Only the first n_free_dofs dofs are not constrained, like in an
+  // agglomerate lying on the Dirichlet boundary.
+  void evaluate_agglomerate(
+      dealii::DoFHandler<dim> &dof_handler,
+      dealii::AffineConstraints<double> &constraints,
+      dealii::SparsityPattern &system_sparsity_pattern,
+      dealii::SparseMatrix<double> &system_matrix) const override final
+  {
+    dealii::FE_Q<2> fe(1);
+    dof_handler.distribute_dofs(fe);
+
+    unsigned int const size = dof_handler.n_dofs();
+    constraints.clear();
+    for (unsigned int i = _n_free_dofs; i < size; ++i)
+      constraints.add_line(i);
+    constraints.close();
+
+    std::vector<std::vector<unsigned int>> column_indices(
+        size, std::vector<unsigned int>(1));
+    for (unsigned int i = 0; i < size; ++i)
+      column_indices[i][0] = i;
+    system_sparsity_pattern.copy_from(size, size, column_indices.begin(),
+                                      column_indices.end());
+    system_matrix.reinit(system_sparsity_pattern);
+    for (unsigned int i = 0; i < size; ++i)
+      system_matrix.diag_element(i) = static_cast<double>(i + 1);
+  }
+
+  void
+  evaluate_global(dealii::DoFHandler<dim> &,
+                  dealii::AffineConstraints<double> &,
+                  dealii::TrilinosWrappers::SparseMatrix &) const override final
+  {
+  }
+
+private:
+  unsigned int const _n_free_dofs;
+};
+
+BOOST_AUTO_TEST_CASE(mostly_constrained, *ut::tolerance(1e-12))
+{
+  int const dim = 2;
+  using Vector = dealii::LinearAlgebra::distributed::Vector<double>;
+  using MeshEvaluator = mfmg::DealIIMeshEvaluator<2>;
+
+  dealii::parallel::distributed::Triangulation<2> triangulation(MPI_COMM_WORLD);
+  dealii::GridGenerator::hyper_cube(triangulation);
+  triangulation.refine_global(3);
+  dealii::FE_Q<2> fe(1);
+  dealii::DoFHandler<2> dof_handler(triangulation);
+  dof_handler.distribute_dofs(fe);
+  mfmg::AMGe_host<2, MeshEvaluator, Vector> amge(MPI_COMM_WORLD, dof_handler);
+
+  unsigned int const n_eigenvectors = 5;
+  std::map<typename dealii::Triangulation<2>::active_cell_iterator,
+           typename dealii::DoFHandler<2>::active_cell_iterator>
+      patch_to_global_map;
+  for (auto cell : dof_handler.active_cell_iterators())
+    patch_to_global_map[cell] = cell;
+
+  dealii::AffineConstraints<double> constraints;
+  MostlyConstrainedTestMeshEvaluator<dim> evaluator(dof_handler, constraints);
+  std::vector<std::complex<double>> eigenvalues;
+  std::vector<dealii::Vector<double>> eigenvectors;
+  std::vector<double> diag_elements;
+  std::vector<dealii::types::global_dof_index> dof_indices_map;
+  std::tie(eigenvalues, eigenvectors, diag_elements, dof_indices_map) =
+      amge.compute_local_eigenvectors(n_eigenvectors, 1e-13, triangulation,
+                                      patch_to_global_map, evaluator,
+                                      mfmg::LobpcgScratchData());
+
+  // The two unconstrained dofs give two eigenpairs. The other ones are zero
+  // so that the agglomerate still has the requested number of rows.
+  BOOST_TEST(eigenvalues.size() == n_eigenvectors);
+  BOOST_TEST(eigenvectors.size() == n_eigenvectors);
+  unsigned int const eigenvector_size = eigenvectors[0].size();
+  for (unsigned int i = 0; i < n_eigenvectors; ++i)
+  {
+    double const ref_eigenvalue = (i < 2) ? static_cast<double>(i + 1) : 0.;
+    BOOST_TEST(eigenvalues[i].real() == ref_eigenvalue);
+    for (unsigned int j = 0; j < eigenvector_size; ++j)
+      BOOST_TEST(std::abs(std::abs(eigenvectors[i][j]) -
+                          ((i == j) ? 1. : 0.)) < 1e-12);
+  }
+}
+
+template <int dim>
+class ConstrainedNearNullspaceTestMeshEvaluator
+    : public MostlyConstrainedTestMeshEvaluator<dim>
+{
+public:
+  ConstrainedNearNullspaceTestMeshEvaluator(
+      dealii::DoFHandler<dim> &dof_handler,
+      dealii::AffineConstraints<double> &constraints,
+      unsigned int const n_free_dofs)
+      : MostlyConstrainedTestMeshEvaluator<dim>(dof_handler, constraints,
+                                                n_free_dofs)
+  {
+  }
+
+  // The constant is not zeroed on the constrained dofs.
+  std::vector<dealii::Vector<double>> get_near_nullspace(
+      dealii::DoFHandler<dim> const &dof_handler,
+      dealii::AffineConstraints<double> const &) const override
+  {
+    dealii::Vector<double> constant(dof_handler.n_dofs());
+    constant = 1.;
+    return std::vector<dealii::Vector<double>>(1, constant);
+  }
+};
+
+BOOST_AUTO_TEST_CASE(constrained_near_nullspace, *ut::tolerance(1e-12))
+{
+  int const dim = 2;
+  using Vector = dealii::LinearAlgebra::distributed::Vector<double>;
+  using MeshEvaluator = mfmg::DealIIMeshEvaluator<2>;
+
+  dealii::parallel::distributed::Triangulation<2> triangulation(MPI_COMM_WORLD);
+  dealii::GridGenerator::hyper_cube(triangulation);
+  triangulation.refine_global(3);
+  dealii::FE_Q<2> fe(1);
+  dealii::DoFHandler<2> dof_handler(triangulation);
+  dof_handler.distribute_dofs(fe);
+  mfmg::AMGe_host<2, MeshEvaluator, Vector> amge(MPI_COMM_WORLD, dof_handler);
+
+  unsigned int const n_eigenvectors = 5;
+  std::map<typename dealii::Triangulation<2>::active_cell_iterator,
+           typename dealii::DoFHandler<2>::active_cell_iterator>
+      patch_to_global_map;
+  for (auto cell : dof_handler.active_cell_iterators())
+    patch_to_global_map[cell] = cell;
+
+  for (unsigned int n_free_dofs : {0, 2})
+  {
+    dealii::AffineConstraints<double> constraints;
+    ConstrainedNearNullspaceTestMeshEvaluator<dim> evaluator(
+        dof_handler, constraints, n_free_dofs);
+    std::vector<std::complex<double>> eigenvalues;
+    std::vector<dealii::Vector<double>> eigenvectors;
+    std::vector<double> diag_elements;
+    std::vector<dealii::types::global_dof_index> dof_indices_map;
+    std::tie(eigenvalues, eigenvectors, diag_elements, dof_indices_map) =
+        amge.compute_local_eigenvectors(n_eigenvectors, 1e-13, triangulation,
+                                        patch_to_global_map, evaluator,
+                                        mfmg::LobpcgScratchData());
+
+    // Without unconstrained dofs, every eigenpair is zero. Otherwise, the
+    // first coarse vector is the constant restricted to the unconstrained
+    // dofs and its Rayleigh quotient is the average of their diagonal.
+    BOOST_TEST(eigenvalues.size() == n_eigenvectors);
+    BOOST_TEST(eigenvectors.size() == n_eigenvectors);
+    unsigned int const eigenvector_size = eigenvectors[0].size();
+    for (unsigned int i = 0; i < n_eigenvectors; ++i)
+      for (unsigned int j = n_free_dofs; j < eigenvector_size; ++j)
+        BOOST_TEST(eigenvectors[i][j] == 0.);
+    if (n_free_dofs > 0)
+    {
+      BOOST_TEST(eigenvalues[0].real() == 1.5);
+      for (unsigned int j = 0; j < n_free_dofs; ++j)
+        BOOST_TEST(std::abs(eigenvectors[0][j]) == 1. / std::sqrt(2.));
+    }
+    else
+    {
+      for (unsigned int i = 0; i < n_eigenvectors; ++i)
+        BOOST_TEST(eigenvalues[i].real() == 0.);
+    }
+  }
+}
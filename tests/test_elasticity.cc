@@ -0,0 +1,369 @@
+/**************************************************************************
+ * Copyright (c) 2017-2019 by the mfmg authors                            *
+ * All rights reserved.                                                   *
+ *                                                                        *
+ * This file is part of the mfmg library. mfmg is distributed under a BSD *
+ * 3-clause license. For the licensing terms see the LICENSE file in the  *
+ * top-level directory                                                    *
+ *                                                                        *
+ * SPDX-License-Identifier: BSD-3-Clause                                  *
+ *************************************************************************/
+
+#define BOOST_TEST_MODULE elasticity
+
+#include <mfmg/common/hierarchy.hpp>
+#include <mfmg/dealii/amge_host.hpp>
+#include <mfmg/dealii/dealii_mesh_evaluator.hpp>
+
+#include <deal.II/distributed/tria.h>
+#include <deal.II/dofs/dof_tools.h>
+#include <deal.II/fe/fe_q.h>
+#include <deal.II/fe/fe_system.h>
+#include <deal.II/fe/fe_values.h>
+#include <deal.II/fe/mapping_q1.h>
+#include <deal.II/grid/filtered_iterator.h>
+#include <deal.II/grid/grid_generator.h>
+#include <deal.II/lac/dynamic_sparsity_pattern.h>
+#include <deal.II/lac/la_parallel_vector.h>
+#include <deal.II/lac/precondition.h>
+#include <deal.II/lac/solver_cg.h>
+#include <deal.II/lac/sparse_matrix.h>
+#include <deal.II/lac/trilinos_sparse_matrix.h>
+#include <deal.II/lac/trilinos_sparsity_pattern.h>
+#include <deal.II/lac/trilinos_vector.h>
+#include <deal.II/numerics/vector_tools.h>
+
+#include <boost/property_tree/info_parser.hpp>
+
+#include <map>
+#include <random>
+
+#include "main.cc"
+
+// Linear elasticity with unit Lame coefficients. The displacement is clamped
+// on the faces of boundary id one.
+template <int dim>
+void assemble_elasticity_cell_matrix(dealii::FEValues<dim> const &fe_values,
+                                     dealii::FullMatrix<double> &cell_matrix)
+{
+  double const lambda = 1.;
+  double const mu = 1.;
+  auto const &fe = fe_values.get_fe();
+  unsigned int const dofs_per_cell = fe.dofs_per_cell;
+  cell_matrix = 0;
+  for (unsigned int q = 0; q < fe_values.n_quadrature_points; ++q)
+    for (unsigned int i = 0; i < dofs_per_cell; ++i)
+    {
+      unsigned int const component_i = fe.system_to_component_index(i).first;
+      for (unsigned int j = 0; j < dofs_per_cell; ++j)
+      {
+        unsigned int const component_j = fe.system_to_component_index(j).first;
+        cell_matrix(i, j) +=
+            (fe_values.shape_grad(i, q)[component_i] *
+                 fe_values.shape_grad(j, q)[component_j] * lambda +
+             fe_values.shape_grad(i, q)[component_j] *
+                 fe_values.shape_grad(j, q)[component_i] * mu +
+             ((component_i == component_j) ? (fe_values.shape_grad(i, q) *
+                                              fe_values.shape_grad(j, q) * mu)
+                                           : 0.)) *
+            fe_values.JxW(q);
+      }
+    }
+}
+
+template <int dim>
+class Elasticity
+{
+public:
+  Elasticity(MPI_Comm const &comm)
+      : _comm(comm), _triangulation(_comm), _fe(dealii::FE_Q<dim>(1), dim),
+        _dof_handler(_triangulation)
+  {
+  }
+
+  // When @p clamped is true, the displacement is zero on the face x = 0.
+  // Otherwise, the problem has pure Neumann boundary conditions and the
+  // matrix is singular.
+  void setup_system(unsigned int const n_refinements, bool const clamped)
+  {
+    dealii::GridGenerator::hyper_cube(_triangulation);
+    _triangulation.refine_global(n_refinements);
+    if (clamped)
+      for (auto &cell : _triangulation.active_cell_iterators())
+        for (unsigned int f = 0; f < dealii::GeometryInfo<dim>::faces_per_cell;
+             ++f)
+          if (cell->face(f)->at_boundary() &&
+              (std::abs(cell->face(f)->center()[0]) < 1e-12))
+            cell->face(f)->set_boundary_id(1);
+
+    _dof_handler.distribute_dofs(_fe);
+    _locally_owned_dofs = _dof_handler.locally_owned_dofs();
+    dealii::DoFTools::extract_locally_relevant_dofs(_dof_handler,
+                                                    _locally_relevant_dofs);
+
+    _constraints.clear();
+    _constraints.reinit(_locally_relevant_dofs);
+    dealii::DoFTools::make_hanging_node_constraints(_dof_handler, _constraints);
+    dealii::VectorTools::interpolate_boundary_values(
+        _dof_handler, 1, dealii::Functions::ZeroFunction<dim>(dim),
+        _constraints);
+    _constraints.close();
+
+    dealii::TrilinosWrappers::SparsityPattern sparsity_pattern(
+        _locally_owned_dofs, _comm);
+    dealii::DoFTools::make_sparsity_pattern(_dof_handler, sparsity_pattern,
+                                            _constraints);
+    sparsity_pattern.compress();
+    _system_matrix.reinit(sparsity_pattern);
+
+    dealii::QGauss<dim> const quadrature(2);
+    dealii::FEValues<dim> fe_values(_fe, quadrature,
+                                    dealii::update_gradients |
+                                        dealii::update_JxW_values);
+    dealii::FullMatrix<double> cell_matrix(_fe.dofs_per_cell,
+                                           _fe.dofs_per_cell);
+    std::vector<dealii::types::global_dof_index> local_dof_indices(
+        _fe.dofs_per_cell);
+    for (auto cell :
+         dealii::filter_iterators(_dof_handler.active_cell_iterators(),
+                                  dealii::IteratorFilters::LocallyOwnedCell()))
+    {
+      fe_values.reinit(cell);
+      assemble_elasticity_cell_matrix(fe_values, cell_matrix);
+      cell->get_dof_indices(local_dof_indices);
+      _constraints.distribute_local_to_global(cell_matrix, local_dof_indices,
+                                              _system_matrix);
+    }
+    _system_matrix.compress(dealii::VectorOperation::add);
+  }
+
+  MPI_Comm _comm;
+  dealii::parallel::distributed::Triangulation<dim> _triangulation;
+  dealii::FESystem<dim> _fe;
+  dealii::DoFHandler<dim> _dof_handler;
+  dealii::IndexSet _locally_owned_dofs;
+  dealii::IndexSet _locally_relevant_dofs;
+  dealii::AffineConstraints<double> _constraints;
+  dealii::TrilinosWrappers::SparseMatrix _system_matrix;
+};
+
+template <int dim>
+class ElasticityMeshEvaluator final : public mfmg::DealIIMeshEvaluator<dim>
+{
+public:
+  ElasticityMeshEvaluator(dealii::DoFHandler<dim> &dof_handler,
+                          dealii::AffineConstraints<double> &constraints,
+                          dealii::TrilinosWrappers::SparseMatrix const &matrix,
+                          bool const use_near_nullspace)
+      : mfmg::DealIIMeshEvaluator<dim>(dof_handler, constraints),
+        _matrix(matrix), _use_near_nullspace(use_near_nullspace)
+  {
+  }
+
+  virtual ~ElasticityMeshEvaluator() override = default;
+
+  virtual void evaluate_global(
+      dealii::DoFHandler<dim> &, dealii::AffineConstraints<double> &,
+      dealii::TrilinosWrappers::SparseMatrix &system_matrix) const override
+  {
+    system_matrix.copy_from(_matrix);
+  }
+
+  virtual void evaluate_agglomerate(
+      dealii::DoFHandler<dim> &dof_handler,
+      dealii::AffineConstraints<double> &constraints,
+      dealii::SparsityPattern &system_sparsity_pattern,
+      dealii::SparseMatrix<double> &system_matrix) const override
+  {
+    dealii::FESystem<dim> fe(dealii::FE_Q<dim>(1), dim);
+    dof_handler.distribute_dofs(fe);
+
+    constraints.clear();
+    dealii::DoFTools::make_hanging_node_constraints(dof_handler, constraints);
+    dealii::VectorTools::interpolate_boundary_values(
+        dof_handler, 1, dealii::Functions::ZeroFunction<dim>(dim), constraints);
+    constraints.close();
+
+    dealii::DynamicSparsityPattern dsp(dof_handler.n_dofs());
+    dealii::DoFTools::make_sparsity_pattern(dof_handler, dsp, constraints);
+    system_sparsity_pattern.copy_from(dsp);
+    system_matrix.reinit(system_sparsity_pattern);
+
+    dealii::QGauss<dim> const quadrature(2);
+    dealii::FEValues<dim> fe_values(fe, quadrature,
+                                    dealii::update_gradients |
+                                        dealii::update_JxW_values);
+    dealii::FullMatrix<double> cell_matrix(fe.dofs_per_cell, fe.dofs_per_cell);
+    std::vector<dealii::types::global_dof_index> local_dof_indices(
+        fe.dofs_per_cell);
+    for (auto cell : dof_handler.active_cell_iterators())
+    {
+      fe_values.reinit(cell);
+      assemble_elasticity_cell_matrix(fe_values, cell_matrix);
+      cell->get_dof_indices(local_dof_indices);
+      constraints.distribute_local_to_global(cell_matrix, local_dof_indices,
+                                             system_matrix);
+    }
+  }
+
+  virtual std::vector<dealii::Vector<double>> get_near_nullspace(
+      dealii::DoFHandler<dim> const &dof_handler,
+      dealii::AffineConstraints<double> const &constraints) const override
+  {
+    if (_use_near_nullspace)
+      return this->compute_rigid_body_modes(dof_handler, constraints);
+    else
+      return std::vector<dealii::Vector<double>>();
+  }
+
+private:
+  dealii::TrilinosWrappers::SparseMatrix const &_matrix;
+  bool const _use_near_nullspace;
+};
+
+// The operator R R^T, whose inverse gives the coefficients of the orthogonal
+// projection on the range of the prolongation R^T.
+class NormalOperator
+{
+public:
+  NormalOperator(dealii::TrilinosWrappers::SparseMatrix const &restriction)
+      : _restriction(restriction),
+        _tmp(restriction.locally_owned_domain_indices(),
+             restriction.get_mpi_communicator())
+  {
+  }
+
+  void vmult(dealii::TrilinosWrappers::MPI::Vector &dst,
+             dealii::TrilinosWrappers::MPI::Vector const &src) const
+  {
+    _restriction.Tvmult(_tmp, src);
+    _restriction.vmult(dst, _tmp);
+  }
+
+private:
+  dealii::TrilinosWrappers::SparseMatrix const &_restriction;
+  mutable dealii::TrilinosWrappers::MPI::Vector _tmp;
+};
+
+BOOST_AUTO_TEST_CASE(rigid_body_modes_in_prolongation_range)
+{
+  unsigned int constexpr dim = 2;
+  using DVector = dealii::LinearAlgebra::distributed::Vector<double>;
+
+  MPI_Comm comm = MPI_COMM_WORLD;
+  Elasticity<dim> elasticity(comm);
+  elasticity.setup_system(4, false);
+  ElasticityMeshEvaluator<dim> evaluator(
+      elasticity._dof_handler, elasticity._constraints,
+      elasticity._system_matrix, true);
+
+  // The coarse space of every agglomerate contains the 3 rigid body modes
+  // and one eigenvector.
+  boost::property_tree::ptree agglomerate_params;
+  agglomerate_params.put("partitioner", "block");
+  agglomerate_params.put("nx", 2);
+  agglomerate_params.put("ny", 2);
+  boost::property_tree::ptree eigensolver_params;
+  eigensolver_params.put("number of eigenvectors", 4);
+  eigensolver_params.put("tolerance", 1e-14);
+  mfmg::AMGe_host<dim, mfmg::DealIIMeshEvaluator<dim>, DVector> amge(
+      comm, elasticity._dof_handler, eigensolver_params);
+  dealii::TrilinosWrappers::SparseMatrix restriction;
+  amge.setup_restrictor(agglomerate_params, 4, 1e-14, evaluator,
+                        evaluator.get_diagonal(), restriction);
+
+  // Global rigid body modes
+  auto const &fe = elasticity._fe;
+  std::map<dealii::types::global_dof_index, dealii::Point<dim>> support_points;
+  dealii::DoFTools::map_dofs_to_support_points(
+      dealii::MappingQ1<dim>(), elasticity._dof_handler, support_points);
+  std::map<dealii::types::global_dof_index, unsigned int> dof_components;
+  std::vector<dealii::types::global_dof_index> dof_indices(fe.dofs_per_cell);
+  for (auto cell : dealii::filter_iterators(
+           elasticity._dof_handler.active_cell_iterators(),
+           dealii::IteratorFilters::LocallyOwnedCell()))
+  {
+    cell->get_dof_indices(dof_indices);
+    for (unsigned int i = 0; i < fe.dofs_per_cell; ++i)
+      dof_components[dof_indices[i]] = fe.system_to_component_index(i).first;
+  }
+  unsigned int const n_modes = dim + dim * (dim - 1) / 2;
+  std::vector<dealii::TrilinosWrappers::MPI::Vector> modes(
+      n_modes, dealii::TrilinosWrappers::MPI::Vector(
+                   elasticity._locally_owned_dofs, comm));
+  for (auto const i : elasticity._locally_owned_dofs)
+  {
+    unsigned int const component = dof_components[i];
+    modes[component][i] = 1.;
+    modes[dim][i] = (component == 0) ? -support_points[i][1]
+                                     : support_points[i][0];
+  }
+  for (auto &mode : modes)
+    mode.compress(dealii::VectorOperation::insert);
+
+  // The orthogonal projection of every mode on the range of the prolongation
+  // is the mode itself.
+  NormalOperator normal_operator(restriction);
+  dealii::TrilinosWrappers::MPI::Vector coefficients(
+      restriction.locally_owned_range_indices(), comm);
+  dealii::TrilinosWrappers::MPI::Vector rhs(coefficients);
+  dealii::TrilinosWrappers::MPI::Vector projection(modes[0]);
+  for (auto &mode : modes)
+  {
+    restriction.vmult(rhs, mode);
+    coefficients = 0.;
+    dealii::SolverControl solver_control(rhs.size(), 1e-12 * rhs.l2_norm());
+    dealii::SolverCG<dealii::TrilinosWrappers::MPI::Vector> solver(
+        solver_control);
+    solver.solve(normal_operator, coefficients, rhs,
+                 dealii::PreconditionIdentity());
+    restriction.Tvmult(projection, coefficients);
+    projection -= mode;
+    BOOST_TEST(projection.l2_norm() <= 1e-8 * mode.l2_norm());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(elasticity_hierarchy)
+{
+  unsigned int constexpr dim = 2;
+  using DVector = dealii::LinearAlgebra::distributed::Vector<double>;
+
+  MPI_Comm comm = MPI_COMM_WORLD;
+  Elasticity<dim> elasticity(comm);
+  elasticity.setup_system(5, true);
+
+  auto params = std::make_shared<boost::property_tree::ptree>();
+  boost::property_tree::info_parser::read_info("hierarchy_input.info", *params);
+  params->put("is preconditioner", true);
+  params->put("smoother.type", "Symmetric Gauss-Seidel");
+  params->put("eigensolver.number of eigenvectors", 4);
+  auto evaluator = std::make_shared<ElasticityMeshEvaluator<dim>>(
+      elasticity._dof_handler, elasticity._constraints,
+      elasticity._system_matrix, true);
+  mfmg::Hierarchy<DVector> hierarchy(comm, evaluator, params);
+
+  DVector rhs(elasticity._locally_owned_dofs, comm);
+  std::default_random_engine generator;
+  std::uniform_real_distribution<double> distribution(-1., 1.);
+  for (auto const index : elasticity._locally_owned_dofs)
+    if (!elasticity._constraints.is_constrained(index))
+      rhs[index] = distribution(generator);
+  DVector solution(rhs);
+  double const tolerance = 1e-8 * rhs.l2_norm();
+
+  solution = 0.;
+  dealii::SolverControl ref_solver_control(rhs.size(), tolerance);
+  dealii::SolverCG<DVector> ref_solver(ref_solver_control);
+  ref_solver.solve(elasticity._system_matrix, solution, rhs,
+                   dealii::PreconditionIdentity());
+
+  solution = 0.;
+  dealii::SolverControl solver_control(rhs.size(), tolerance);
+  dealii::SolverCG<DVector> solver(solver_control);
+  solver.solve(elasticity._system_matrix, solution, rhs, hierarchy);
+
+  // The rigid body modes make the coarse space effective on the agglomerates
+  // touching the clamped face as well as on the others.
+  BOOST_TEST(solver_control.last_step() <= 50u);
+  BOOST_TEST(2 * solver_control.last_step() < ref_solver_control.last_step());
+}
@@ -12,6 +12,8 @@
 #define BOOST_TEST_MODULE hierarchy
 
 #include <mfmg/common/hierarchy.hpp>
+#include <mfmg/dealii/amge_host.templates.hpp>
+#include <mfmg/dealii/dealii_smoother.hpp>
 #include <mfmg/dealii/dealii_trilinos_matrix_operator.hpp>
 
 #include <deal.II/base/conditional_ostream.h>
@@ -29,6 +31,9 @@
 #include <boost/test/data/monomorphic.hpp>
 #include <boost/test/data/test_case.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <random>
 
 #include "laplace.hpp"
@@ -48,7 +53,7 @@
 namespace bdata = boost::unit_test::data;
 namespace tt = boost::test_tools;
 
-template <typename MeshEvaluator>
+template <typename MeshEvaluator, int fe_degree = 1>
 double test_mf(std::shared_ptr<boost::property_tree::ptree> params)
 {
   using DVector = dealii::LinearAlgebra::distributed::Vector<double>;
@@ -65,7 +70,6 @@ double test_mf(std::shared_ptr<boost::property_tree::ptree> params)
   Source<dim> source;
 
   auto laplace_ptree = params->get_child("laplace");
-  int constexpr fe_degree = 1;
   LaplaceMatrixFree<dim, fe_degree, double> mf_laplace(comm);
   mf_laplace.setup_system(laplace_ptree, *material_property);
 
@@ -222,6 +226,177 @@ BOOST_AUTO_TEST_CASE(benchmark_mf)
   test_mf<mfmg::DealIIMatrixFreeMeshEvaluator<2>>(params);
 }
 
+BOOST_AUTO_TEST_CASE(p_multigrid)
+{
+  dealii::MultithreadInfo::set_thread_limit(1);
+
+  auto params = std::make_shared<boost::property_tree::ptree>();
+  boost::property_tree::info_parser::read_info("hierarchy_input.info", *params);
+  params->put("smoother.type", "Chebyshev");
+  params->put("laplace.n_refinements", 4);
+
+  // The reference rate is the one of the hierarchy built directly on the
+  // quadratic discretization, computed in the same run.
+  int constexpr fe_degree = 2;
+  double const ref_rate =
+      test_mf<mfmg::DealIIMatrixFreeMeshEvaluator<2>, fe_degree>(params);
+
+  // The quadratic discretization is coarsened to a linear one before AMGe is
+  // used. The rediscretized level must not degrade the convergence.
+  params->put("p-multigrid", true);
+  double const conv_rate =
+      test_mf<mfmg::DealIIMatrixFreeMeshEvaluator<2>, fe_degree>(params);
+
+  BOOST_TEST(conv_rate < 1.);
+  BOOST_TEST(conv_rate <= ref_rate + 0.05);
+}
+
+BOOST_AUTO_TEST_CASE(geometric_levels)
+{
+  dealii::MultithreadInfo::set_thread_limit(1);
+
+  auto params = std::make_shared<boost::property_tree::ptree>();
+  boost::property_tree::info_parser::read_info("hierarchy_input.info", *params);
+  params->put("smoother.type", "Chebyshev");
+
+  // The reference rate is the one of the hierarchy without geometric levels,
+  // computed in the same run.
+  double const ref_rate =
+      test_mf<mfmg::DealIIMatrixFreeMeshEvaluator<2>>(params);
+
+  // The mesh is coarsened twice before AMGe is used. The geometric levels must
+  // not degrade the convergence.
+  params->put("geometric levels", 2);
+  double const conv_rate =
+      test_mf<mfmg::DealIIMatrixFreeMeshEvaluator<2>>(params);
+
+  BOOST_TEST(conv_rate < 1.);
+  BOOST_TEST(conv_rate <= ref_rate + 0.05);
+}
+
+BOOST_AUTO_TEST_CASE(cell_schwarz_smoother)
+{
+  dealii::MultithreadInfo::set_thread_limit(1);
+
+  auto params = std::make_shared<boost::property_tree::ptree>();
+  boost::property_tree::info_parser::read_info("hierarchy_input.info", *params);
+  params->put("smoother.type", "Chebyshev");
+  params->put("laplace.n_refinements", 4);
+
+  // The reference rate is the one of the Chebyshev smoother preconditioned
+  // by the point diagonal, computed in the same run.
+  int constexpr fe_degree = 3;
+  double const ref_rate =
+      test_mf<mfmg::DealIIMatrixFreeMeshEvaluator<2>, fe_degree>(params);
+
+  // The cell problems capture the coupling of the high-order dofs of a cell
+  // so the smoother must be at least as good as the point diagonal one.
+  params->put("smoother.preconditioner", "cell Schwarz");
+  double const conv_rate =
+      test_mf<mfmg::DealIIMatrixFreeMeshEvaluator<2>, fe_degree>(params);
+
+  BOOST_TEST(conv_rate < 1.);
+  BOOST_TEST(conv_rate <= ref_rate + 0.05);
+}
+
+BOOST_AUTO_TEST_CASE(fast_diagonalization)
+{
+  dealii::MultithreadInfo::set_thread_limit(1);
+
+  auto params = std::make_shared<boost::property_tree::ptree>();
+  boost::property_tree::info_parser::read_info("hierarchy_input.info", *params);
+
+  // The reference rates are those obtained with the default eigensolvers,
+  // computed in the same run. The fast diagonalization computes the modes of
+  // the generalized eigenproblem instead of the standard one, so the rates
+  // are close but not equal.
+  double const ref_rate = test<mfmg::DealIIMeshEvaluator<2>>(params);
+  params->put("smoother.type", "Chebyshev");
+  double const ref_mf_rate =
+      test_mf<mfmg::DealIIMatrixFreeMeshEvaluator<2>>(params);
+
+  params->put("eigensolver.type", "fast_diagonalization");
+  // Make sure that the fast diagonalization is used on every agglomerate
+  // instead of silently falling back to another eigensolver.
+  params->put("eigensolver.fast diagonalization fallback", "none");
+
+  // The block agglomerates of the uniform Cartesian mesh with a constant
+  // coefficient have a tensor-product structure.
+  double const mf_rate =
+      test_mf<mfmg::DealIIMatrixFreeMeshEvaluator<2>>(params);
+  BOOST_TEST(mf_rate < 1.);
+  BOOST_TEST(mf_rate <= ref_mf_rate + 0.05);
+
+  params->put("smoother.type", "Gauss-Seidel");
+  double const rate = test<mfmg::DealIIMeshEvaluator<2>>(params);
+  BOOST_TEST(rate < 1.);
+  BOOST_TEST(rate <= ref_rate + 0.05);
+
+  // The agglomerates of a distorted mesh do not have a tensor-product
+  // structure. The check is only done on one processor since the other
+  // processors would wait for the one that throws.
+  if (dealii::Utilities::MPI::n_mpi_processes(MPI_COMM_WORLD) == 1)
+  {
+    params->put("laplace.distort_random", true);
+    BOOST_CHECK_THROW(test<mfmg::DealIIMeshEvaluator<2>>(params),
+                      std::runtime_error);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(block_lanczos)
+{
+  dealii::MultithreadInfo::set_thread_limit(1);
+
+  auto params = std::make_shared<boost::property_tree::ptree>();
+  boost::property_tree::info_parser::read_info("hierarchy_input.info", *params);
+  // With three eigenvectors, the second eigenvalue of the interior
+  // agglomerates, which is double, is fully captured. The span of the
+  // eigenvectors, and therefore the two-level cycle, does not depend on the
+  // eigensolver.
+  params->put("eigensolver.number of eigenvectors", 3);
+
+  // The reference rates are those obtained with the Lanczos eigensolver,
+  // computed in the same run.
+  params->put("eigensolver.type", "lanczos");
+  double const ref_rate = test<mfmg::DealIIMeshEvaluator<2>>(params);
+  params->put("eigensolver.type", "block_lanczos");
+  double const rate = test<mfmg::DealIIMeshEvaluator<2>>(params);
+  BOOST_TEST(rate < 1.);
+  BOOST_TEST(rate == ref_rate, tt::tolerance(1e-4));
+
+  params->put("smoother.type", "Chebyshev");
+  params->put("eigensolver.type", "lanczos");
+  double const ref_mf_rate =
+      test_mf<mfmg::DealIIMatrixFreeMeshEvaluator<2>>(params);
+  params->put("eigensolver.type", "block_lanczos");
+  double const mf_rate =
+      test_mf<mfmg::DealIIMatrixFreeMeshEvaluator<2>>(params);
+  BOOST_TEST(mf_rate < 1.);
+  BOOST_TEST(mf_rate == ref_mf_rate, tt::tolerance(1e-4));
+}
+
+BOOST_AUTO_TEST_CASE(restriction_drop_tolerance)
+{
+  auto params = std::make_shared<boost::property_tree::ptree>();
+  boost::property_tree::info_parser::read_info("hierarchy_input.info", *params);
+  params->put("eigensolver.number of eigenvectors", 3);
+
+  // A tiny tolerance only drops the zero entries, e.g., the constrained dofs
+  double const ref_rate = test<mfmg::DealIIMeshEvaluator<2>>(params);
+  params->put("eigensolver.drop_tolerance", 1e-14);
+  params->put("eigensolver.drop_rescaling", "none");
+  BOOST_TEST(test<mfmg::DealIIMeshEvaluator<2>>(params) == ref_rate,
+             tt::tolerance(1e-6));
+
+  // The truncated hierarchy still converges
+  params->put("eigensolver.drop_tolerance", 1e-2);
+  for (std::string rescaling : {"row_sum", "norm"})
+  {
+    params->put("eigensolver.drop_rescaling", rescaling);
+    BOOST_TEST(test<mfmg::DealIIMeshEvaluator<2>>(params) < 1.);
+  }
+}
+
 typedef std::tuple<mfmg::DealIIMeshEvaluator<2>,
                    mfmg::DealIIMatrixFreeMeshEvaluator<2>>
     mesh_evaluator_types;
@@ -442,6 +617,55 @@ BOOST_AUTO_TEST_CASE_TEMPLATE(zoltan, MeshEvaluator, mesh_evaluator_types)
   }
 }
 
+BOOST_AUTO_TEST_CASE(additive)
+{
+  dealii::MultithreadInfo::set_thread_limit(1);
+
+  MPI_Comm comm = MPI_COMM_WORLD;
+
+  using DVector = dealii::LinearAlgebra::distributed::Vector<double>;
+  int constexpr dim = 2;
+
+  auto params = std::make_shared<boost::property_tree::ptree>();
+  boost::property_tree::info_parser::read_info("hierarchy_input.info", *params);
+  params->put("is preconditioner", true);
+  params->put("smoother.type", "Symmetric Gauss-Seidel");
+  params->put("cycle", "additive");
+  auto material_property =
+      MaterialPropertyFactory<dim>::create_material_property(
+          params->get<std::string>("material_property.type"));
+  Source<dim> source;
+  auto laplace_ptree = params->get_child("laplace");
+
+  Laplace<dim, DVector> laplace(comm, 1);
+  laplace.setup_system(laplace_ptree);
+  laplace.assemble_system(source, *material_property);
+
+  auto evaluator =
+      std::make_shared<TestMeshEvaluator<mfmg::DealIIMeshEvaluator<dim>>>(
+          laplace._dof_handler, laplace._constraints, 1,
+          laplace._system_matrix, material_property);
+  mfmg::Hierarchy<DVector> hierarchy(comm, evaluator, params);
+
+  // The additive cycle is not meant to be used as a solver, so we compare the
+  // number of CG iterations with and without preconditioner.
+  DVector rhs(laplace._system_rhs);
+  DVector solution(laplace._locally_owned_dofs, comm);
+  double const tolerance = 1e-8 * rhs.l2_norm();
+
+  dealii::SolverControl ref_solver_control(rhs.size(), tolerance);
+  dealii::SolverCG<DVector> ref_solver(ref_solver_control);
+  ref_solver.solve(laplace._system_matrix, solution, rhs,
+                   dealii::PreconditionIdentity());
+
+  solution = 0.;
+  dealii::SolverControl solver_control(rhs.size(), tolerance);
+  dealii::SolverCG<DVector> solver(solver_control);
+  solver.solve(laplace._system_matrix, solution, rhs, hierarchy);
+
+  BOOST_TEST(solver_control.last_step() < ref_solver_control.last_step());
+}
+
 // n_local_rows passed to gimme_a_matrix() must be the same on all processes
 dealii::TrilinosWrappers::SparseMatrix
 gimme_a_matrix(unsigned int n_local_rows, unsigned int n_entries_per_row)
@@ -641,6 +865,519 @@ BOOST_AUTO_TEST_CASE(fast_multiply_transpose_mf)
                    tt::tolerance(1e-9));
 }
 
+BOOST_AUTO_TEST_CASE(matrix_free_diagonal)
+{
+  using DVector = dealii::LinearAlgebra::distributed::Vector<double>;
+  int constexpr dim = 2;
+  int constexpr fe_degree = 2;
+
+  MPI_Comm comm = MPI_COMM_WORLD;
+
+  auto params = std::make_shared<boost::property_tree::ptree>();
+  boost::property_tree::info_parser::read_info("hierarchy_input.info", *params);
+  params->put("laplace.n_refinements", 3);
+  auto material_property =
+      MaterialPropertyFactory<dim>::create_material_property(
+          params->get<std::string>("material_property.type"));
+  Source<dim> source;
+  auto laplace_ptree = params->get_child("laplace");
+
+  Laplace<dim, DVector> laplace(comm, fe_degree);
+  laplace.setup_system(laplace_ptree);
+  laplace.assemble_system(source, *material_property);
+
+  LaplaceMatrixFree<dim, fe_degree, double> mf_laplace(comm);
+  mf_laplace.setup_system(laplace_ptree, *material_property);
+  auto evaluator =
+      std::make_shared<TestMFMeshEvaluator<dim, fe_degree, double>>(
+          mf_laplace._dof_handler, mf_laplace._constraints,
+          mf_laplace._laplace_operator, material_property);
+
+  // The diagonals computed from the cell kernel must match the diagonal of the
+  // assembled matrix. The assembled matrix has arbitrary diagonal entries for
+  // the constrained dofs while the matrix-free diagonal is one.
+  DVector const diagonal = evaluator->get_diagonal();
+  auto const &inverse_diagonal =
+      evaluator->matrix_free_get_diagonal_inverse()->get_vector();
+  for (auto const dof : mf_laplace._locally_owned_dofs)
+  {
+    double const ref_value = mf_laplace._constraints.is_constrained(dof)
+                                 ? 1.
+                                 : laplace._system_matrix.diag_element(dof);
+    BOOST_TEST(diagonal[dof] == ref_value, tt::tolerance(1e-12));
+    BOOST_TEST(inverse_diagonal[dof] * ref_value == 1., tt::tolerance(1e-12));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(matrix_free_agglomerate_view)
+{
+  using DVector = dealii::LinearAlgebra::distributed::Vector<double>;
+  int constexpr dim = 2;
+  int constexpr fe_degree = 2;
+
+  MPI_Comm comm = MPI_COMM_WORLD;
+
+  auto params = std::make_shared<boost::property_tree::ptree>();
+  boost::property_tree::info_parser::read_info("hierarchy_input.info", *params);
+  params->put("laplace.n_refinements", 3);
+  auto material_property =
+      MaterialPropertyFactory<dim>::create_material_property(
+          params->get<std::string>("material_property.type"));
+
+  LaplaceMatrixFree<dim, fe_degree, double> mf_laplace(comm);
+  mf_laplace.setup_system(params->get_child("laplace"), *material_property);
+  TestMFMeshEvaluator<dim, fe_degree, double> evaluator(
+      mf_laplace._dof_handler, mf_laplace._constraints,
+      mf_laplace._laplace_operator, material_property);
+  TestMFMeshEvaluator<dim, fe_degree, double> ref_evaluator(
+      mf_laplace._dof_handler, mf_laplace._constraints,
+      mf_laplace._laplace_operator, material_property);
+  ref_evaluator.set_use_agglomerate_view(false);
+
+  mfmg::AMGe_host<dim, mfmg::DealIIMatrixFreeMeshEvaluator<dim>, DVector> amge(
+      comm, mf_laplace._dof_handler, params->get_child("eigensolver"));
+  unsigned int const n_agglomerates =
+      amge.build_agglomerates(params->get_child("agglomeration"));
+  unsigned int const n_eigenvectors =
+      params->get<unsigned int>("eigensolver.number of eigenvectors");
+  double const tolerance = params->get<double>("eigensolver.tolerance");
+
+  // The operator evaluated on the cells of the global MatrixFree object must
+  // be the operator of the MatrixFree object built for the agglomerate.
+  for (unsigned int agg_id = 1; agg_id <= n_agglomerates; ++agg_id)
+  {
+    dealii::Triangulation<dim> agglomerate_triangulation;
+    std::map<typename dealii::Triangulation<dim>::active_cell_iterator,
+             typename dealii::DoFHandler<dim>::active_cell_iterator>
+        patch_to_global_map;
+    amge.build_agglomerate_triangulation(agg_id, agglomerate_triangulation,
+                                         patch_to_global_map);
+
+    std::vector<std::complex<double>> eigenvalues;
+    std::vector<dealii::Vector<double>> eigenvectors;
+    std::vector<double> diag_elements;
+    std::vector<dealii::types::global_dof_index> dof_indices_map;
+    std::tie(eigenvalues, eigenvectors, diag_elements, dof_indices_map) =
+        amge.compute_local_eigenvectors(n_eigenvectors, tolerance,
+                                        agglomerate_triangulation,
+                                        patch_to_global_map, evaluator,
+                                        mfmg::LobpcgScratchData());
+
+    std::vector<std::complex<double>> ref_eigenvalues;
+    std::vector<double> ref_diag_elements;
+    std::vector<dealii::types::global_dof_index> ref_dof_indices_map;
+    std::tie(ref_eigenvalues, eigenvectors, ref_diag_elements,
+             ref_dof_indices_map) =
+        amge.compute_local_eigenvectors(n_eigenvectors, tolerance,
+                                        agglomerate_triangulation,
+                                        patch_to_global_map, ref_evaluator,
+                                        mfmg::LobpcgScratchData());
+
+    BOOST_TEST(dof_indices_map == ref_dof_indices_map, tt::per_element());
+    BOOST_TEST(diag_elements.size() == ref_diag_elements.size());
+    for (unsigned int i = 0; i < diag_elements.size(); ++i)
+      BOOST_TEST(diag_elements[i] == ref_diag_elements[i],
+                 tt::tolerance(1e-12));
+    // The smallest eigenvalue is zero so the eigenvalues are compared
+    // relatively to the largest one.
+    BOOST_TEST(eigenvalues.size() == ref_eigenvalues.size());
+    double const scale = std::abs(ref_eigenvalues.back());
+    for (unsigned int i = 0; i < eigenvalues.size(); ++i)
+      BOOST_TEST(std::abs(eigenvalues[i] - ref_eigenvalues[i]) <=
+                 1e-10 * scale);
+  }
+}
+
+// Operator that is only available through its action. It is used to exercise
+// the paths of the transfer kernels that do not have access to the rows of
+// the operator.
+template <typename VectorType>
+class ActionOperator final : public mfmg::Operator<VectorType>
+{
+public:
+  using operator_type = mfmg::Operator<VectorType>;
+
+  ActionOperator(std::shared_ptr<operator_type const> op) : _op(op) {}
+
+  void apply(VectorType const &x, VectorType &y,
+             mfmg::OperatorMode mode = mfmg::OperatorMode::NO_TRANS) const
+      override
+  {
+    _op->apply(x, y, mode);
+  }
+
+  std::shared_ptr<operator_type> transpose() const override
+  {
+    return _op->transpose();
+  }
+
+  std::shared_ptr<operator_type>
+  multiply(std::shared_ptr<operator_type const> b) const override
+  {
+    return _op->multiply(b);
+  }
+
+  std::shared_ptr<operator_type>
+  multiply_transpose(std::shared_ptr<operator_type const> b) const override
+  {
+    return _op->multiply_transpose(b);
+  }
+
+  std::shared_ptr<VectorType> build_domain_vector() const override
+  {
+    return _op->build_domain_vector();
+  }
+
+  std::shared_ptr<VectorType> build_range_vector() const override
+  {
+    return _op->build_range_vector();
+  }
+
+  size_t grid_complexity() const override { return _op->grid_complexity(); }
+
+  size_t operator_complexity() const override
+  {
+    return _op->operator_complexity();
+  }
+
+private:
+  std::shared_ptr<operator_type const> _op;
+};
+
+// Return the operator of the Laplace problem and its AMGe restrictor
+template <typename VectorType>
+std::pair<std::shared_ptr<mfmg::Operator<VectorType>>,
+          std::shared_ptr<mfmg::Operator<VectorType>>>
+build_transfer_operators(std::shared_ptr<boost::property_tree::ptree> params)
+{
+  MPI_Comm comm = MPI_COMM_WORLD;
+  int constexpr dim = 2;
+
+  auto material_property =
+      MaterialPropertyFactory<dim>::create_material_property(
+          params->get<std::string>("material_property.type"));
+  Source<dim> source;
+  auto laplace_ptree = params->get_child("laplace");
+
+  Laplace<dim, VectorType> laplace(comm, 1);
+  laplace.setup_system(laplace_ptree);
+  laplace.assemble_system(source, *material_property);
+
+  auto evaluator =
+      std::make_shared<TestMeshEvaluator<mfmg::DealIIMeshEvaluator<dim>>>(
+          laplace._dof_handler, laplace._constraints, 1,
+          laplace._system_matrix, material_property);
+  std::unique_ptr<mfmg::HierarchyHelpers<VectorType>> hierarchy_helpers(
+      new mfmg::DealIIHierarchyHelpers<dim, VectorType>());
+  auto a = hierarchy_helpers->get_global_operator(evaluator);
+  auto restrictor =
+      hierarchy_helpers->build_restrictor(comm, evaluator, params);
+
+  return std::make_pair(a, restrictor);
+}
+
+template <typename VectorType>
+void fill_random(VectorType &x)
+{
+  std::default_random_engine generator(
+      dealii::Utilities::MPI::this_mpi_process(MPI_COMM_WORLD));
+  std::uniform_real_distribution<double> distribution(-1., 1.);
+  for (auto &value : x)
+    value = distribution(generator);
+}
+
+BOOST_AUTO_TEST_CASE(restrict_residual)
+{
+  using DVector = dealii::LinearAlgebra::distributed::Vector<double>;
+
+  auto params = std::make_shared<boost::property_tree::ptree>();
+  boost::property_tree::info_parser::read_info("hierarchy_input.info", *params);
+  std::shared_ptr<mfmg::Operator<DVector>> a;
+  std::shared_ptr<mfmg::Operator<DVector>> restrictor;
+  std::tie(a, restrictor) = build_transfer_operators<DVector>(params);
+
+  auto x = a->build_domain_vector();
+  auto b = a->build_range_vector();
+  fill_random(*x);
+  fill_random(*b);
+
+  // Reference: the residual is stored and then restricted
+  auto residual = a->build_range_vector();
+  a->apply(*x, *residual);
+  residual->add(-1., *b);
+  auto ref = restrictor->build_range_vector();
+  restrictor->apply(*residual, *ref);
+
+  // Fully fused path and path for operators only known through their action
+  ActionOperator<DVector> action_a(a);
+  for (mfmg::Operator<DVector> const *op :
+       {static_cast<mfmg::Operator<DVector> const *>(a.get()),
+        static_cast<mfmg::Operator<DVector> const *>(&action_a)})
+  {
+    auto y = restrictor->build_range_vector();
+    auto work = a->build_range_vector();
+    restrictor->restrict_residual(*op, *x, *b, *y, *work);
+    y->add(-1., *ref);
+    BOOST_TEST(y->l2_norm() <= 1e-12 * ref->l2_norm());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(apply_add)
+{
+  using DVector = dealii::LinearAlgebra::distributed::Vector<double>;
+
+  auto params = std::make_shared<boost::property_tree::ptree>();
+  boost::property_tree::info_parser::read_info("hierarchy_input.info", *params);
+  std::shared_ptr<mfmg::Operator<DVector>> a;
+  std::shared_ptr<mfmg::Operator<DVector>> restrictor;
+  std::tie(a, restrictor) = build_transfer_operators<DVector>(params);
+
+  double const alpha = -0.7;
+  for (auto mode : {mfmg::OperatorMode::NO_TRANS, mfmg::OperatorMode::TRANS})
+  {
+    bool const transpose = (mode == mfmg::OperatorMode::TRANS);
+    auto x = transpose ? restrictor->build_range_vector()
+                       : restrictor->build_domain_vector();
+    auto y = transpose ? restrictor->build_domain_vector()
+                       : restrictor->build_range_vector();
+    fill_random(*x);
+    fill_random(*y);
+
+    // Reference: the product is stored and then added
+    auto ref = transpose ? restrictor->build_domain_vector()
+                         : restrictor->build_range_vector();
+    restrictor->apply(*x, *ref, mode);
+    ref->sadd(alpha, 1., *y);
+
+    restrictor->apply_add(*x, *y, alpha, mode);
+    y->add(-1., *ref);
+    BOOST_TEST(y->l2_norm() <= 1e-12 * ref->l2_norm());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(blocked_transfer_kernels)
+{
+  using DVector = dealii::LinearAlgebra::distributed::Vector<double>;
+
+  // The mesh is refined so that every process has several blocks of rows and
+  // the blocks are processed by several threads.
+  dealii::MultithreadInfo::set_thread_limit(
+      dealii::numbers::invalid_unsigned_int);
+  auto params = std::make_shared<boost::property_tree::ptree>();
+  boost::property_tree::info_parser::read_info("hierarchy_input.info", *params);
+  params->put("laplace.n_refinements", 6);
+  std::shared_ptr<mfmg::Operator<DVector>> a;
+  std::shared_ptr<mfmg::Operator<DVector>> restrictor;
+  std::tie(a, restrictor) = build_transfer_operators<DVector>(params);
+  auto const &r_matrix =
+      *std::dynamic_pointer_cast<mfmg::DealIITrilinosMatrixOperator<DVector>>(
+           restrictor)
+           ->get_matrix();
+  auto const &a_matrix =
+      *std::dynamic_pointer_cast<mfmg::DealIITrilinosMatrixOperator<DVector>>(
+           a)
+           ->get_matrix();
+
+  auto x = a->build_domain_vector();
+  auto b = a->build_range_vector();
+  auto x_coarse = restrictor->build_range_vector();
+  fill_random(*x);
+  fill_random(*b);
+  fill_random(*x_coarse);
+
+  // Unblocked references computed by Trilinos
+  auto residual = a->build_range_vector();
+  a_matrix.vmult(*residual, *x);
+  residual->add(-1., *b);
+  auto ref_coarse = restrictor->build_range_vector();
+  r_matrix.vmult(*ref_coarse, *residual);
+  auto ref_fine = a->build_range_vector();
+  r_matrix.Tvmult(*ref_fine, *x_coarse);
+  ref_fine->add(1., *x);
+
+  ActionOperator<DVector> action_a(a);
+  for (mfmg::Operator<DVector> const *op :
+       {static_cast<mfmg::Operator<DVector> const *>(a.get()),
+        static_cast<mfmg::Operator<DVector> const *>(&action_a)})
+  {
+    auto y = restrictor->build_range_vector();
+    auto work = a->build_range_vector();
+    restrictor->restrict_residual(*op, *x, *b, *y, *work);
+    y->add(-1., *ref_coarse);
+    BOOST_TEST(y->l2_norm() <= 1e-12 * ref_coarse->l2_norm());
+  }
+
+  auto y = a->build_range_vector();
+  *y = *x;
+  restrictor->apply_add(*x_coarse, *y, 1., mfmg::OperatorMode::TRANS);
+  y->add(-1., *ref_fine);
+  BOOST_TEST(y->l2_norm() <= 1e-12 * ref_fine->l2_norm());
+}
+
+BOOST_AUTO_TEST_CASE(sparsification)
+{
+  MPI_Comm comm = MPI_COMM_WORLD;
+
+  using DVector = dealii::LinearAlgebra::distributed::Vector<double>;
+  int constexpr dim = 2;
+
+  auto params = std::make_shared<boost::property_tree::ptree>();
+  boost::property_tree::info_parser::read_info("hierarchy_input.info", *params);
+  auto material_property =
+      MaterialPropertyFactory<dim>::create_material_property(
+          params->get<std::string>("material_property.type"));
+  Source<dim> source;
+  auto laplace_ptree = params->get_child("laplace");
+
+  Laplace<dim, DVector> laplace(comm, 1);
+  laplace.setup_system(laplace_ptree);
+  laplace.assemble_system(source, *material_property);
+
+  auto evaluator =
+      std::make_shared<TestMeshEvaluator<mfmg::DealIIMeshEvaluator<2>>>(
+          laplace._dof_handler, laplace._constraints, 1,
+          laplace._system_matrix, material_property);
+  std::unique_ptr<mfmg::HierarchyHelpers<DVector>> hierarchy_helpers(
+      new mfmg::DealIIHierarchyHelpers<dim, DVector>());
+  auto a = hierarchy_helpers->get_global_operator(evaluator);
+  auto restrictor =
+      hierarchy_helpers->build_restrictor(comm, evaluator, params);
+  auto a_coarse = restrictor->multiply(a->multiply_transpose(restrictor));
+  auto get_matrix = [](std::shared_ptr<mfmg::Operator<DVector>> op) {
+    return std::dynamic_pointer_cast<
+               mfmg::DealIITrilinosMatrixOperator<DVector>>(op)
+        ->get_matrix();
+  };
+  auto const matrix = get_matrix(a_coarse);
+
+  // Without any room in the safeguard, no entry is dropped
+  auto sparsified = get_matrix(a_coarse->sparsify(1., 0.));
+  BOOST_TEST(sparsified->n_nonzero_elements() == matrix->n_nonzero_elements());
+
+  // The drop tolerance is chosen between the smallest and the largest
+  // relative magnitudes |a_ij| / sqrt(a_ii a_jj) of the off-diagonal entries
+  // so that, without safeguard, some entries are dropped and some are kept.
+  dealii::IndexSet const &locally_owned_rows =
+      matrix->locally_owned_range_indices();
+  dealii::IndexSet locally_relevant_columns = locally_owned_rows;
+  for (auto const row : locally_owned_rows)
+    for (auto entry = matrix->begin(row); entry != matrix->end(row); ++entry)
+      locally_relevant_columns.add_index(entry->column());
+  DVector diagonal(locally_owned_rows, locally_relevant_columns, comm);
+  for (auto const row : locally_owned_rows)
+    diagonal[row] = matrix->diag_element(row);
+  diagonal.update_ghost_values();
+  double min_magnitude = std::numeric_limits<double>::max();
+  double max_magnitude = 0.;
+  for (auto const row : locally_owned_rows)
+    for (auto entry = matrix->begin(row); entry != matrix->end(row); ++entry)
+      if ((entry->column() != row) && (entry->value() != 0.))
+      {
+        double const magnitude =
+            std::abs(entry->value()) /
+            std::sqrt(diagonal[row] * diagonal[entry->column()]);
+        min_magnitude = std::min(min_magnitude, magnitude);
+        max_magnitude = std::max(max_magnitude, magnitude);
+      }
+  min_magnitude = dealii::Utilities::MPI::min(min_magnitude, comm);
+  max_magnitude = dealii::Utilities::MPI::max(max_magnitude, comm);
+  BOOST_REQUIRE(min_magnitude < max_magnitude);
+  double const drop_tolerance = std::sqrt(min_magnitude * max_magnitude);
+  sparsified = get_matrix(a_coarse->sparsify(drop_tolerance, 1e10));
+  BOOST_TEST(sparsified->n_nonzero_elements() < matrix->n_nonzero_elements());
+  BOOST_TEST(sparsified->n_nonzero_elements() > sparsified->m());
+
+  // The sparsified matrix A_s is symmetric and A <= A_s <= A + safeguard D.
+  // The bounds are checked with random vectors.
+  double const safeguard = 0.5;
+  auto safeguarded = get_matrix(a_coarse->sparsify(drop_tolerance, safeguard));
+  std::default_random_engine generator(
+      dealii::Utilities::MPI::this_mpi_process(comm));
+  std::uniform_real_distribution<double> distribution(-1., 1.);
+  auto x = a_coarse->build_domain_vector();
+  auto y = a_coarse->build_domain_vector();
+  auto ax = a_coarse->build_range_vector();
+  auto sx = a_coarse->build_range_vector();
+  auto sy = a_coarse->build_range_vector();
+  for (unsigned int i = 0; i < 10; ++i)
+  {
+    for (auto &value : *x)
+      value = distribution(generator);
+    for (auto &value : *y)
+      value = distribution(generator);
+    matrix->vmult(*ax, *x);
+    sparsified->vmult(*sx, *x);
+    sparsified->vmult(*sy, *y);
+    BOOST_TEST(std::abs((*sx) * (*y) - (*sy) * (*x)) <=
+               1e-12 * sx->l2_norm() * y->l2_norm());
+    double const energy = (*ax) * (*x);
+    BOOST_TEST((*sx) * (*x) >= energy * (1. - 1e-12));
+
+    safeguarded->vmult(*sx, *x);
+    double diagonal_energy = 0.;
+    for (auto const row : locally_owned_rows)
+      diagonal_energy += diagonal[row] * (*x)[row] * (*x)[row];
+    diagonal_energy = dealii::Utilities::MPI::sum(diagonal_energy, comm);
+    BOOST_TEST((*sx) * (*x) >= energy * (1. - 1e-12));
+    BOOST_TEST((*sx) * (*x) <=
+               energy + safeguard * diagonal_energy * (1. + 1e-12));
+  }
+
+  // The non-Galerkin hierarchy still converges
+  params->put("max levels", 3);
+  params->put("sparsification.drop_tolerance", 0.1);
+  BOOST_TEST(test<mfmg::DealIIMeshEvaluator<2>>(params) < 1.);
+}
+
+BOOST_AUTO_TEST_CASE(smoother_zero_initial_guess)
+{
+  MPI_Comm comm = MPI_COMM_WORLD;
+
+  using DVector = dealii::LinearAlgebra::distributed::Vector<double>;
+  int constexpr dim = 2;
+
+  auto params = std::make_shared<boost::property_tree::ptree>();
+  boost::property_tree::info_parser::read_info("hierarchy_input.info", *params);
+  auto material_property =
+      MaterialPropertyFactory<dim>::create_material_property(
+          params->get<std::string>("material_property.type"));
+  Source<dim> source;
+
+  Laplace<dim, DVector> laplace(comm, 1);
+  laplace.setup_system(params->get_child("laplace"));
+  laplace.assemble_system(source, *material_property);
+
+  auto evaluator =
+      std::make_shared<TestMeshEvaluator<mfmg::DealIIMeshEvaluator<2>>>(
+          laplace._dof_handler, laplace._constraints, 1,
+          laplace._system_matrix, material_property);
+  mfmg::DealIIHierarchyHelpers<dim, DVector> hierarchy_helpers;
+  auto a = hierarchy_helpers.get_global_operator(evaluator);
+
+  for (std::string smoother_type :
+       {"Symmetric Gauss-Seidel", "Gauss-Seidel", "Jacobi"})
+  {
+    params->put("smoother.type", smoother_type);
+    mfmg::DealIISmoother<DVector> smoother(a, params);
+
+    auto b = a->build_range_vector();
+    for (unsigned int i = 0; i < b->local_size(); ++i)
+      b->local_element(i) = (i % 7) + 1.;
+
+    auto ref_x = a->build_domain_vector();
+    *ref_x = 0.;
+    smoother.apply(*b, *ref_x);
+
+    // The input value of x is ignored
+    auto x = a->build_domain_vector();
+    *x = 1.;
+    smoother.apply_zero_initial_guess(*b, *x);
+
+    x->add(-1., *ref_x);
+    BOOST_TEST(x->l2_norm() <= 1e-12 * ref_x->l2_norm());
+  }
+}
+
 using material_properties =
     std::tuple<ConstantMaterialProperty<2>, LinearMaterialProperty<2>,
                LinearXMaterialProperty<2>, DiscontinuousMaterialProperty<2>>;
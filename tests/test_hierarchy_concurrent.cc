@@ -0,0 +1,107 @@
+/**************************************************************************
+ * Copyright (c) 2017-2019 by the mfmg authors                            *
+ * All rights reserved.                                                   *
+ *                                                                        *
+ * This file is part of the mfmg library. mfmg is distributed under a BSD *
+ * 3-clause license. For the licensing terms see the LICENSE file in the  *
+ * top-level directory                                                    *
+ *                                                                        *
+ * SPDX-License-Identifier: BSD-3-Clause                                  *
+ **************************************************************************/
+
+#define BOOST_TEST_MODULE hierarchy_concurrent
+// The code paths tested here call MPI from several threads at the same time
+#define MFMG_TEST_MPI_THREAD_MULTIPLE
+
+#include <mfmg/common/hierarchy.hpp>
+
+#include <deal.II/lac/la_parallel_vector.h>
+
+#include <boost/property_tree/info_parser.hpp>
+
+#include <random>
+#include <string>
+
+#include "laplace.hpp"
+#include "main.cc"
+#include "test_hierarchy_helpers.hpp"
+
+// Check that setting \p option does not change the result of the cycle. The
+// cycle is applied several times to make sure that the concurrent work of
+// the hierarchy does not interfere with itself.
+void check_concurrent_hierarchy(
+    std::shared_ptr<boost::property_tree::ptree> params,
+    std::string const &option)
+{
+  int thread_support = MPI_THREAD_SINGLE;
+  MPI_Query_thread(&thread_support);
+  BOOST_REQUIRE(thread_support == MPI_THREAD_MULTIPLE);
+
+  MPI_Comm comm = MPI_COMM_WORLD;
+  using DVector = dealii::LinearAlgebra::distributed::Vector<double>;
+  int constexpr dim = 2;
+
+  auto material_property =
+      MaterialPropertyFactory<dim>::create_material_property(
+          params->get<std::string>("material_property.type"));
+  Source<dim> source;
+  auto laplace_ptree = params->get_child("laplace");
+
+  Laplace<dim, DVector> laplace(comm, 1);
+  laplace.setup_system(laplace_ptree);
+  laplace.assemble_system(source, *material_property);
+
+  auto evaluator =
+      std::make_shared<TestMeshEvaluator<mfmg::DealIIMeshEvaluator<dim>>>(
+          laplace._dof_handler, laplace._constraints, 1,
+          laplace._system_matrix, material_property);
+  mfmg::Hierarchy<DVector> ref_hierarchy(comm, evaluator, params);
+  params->put(option, true);
+  mfmg::Hierarchy<DVector> hierarchy(comm, evaluator, params);
+
+  DVector b(laplace._locally_owned_dofs, comm);
+  std::default_random_engine generator(
+      dealii::Utilities::MPI::this_mpi_process(comm));
+  std::uniform_real_distribution<double> distribution(-1., 1.);
+  for (auto &value : b)
+    value = distribution(generator);
+
+  DVector ref_x(b);
+  DVector x(b);
+  for (unsigned int i = 0; i < 5; ++i)
+  {
+    ref_hierarchy.vmult(ref_x, b);
+    hierarchy.vmult(x, b);
+    x.add(-1., ref_x);
+    BOOST_TEST(x.l2_norm() <= 1e-12 * ref_x.l2_norm());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(additive_concurrent_levels)
+{
+  auto params = std::make_shared<boost::property_tree::ptree>();
+  boost::property_tree::info_parser::read_info("hierarchy_input.info", *params);
+  params->put("is preconditioner", true);
+  params->put("smoother.type", "Symmetric Gauss-Seidel");
+  params->put("cycle", "additive");
+  params->put("max levels", 3);
+
+  // The corrections of the levels do not depend on each other, so computing
+  // them concurrently, each level on its own communicator, does not change
+  // the result.
+  check_concurrent_hierarchy(params, "additive.concurrent levels");
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_setup)
+{
+  auto params = std::make_shared<boost::property_tree::ptree>();
+  boost::property_tree::info_parser::read_info("hierarchy_input.info", *params);
+  params->put("is preconditioner", true);
+  params->put("smoother.type", "Symmetric Gauss-Seidel");
+  params->put("max levels", 3);
+
+  // The smoothers and the coarse solver are built by tasks on their own
+  // communicators from copies of the level operators, which does not change
+  // the hierarchy.
+  check_concurrent_hierarchy(params, "concurrent setup");
+}
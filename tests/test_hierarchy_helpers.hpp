@@ -13,10 +13,13 @@
 #define MFMG_TEST_HIERARCHY_HELPERS_HPP
 
 #include <mfmg/common/hierarchy.hpp>
+#include <mfmg/dealii/dealii_matrix_free_agglomerate_view.hpp>
+#include <mfmg/dealii/dealii_matrix_free_cell_kernel_evaluator.hpp>
 #include <mfmg/dealii/dealii_matrix_free_mesh_evaluator.hpp>
 #include <mfmg/dealii/dealii_mesh_evaluator.hpp>
 
 #include <deal.II/base/conditional_ostream.h>
+#include <deal.II/distributed/tria.h>
 #include <deal.II/dofs/dof_accessor.h>
 #include <deal.II/fe/fe_q.h>
 #include <deal.II/lac/la_parallel_vector.h>
@@ -306,19 +309,120 @@ private:
   std::shared_ptr<dealii::Function<dim>> _material_property;
 };
 
+// Create a triangulation with the same coarse mesh as the globally refined
+// triangulation @p fine_triangulation and one less global refinement. Only the
+// vertices and the cells of the coarse mesh are copied: manifolds are not.
+template <int dim>
+void create_coarser_triangulation(
+    dealii::Triangulation<dim> const &fine_triangulation,
+    dealii::Triangulation<dim> &coarse_triangulation)
+{
+  std::map<unsigned int, unsigned int> vertex_map;
+  std::vector<dealii::Point<dim>> vertices;
+  std::vector<dealii::CellData<dim>> cells;
+  for (auto const &cell : fine_triangulation.cell_iterators_on_level(0))
+  {
+    dealii::CellData<dim> cell_data;
+    for (unsigned int v = 0; v < dealii::GeometryInfo<dim>::vertices_per_cell;
+         ++v)
+    {
+      auto const vertex = vertex_map.emplace(cell->vertex_index(v),
+                                             vertices.size());
+      if (vertex.second)
+        vertices.push_back(cell->vertex(v));
+      cell_data.vertices[v] = vertex.first->second;
+    }
+    cell_data.material_id = cell->material_id();
+    cells.push_back(cell_data);
+  }
+  coarse_triangulation.create_triangulation(vertices, cells,
+                                            dealii::SubCellData());
+  coarse_triangulation.refine_global(fine_triangulation.n_global_levels() - 2);
+
+  // Set the boundary id to one
+  for (auto const &cell : coarse_triangulation.active_cell_iterators())
+    for (unsigned int f = 0; f < dealii::GeometryInfo<dim>::faces_per_cell; ++f)
+      if (cell->face(f)->at_boundary())
+        cell->face(f)->set_boundary_id(1);
+}
+
+// Data of a rediscretized level. A polynomial coarsening level shares the
+// triangulation of the finest level while a geometric level owns a coarser
+// triangulation.
+template <int dim, int fe_degree, typename ScalarType>
+struct MatrixFreeLevelData
+{
+  MatrixFreeLevelData(dealii::Triangulation<dim> const &triangulation)
+      : fe(fe_degree), dof_handler(triangulation)
+  {
+  }
+
+  MatrixFreeLevelData(
+      std::unique_ptr<dealii::Triangulation<dim>> level_triangulation)
+      : triangulation(std::move(level_triangulation)), fe(fe_degree),
+        dof_handler(*triangulation)
+  {
+  }
+
+  template <typename MaterialPropertyType>
+  void setup(MaterialPropertyType const &material_property)
+  {
+    dof_handler.distribute_dofs(fe);
+
+    dealii::IndexSet locally_relevant_dofs;
+    dealii::DoFTools::extract_locally_relevant_dofs(dof_handler,
+                                                    locally_relevant_dofs);
+    constraints.reinit(locally_relevant_dofs);
+    dealii::DoFTools::make_hanging_node_constraints(dof_handler, constraints);
+    dealii::VectorTools::interpolate_boundary_values(
+        dof_handler, 1, dealii::Functions::ZeroFunction<dim>(), constraints);
+    constraints.close();
+
+    typename dealii::MatrixFree<dim, ScalarType>::AdditionalData
+        additional_data;
+    additional_data.tasks_parallel_scheme =
+        dealii::MatrixFree<dim, ScalarType>::AdditionalData::none;
+    additional_data.mapping_update_flags = dealii::update_gradients |
+                                           dealii::update_JxW_values |
+                                           dealii::update_quadrature_points;
+    auto mf_storage = std::make_shared<dealii::MatrixFree<dim, ScalarType>>();
+    mf_storage->reinit(dof_handler, constraints,
+                       dealii::QGauss<1>(fe_degree + 1), additional_data);
+    laplace_operator.initialize(mf_storage);
+    laplace_operator.evaluate_coefficient(material_property);
+    laplace_operator.compute_diagonal();
+  }
+
+  std::unique_ptr<dealii::Triangulation<dim>> triangulation;
+  dealii::FE_Q<dim> fe;
+  dealii::DoFHandler<dim> dof_handler;
+  dealii::AffineConstraints<double> constraints;
+  LaplaceOperator<dim, fe_degree, ScalarType> laplace_operator;
+};
+
 template <int dim, int fe_degree, typename ScalarType>
 class TestMFMeshEvaluator final
-    : public mfmg::DealIIMatrixFreeMeshEvaluator<dim>
+    : public mfmg::DealIIMatrixFreeCellKernelEvaluator<dim, fe_degree>
 {
 public:
+  using FEEvaluation = typename mfmg::DealIIMatrixFreeCellKernelEvaluator<
+      dim, fe_degree>::FEEvaluation;
+  using AgglomerateView = typename mfmg::DealIIMatrixFreeCellKernelEvaluator<
+      dim, fe_degree>::AgglomerateView;
+
   TestMFMeshEvaluator(
       dealii::DoFHandler<dim> &dof_handler,
       dealii::AffineConstraints<double> &constraints,
       LaplaceOperator<dim, fe_degree, ScalarType> &laplace_operator,
-      std::shared_ptr<Coefficient<dim>> material_property)
-      : mfmg::DealIIMatrixFreeMeshEvaluator<dim>(dof_handler, constraints),
+      std::shared_ptr<Coefficient<dim>> material_property,
+      std::shared_ptr<void> level_data = nullptr)
+      : mfmg::DealIIMatrixFreeCellKernelEvaluator<dim, fe_degree>(dof_handler,
+                                                                  constraints),
         _material_property(material_property), _fe(fe_degree),
-        _laplace_operator(laplace_operator)
+        _laplace_operator(laplace_operator), _level_data(level_data),
+        _cell_batch_map(std::make_shared<mfmg::CellBatchMap const>(
+            mfmg::build_cell_batch_map(
+                *laplace_operator.get_matrix_free())))
   {
   }
 
@@ -328,43 +432,81 @@ public:
   // they are set up in matrix_free_initialize_agglomerate only.
   TestMFMeshEvaluator(
       TestMFMeshEvaluator<dim, fe_degree, ScalarType> const &_other_evaluator)
-      : mfmg::DealIIMatrixFreeMeshEvaluator<dim>(*this),
+      : mfmg::DealIIMatrixFreeCellKernelEvaluator<dim, fe_degree>(
+            _other_evaluator),
         _material_property(_other_evaluator._material_property),
         _fe(_other_evaluator._fe),
-        _laplace_operator(_other_evaluator._laplace_operator)
+        _laplace_operator(_other_evaluator._laplace_operator),
+        _level_data(_other_evaluator._level_data),
+        _cell_batch_map(_other_evaluator._cell_batch_map),
+        _use_agglomerate_view(_other_evaluator._use_agglomerate_view)
   {
   }
 
   virtual ~TestMFMeshEvaluator() override = default;
 
+  // When false, the agglomerate operators are always evaluated on a
+  // MatrixFree object built for the agglomerate.
+  void set_use_agglomerate_view(bool const use_agglomerate_view)
+  {
+    _use_agglomerate_view = use_agglomerate_view;
+  }
+
   virtual std::unique_ptr<mfmg::DealIIMatrixFreeMeshEvaluator<dim>>
   clone() const override
   {
     return std::make_unique<TestMFMeshEvaluator>(*this);
   }
 
-  virtual void
-  matrix_free_evaluate_agglomerate(dealii::Vector<double> const &src,
-                                   dealii::Vector<double> &dst) const override
+  virtual std::shared_ptr<mfmg::DealIIMatrixFreeMeshEvaluator<dim>>
+  build_coarser_degree_evaluator() const override
   {
-    // Unfortunately, dealii::MatrixFreeOperators::Base only supports
-    // dealii::LinearAlgebra::distributed::Vector so unless we duplicate a lot
-    // of code, we need copy src and dst.
-    std::copy(src.begin(), src.end(), distributed_src.begin());
-    _agg_laplace_operator->vmult(distributed_dst, distributed_src);
-    std::copy(distributed_dst.begin(), distributed_dst.end(), dst.begin());
+    int constexpr coarse_fe_degree = fe_degree > 1 ? fe_degree / 2 : 1;
+    using LevelData =
+        MatrixFreeLevelData<dim, coarse_fe_degree, ScalarType>;
+    auto level_data = std::make_shared<LevelData>(
+        this->_dof_handler.get_triangulation());
+    level_data->setup(*_material_property);
+
+    return std::make_shared<
+        TestMFMeshEvaluator<dim, coarse_fe_degree, ScalarType>>(
+        level_data->dof_handler, level_data->constraints,
+        level_data->laplace_operator, _material_property, level_data);
   }
 
-  virtual std::vector<double> matrix_free_get_agglomerate_diagonal(
-      dealii::AffineConstraints<double> &constraints) const override
+  virtual std::shared_ptr<mfmg::DealIIMatrixFreeMeshEvaluator<dim>>
+  build_coarser_mesh_evaluator() const override
   {
-    constraints.copy_from(_agg_constraints);
-
-    auto diag_matrix = _agg_laplace_operator->get_matrix_diagonal();
-    auto diag_dealii_vector = diag_matrix->get_vector();
+    auto const &fine_triangulation =
+        dynamic_cast<dealii::parallel::distributed::Triangulation<dim> const &>(
+            this->_dof_handler.get_triangulation());
+    auto coarse_triangulation =
+        std::make_unique<dealii::parallel::distributed::Triangulation<dim>>(
+            fine_triangulation.get_communicator());
+    create_coarser_triangulation(fine_triangulation, *coarse_triangulation);
+
+    using LevelData = MatrixFreeLevelData<dim, fe_degree, ScalarType>;
+    auto level_data = std::make_shared<LevelData>(
+        std::unique_ptr<dealii::Triangulation<dim>>(
+            std::move(coarse_triangulation)));
+    level_data->setup(*_material_property);
+
+    return std::make_shared<TestMFMeshEvaluator<dim, fe_degree, ScalarType>>(
+        level_data->dof_handler, level_data->constraints,
+        level_data->laplace_operator, _material_property, level_data);
+  }
 
-    return std::vector<double>(diag_dealii_vector.begin(),
-                               diag_dealii_vector.end());
+  virtual void matrix_free_evaluate_agglomerate(
+      dealii::LinearAlgebra::distributed::Vector<double> const &src,
+      dealii::LinearAlgebra::distributed::Vector<double> &dst) const override
+  {
+    if (_agg_view)
+      _agg_view->vmult(dst, src,
+                       [&](FEEvaluation &fe_eval, unsigned int const cell) {
+                         apply_cell(fe_eval, cell);
+                       });
+    else
+      _agg_laplace_operator->vmult(dst, src);
   }
 
   virtual void matrix_free_evaluate_global(
@@ -374,40 +516,75 @@ public:
     _laplace_operator.vmult(dst, src);
   }
 
-  virtual std::shared_ptr<dealii::DiagonalMatrix<
-      dealii::LinearAlgebra::distributed::Vector<double>>>
-  matrix_free_get_diagonal_inverse() const override
+  // The diagonals are computed from the cell kernel by
+  // DealIIMatrixFreeCellKernelEvaluator.
+  virtual dealii::MatrixFree<dim, double> const &
+  get_matrix_free() const override
+  {
+    return *_laplace_operator.get_matrix_free();
+  }
+
+  virtual void apply_cell(FEEvaluation &fe_eval,
+                          unsigned int const cell) const override
   {
-    return _laplace_operator.get_matrix_diagonal_inverse();
+    _laplace_operator.apply_cell(fe_eval, cell);
   }
 
-  virtual dealii::LinearAlgebra::distributed::Vector<double>
-  get_diagonal() override
+  virtual dealii::AffineConstraints<double> const &
+  get_agglomerate_constraints() const override
   {
-    auto vector = _laplace_operator.get_matrix_diagonal()->get_vector();
-    vector.update_ghost_values();
+    return _agg_constraints;
+  }
 
-    return vector;
+  virtual AgglomerateView const *get_agglomerate_view() const override
+  {
+    return _agg_view.get();
+  }
+
+  virtual dealii::MatrixFree<dim, double> const *
+  get_agglomerate_matrix_free() const override
+  {
+    return _agg_laplace_operator
+               ? _agg_laplace_operator->get_matrix_free().get()
+               : nullptr;
+  }
+
+  virtual void apply_agglomerate_cell(FEEvaluation &fe_eval,
+                                      unsigned int const cell) const override
+  {
+    // The coefficient of the agglomerate operator is stored per cell batch of
+    // the agglomerate MatrixFree object.
+    _agg_laplace_operator->apply_cell(fe_eval, cell);
   }
 
   virtual void matrix_free_initialize_agglomerate(
-      dealii::DoFHandler<dim> &dof_handler) const override
+      dealii::DoFHandler<dim> &dof_handler,
+      std::map<typename dealii::Triangulation<dim>::active_cell_iterator,
+               typename dealii::DoFHandler<dim>::active_cell_iterator> const
+          &patch_to_global_map) const override
   {
-    // FIXME dof_handler should be const and initialized somewhere else
-    dof_handler.distribute_dofs(_fe);
+    // Agglomerates that contain ghost cells cannot be evaluated on the global
+    // MatrixFree object.
+    if (!_use_agglomerate_view ||
+        !mfmg::is_in_cell_batch_map<dim>(*_cell_batch_map,
+                                         patch_to_global_map))
+    {
+      matrix_free_initialize_agglomerate(dof_handler);
+      return;
+    }
 
-    dealii::IndexSet locally_relevant_dofs;
-    dealii::DoFTools::extract_locally_relevant_dofs(dof_handler,
-                                                    locally_relevant_dofs);
-    // Compute the constraints
-    _agg_constraints.clear();
-    _agg_constraints.reinit(locally_relevant_dofs);
-    dealii::DoFTools::make_hanging_node_constraints(dof_handler,
-                                                    _agg_constraints);
-    dealii::VectorTools::interpolate_boundary_values(
-        dof_handler, 1, dealii::Functions::ZeroFunction<dim>(),
-        _agg_constraints);
-    _agg_constraints.close();
+    initialize_agglomerate_constraints(dof_handler);
+    _agg_laplace_operator.reset();
+    _agg_view = std::make_unique<AgglomerateView>(
+        *_laplace_operator.get_matrix_free(), *_cell_batch_map, dof_handler,
+        patch_to_global_map, _agg_constraints);
+  }
+
+  virtual void matrix_free_initialize_agglomerate(
+      dealii::DoFHandler<dim> &dof_handler) const override
+  {
+    initialize_agglomerate_constraints(dof_handler);
+    _agg_view.reset();
 
     // Initialize the MatrixFree object
     typename dealii::MatrixFree<dim, ScalarType>::AdditionalData
@@ -432,23 +609,41 @@ public:
         std::make_unique<LaplaceOperator<dim, fe_degree, ScalarType>>();
     _agg_laplace_operator->initialize(mf_storage);
     _agg_laplace_operator->evaluate_coefficient(*_material_property);
-    _agg_laplace_operator->compute_diagonal();
-
-    distributed_dst.reinit(dof_handler.n_dofs());
-    distributed_src.reinit(dof_handler.n_dofs());
   }
 
 private:
+  void initialize_agglomerate_constraints(
+      dealii::DoFHandler<dim> &dof_handler) const
+  {
+    // FIXME dof_handler should be const and initialized somewhere else
+    dof_handler.distribute_dofs(_fe);
+
+    dealii::IndexSet locally_relevant_dofs;
+    dealii::DoFTools::extract_locally_relevant_dofs(dof_handler,
+                                                    locally_relevant_dofs);
+    // Compute the constraints
+    _agg_constraints.clear();
+    _agg_constraints.reinit(locally_relevant_dofs);
+    dealii::DoFTools::make_hanging_node_constraints(dof_handler,
+                                                    _agg_constraints);
+    dealii::VectorTools::interpolate_boundary_values(
+        dof_handler, 1, dealii::Functions::ZeroFunction<dim>(),
+        _agg_constraints);
+    _agg_constraints.close();
+  }
+
   std::shared_ptr<Coefficient<dim>> _material_property;
   dealii::FE_Q<dim> _fe;
   mutable dealii::AffineConstraints<double> _agg_constraints;
   LaplaceOperator<dim, fe_degree, ScalarType> &_laplace_operator;
+  // Keep alive the data referenced by the evaluators of the polynomial
+  // coarsening levels.
+  std::shared_ptr<void> _level_data;
   mutable std::unique_ptr<LaplaceOperator<dim, fe_degree, ScalarType>>
       _agg_laplace_operator;
-  mutable dealii::LinearAlgebra::distributed::Vector<ScalarType>
-      distributed_dst;
-  mutable dealii::LinearAlgebra::distributed::Vector<ScalarType>
-      distributed_src;
+  std::shared_ptr<mfmg::CellBatchMap const> _cell_batch_map;
+  mutable std::unique_ptr<AgglomerateView> _agg_view;
+  bool _use_agglomerate_view = true;
 };
 
 #endif // #ifdef MFMG_TEST_HIERARCHY_HELPERS_HPP
@@ -11,6 +11,7 @@
 
 #define BOOST_TEST_MODULE lanczos
 
+#include <mfmg/common/block_lanczos.templates.hpp>
 #include <mfmg/common/lanczos.templates.hpp>
 
 #include <boost/test/data/test_case.hpp>
@@ -107,3 +108,152 @@ BOOST_DATA_TEST_CASE(lanczos,
     BOOST_TEST(result.l2_norm() < tolerance);
   }
 }
+
+BOOST_AUTO_TEST_CASE(lanczos_workspace)
+{
+  using namespace mfmg;
+
+  using VectorType = dealii::Vector<double>;
+  using OperatorType = SimpleOperator<VectorType>;
+
+  int const n_eigenvectors = 5;
+  boost::property_tree::ptree lanczos_params;
+  lanczos_params.put("num_eigenpairs", n_eigenvectors);
+  lanczos_params.put("max_iterations", 2000);
+  lanczos_params.put("tolerance", 1e-2);
+  lanczos_params.put("percent_overshoot", 5);
+
+  // Reuse the same workspace for operators of decreasing and increasing sizes.
+  // The results must be the same as without workspace.
+  std::vector<VectorType> workspace;
+  for (int const n : {1000, 300, 700})
+  {
+    OperatorType op(n);
+    VectorType initial_guess(n);
+    initial_guess = 1.;
+
+    std::vector<double> ref_evals;
+    std::vector<VectorType> ref_evecs;
+    Lanczos<OperatorType, VectorType> ref_solver(op);
+    std::tie(ref_evals, ref_evecs) =
+        ref_solver.solve(lanczos_params, initial_guess);
+
+    std::vector<double> computed_evals;
+    std::vector<VectorType> computed_evecs;
+    Lanczos<OperatorType, VectorType> solver(op, workspace);
+    std::tie(computed_evals, computed_evecs) =
+        solver.solve(lanczos_params, initial_guess);
+
+    BOOST_TEST(!workspace.empty());
+    BOOST_TEST(computed_evals == ref_evals, tt::per_element());
+    for (int i = 0; i < n_eigenvectors; ++i)
+    {
+      BOOST_TEST(computed_evecs[i].size() == static_cast<unsigned int>(n));
+      computed_evecs[i] -= ref_evecs[i];
+      BOOST_TEST(computed_evecs[i].l2_norm() == 0.);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(lanczos_time_budget)
+{
+  using namespace mfmg;
+
+  using VectorType = dealii::Vector<double>;
+  using OperatorType = SimpleOperator<VectorType>;
+
+  int const n = 1000;
+  int const n_eigenvectors = 5;
+  int const max_iterations = 900;
+
+  OperatorType op(n);
+
+  // The tolerance cannot be reached so the solver stops because of the time
+  // budget, as soon as enough Ritz pairs are available.
+  boost::property_tree::ptree lanczos_params;
+  lanczos_params.put("num_eigenpairs", n_eigenvectors);
+  lanczos_params.put("max_iterations", max_iterations);
+  lanczos_params.put("tolerance", 0.);
+  lanczos_params.put("time_budget", 1e-12);
+
+  VectorType initial_guess(n);
+  initial_guess = 1.;
+
+  std::vector<VectorType> workspace;
+  Lanczos<OperatorType, VectorType> solver(op, workspace);
+  std::vector<double> computed_evals;
+  std::vector<VectorType> computed_evecs;
+  std::tie(computed_evals, computed_evecs) =
+      solver.solve(lanczos_params, initial_guess);
+
+  BOOST_TEST(computed_evals.size() == n_eigenvectors);
+  BOOST_TEST(computed_evecs.size() == n_eigenvectors);
+  BOOST_TEST(workspace.size() < static_cast<size_t>(max_iterations));
+  for (int i = 0; i < n_eigenvectors; ++i)
+    BOOST_TEST(computed_evecs[i].l2_norm() == 1., tt::tolerance(1e-6));
+
+  BlockLanczos<OperatorType, VectorType> block_solver(op);
+  std::tie(computed_evals, computed_evecs) =
+      block_solver.solve(lanczos_params, initial_guess);
+
+  BOOST_TEST(computed_evals.size() == n_eigenvectors);
+  BOOST_TEST(computed_evecs.size() == n_eigenvectors);
+}
+
+BOOST_DATA_TEST_CASE(block_lanczos,
+                     bdata::make({1, 2, 3}) * bdata::make({1, 2, 5}),
+                     multiplicity, n_distinct_eigenvalues)
+{
+  using namespace mfmg;
+
+  using VectorType = dealii::Vector<double>;
+  using OperatorType = SimpleOperator<VectorType>;
+
+  int const n = 1000;
+  int const n_eigenvectors = n_distinct_eigenvalues * multiplicity;
+
+  OperatorType op(n, multiplicity);
+
+  // The block size defaults to the number of eigenpairs so that the repeated
+  // eigenvalues are captured without deflation cycles.
+  boost::property_tree::ptree lanczos_params;
+  lanczos_params.put("num_eigenpairs", n_eigenvectors);
+  lanczos_params.put("max_iterations", 2000);
+  lanczos_params.put("tolerance", 1e-2);
+
+  BlockLanczos<OperatorType, VectorType> solver(op);
+
+  VectorType initial_guess(n);
+  initial_guess = 1.;
+
+  // Add random noise to the guess
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<double> dist(0, 1);
+  std::transform(initial_guess.begin(), initial_guess.end(),
+                 initial_guess.begin(), [&](auto &v) { return v + dist(gen); });
+
+  std::vector<double> computed_evals;
+  std::vector<VectorType> computed_evecs;
+  std::tie(computed_evals, computed_evecs) =
+      solver.solve(lanczos_params, initial_guess);
+
+  auto ref_evals = op.get_evals();
+  std::sort(ref_evals.begin(), ref_evals.end());
+
+  BOOST_TEST(computed_evals.size() == n_eigenvectors);
+
+  double const tolerance = lanczos_params.get<double>("tolerance");
+  for (int i = 0; i < n_eigenvectors; i++)
+    BOOST_TEST(computed_evals[i] == ref_evals[i], tt::tolerance(tolerance));
+
+  // The eigenvectors of a repeated eigenvalue must be orthogonal
+  for (int i = 0; i < n_eigenvectors; i++)
+  {
+    VectorType result(n);
+    op.vmult(result, computed_evecs[i]);
+    result.add(-computed_evals[i], computed_evecs[i]);
+    BOOST_TEST(result.l2_norm() < tolerance);
+    for (int j = 0; j < i; j++)
+      BOOST_TEST(std::abs(computed_evecs[i] * computed_evecs[j]) < 1e-8);
+  }
+}
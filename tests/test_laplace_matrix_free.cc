@@ -133,3 +133,32 @@ BOOST_AUTO_TEST_CASE(laplace_3d)
   ExactSolution<dim> exact_solution;
   BOOST_TEST(laplace.compute_error(exact_solution) == 0., tt::tolerance(1e-14));
 }
+
+BOOST_AUTO_TEST_CASE(diagonal)
+{
+  int constexpr dim = 2;
+  int constexpr fe_degree = 2;
+
+  MaterialProperty<dim> material_property;
+
+  LaplaceMatrixFree<dim, fe_degree, double> laplace(MPI_COMM_WORLD);
+  boost::property_tree::ptree params;
+  params.put("n_refinements", 2);
+  laplace.setup_system(params, material_property);
+
+  // Compare the cell-wise diagonal with the one obtained by applying the
+  // operator to the global unit vectors.
+  auto const &diagonal =
+      laplace._laplace_operator.get_matrix_diagonal()->get_vector();
+  dealii::LinearAlgebra::distributed::Vector<double> src(diagonal);
+  dealii::LinearAlgebra::distributed::Vector<double> dst(diagonal);
+  for (dealii::types::global_dof_index i = 0; i < diagonal.size(); ++i)
+  {
+    src = 0.;
+    if (diagonal.in_local_range(i))
+      src[i] = 1.;
+    laplace._laplace_operator.vmult(dst, src);
+    if (diagonal.in_local_range(i))
+      BOOST_TEST(dst[i] == diagonal[i], tt::tolerance(1e-12));
+  }
+}
@@ -23,6 +23,7 @@
 #include <boost/property_tree/info_parser.hpp>
 #include <boost/test/data/test_case.hpp>
 
+#include <algorithm>
 #include <random>
 
 #include "laplace.hpp"
@@ -167,6 +168,91 @@ BOOST_AUTO_TEST_CASE(restriction_matrix, *utf::tolerance(1e-14))
   }
 }
 
+// Expose the computation of the sparsity pattern of the restriction matrix
+template <int dim>
+class SparsityPatternAMGe
+    : public mfmg::AMGe_host<dim, mfmg::DealIIMeshEvaluator<dim>,
+                             dealii::LinearAlgebra::distributed::Vector<double>>
+{
+public:
+  SparsityPatternAMGe(MPI_Comm comm, dealii::DoFHandler<dim> const &dof_handler)
+      : mfmg::AMGe_host<dim, mfmg::DealIIMeshEvaluator<dim>,
+                        dealii::LinearAlgebra::distributed::Vector<double>>(
+            comm, dof_handler)
+  {
+  }
+
+  using mfmg::AMGe<dim, dealii::LinearAlgebra::distributed::Vector<double>>::
+      compute_restriction_sparsity_pattern;
+};
+
+BOOST_AUTO_TEST_CASE(restriction_sparsity_pattern)
+{
+  unsigned int constexpr dim = 2;
+
+  MPI_Comm comm = MPI_COMM_WORLD;
+  dealii::parallel::distributed::Triangulation<dim> triangulation(comm);
+  dealii::GridGenerator::hyper_cube(triangulation);
+  triangulation.refine_global(3);
+  dealii::FE_Q<dim> fe(1);
+  dealii::DoFHandler<dim> dof_handler(triangulation);
+  dof_handler.distribute_dofs(fe);
+  SparsityPatternAMGe<dim> amge(comm, dof_handler);
+
+  boost::property_tree::ptree agglomerate_params;
+  agglomerate_params.put("partitioner", "block");
+  agglomerate_params.put("nx", 2);
+  agglomerate_params.put("ny", 2);
+  unsigned int const n_agglomerates =
+      amge.build_agglomerates(agglomerate_params);
+
+  // The number of eigenvectors differs between the agglomerates
+  std::vector<unsigned int> n_local_eigenvectors(n_agglomerates);
+  for (unsigned int i = 0; i < n_agglomerates; ++i)
+    n_local_eigenvectors[i] = 1 + i % 3;
+
+  // Compute the pattern from the dof maps of the agglomerates
+  std::vector<std::vector<dealii::types::global_dof_index>> dof_indices_maps;
+  std::vector<dealii::Vector<double>> eigenvectors;
+  for (unsigned int i = 0; i < n_agglomerates; ++i)
+  {
+    dealii::Triangulation<dim> agglomerate_triangulation;
+    std::map<typename dealii::Triangulation<dim>::active_cell_iterator,
+             typename dealii::DoFHandler<dim>::active_cell_iterator>
+        agglomerate_to_global_tria_map;
+    amge.build_agglomerate_triangulation(i + 1, agglomerate_triangulation,
+                                         agglomerate_to_global_tria_map);
+    dealii::DoFHandler<dim> agglomerate_dof_handler(agglomerate_triangulation);
+    agglomerate_dof_handler.distribute_dofs(fe);
+    dof_indices_maps.push_back(amge.compute_dof_index_map(
+        agglomerate_to_global_tria_map, agglomerate_dof_handler));
+    for (unsigned int j = 0; j < n_local_eigenvectors[i]; ++j)
+      eigenvectors.emplace_back(dof_indices_maps.back().size());
+  }
+  auto const ref_sp = amge.compute_restriction_sparsity_pattern(
+      eigenvectors, dof_indices_maps, n_local_eigenvectors);
+
+  // The user index of the cells that are not locally owned must be ignored
+  for (auto cell : dof_handler.active_cell_iterators())
+    if (!cell->is_locally_owned())
+      cell->set_user_index(1);
+  auto const sp =
+      amge.compute_restriction_sparsity_pattern(n_local_eigenvectors);
+
+  BOOST_TEST(sp.n_rows() == ref_sp.n_rows());
+  BOOST_TEST(sp.n_cols() == ref_sp.n_cols());
+  BOOST_TEST(sp.n_nonzero_elements() == ref_sp.n_nonzero_elements());
+  auto const local_range = ref_sp.local_range();
+  BOOST_TEST(sp.local_range().first == local_range.first);
+  BOOST_TEST(sp.local_range().second == local_range.second);
+  for (auto row = local_range.first; row < local_range.second; ++row)
+  {
+    BOOST_TEST(sp.row_length(row) == ref_sp.row_length(row));
+    for (auto entry = ref_sp.begin(row); entry != ref_sp.end(row); ++entry)
+      BOOST_TEST(sp.exists(row, entry->column()));
+  }
+}
+
 template <int dim>
 class Source : public dealii::Function<dim>
 {
@@ -352,3 +438,71 @@ BOOST_DATA_TEST_CASE(weight_sum, bdata::make({"lapack", "lanczos"}),
     BOOST_TEST(ee.l1_norm() == 1., tt::tolerance(2e-4));
   }
 }
+
+BOOST_AUTO_TEST_CASE(dirichlet_agglomerates)
+{
+  // Agglomerates made of a single cell at the corner of the domain have a
+  // single dof that is not on the Dirichlet boundary. Their number of
+  // eigenvectors is clamped.
+  unsigned int constexpr dim = 2;
+  using DVector = dealii::LinearAlgebra::distributed::Vector<double>;
+  using MeshEvaluator = mfmg::DealIIMeshEvaluator<dim>;
+
+  MPI_Comm comm = MPI_COMM_WORLD;
+
+  auto params = std::make_shared<boost::property_tree::ptree>();
+  boost::property_tree::info_parser::read_info("hierarchy_input.info", *params);
+  params->put("eigensolver.type", "lapack");
+  params->put("laplace.n_refinements", 3);
+  boost::property_tree::ptree agglomerate_ptree;
+  agglomerate_ptree.put("partitioner", "block");
+  agglomerate_ptree.put("nx", 1);
+  agglomerate_ptree.put("ny", 1);
+  unsigned int const n_eigenvectors = 3;
+
+  Source<dim> source;
+  ConstantMaterialProperty<dim> material_property;
+  Laplace<dim, DVector> laplace(comm, 1);
+  laplace.setup_system(params->get_child("laplace"));
+  laplace.assemble_system(source, material_property);
+
+  TestMeshEvaluator<dim> evaluator(laplace._dof_handler, laplace._constraints,
+                                   laplace._system_matrix);
+  mfmg::AMGe_host<dim, MeshEvaluator, DVector> amge(
+      comm, laplace._dof_handler, params->get_child("eigensolver"));
+
+  dealii::TrilinosWrappers::SparseMatrix restriction;
+  amge.setup_restrictor(agglomerate_ptree, n_eigenvectors, 1e-14, evaluator,
+                        evaluator.get_diagonal(), restriction);
+
+  // Every cell contributes as many rows as it has unconstrained dofs, up to
+  // n_eigenvectors.
+  unsigned int n_local_rows = 0;
+  std::vector<dealii::types::global_dof_index> dof_indices(
+      laplace._fe.dofs_per_cell);
+  for (auto cell : dealii::filter_iterators(
+           laplace._dof_handler.active_cell_iterators(),
+           dealii::IteratorFilters::LocallyOwnedCell()))
+  {
+    cell->get_dof_indices(dof_indices);
+    unsigned int const n_free_dofs = std::count_if(
+        dof_indices.begin(), dof_indices.end(),
+        [&](dealii::types::global_dof_index const dof) {
+          return !laplace._constraints.is_constrained(dof);
+        });
+    n_local_rows += std::min(n_eigenvectors, n_free_dofs);
+  }
+  BOOST_TEST(restriction.m() ==
+             dealii::Utilities::MPI::sum(n_local_rows, comm));
+
+  // None of the rows is empty.
+  auto const local_range = restriction.local_range();
+  for (auto row = local_range.first; row < local_range.second; ++row)
+  {
+    double row_norm = 0.;
+    for (auto entry = restriction.begin(row); entry != restriction.end(row);
+         ++entry)
+      row_norm += std::abs(entry->value());
+    BOOST_TEST(row_norm > 0.);
+  }
+}
@@ -0,0 +1,87 @@
+/**************************************************************************
+ * Copyright (c) 2017-2019 by the mfmg authors                            *
+ * All rights reserved.                                                   *
+ *                                                                        *
+ * This file is part of the mfmg library. mfmg is distributed under a BSD *
+ * 3-clause license. For the licensing terms see the LICENSE file in the  *
+ * top-level directory                                                    *
+ *                                                                        *
+ * SPDX-License-Identifier: BSD-3-Clause                                  *
+ *************************************************************************/
+
+#define BOOST_TEST_MODULE shared_memory_import
+
+#include <mfmg/dealii/shared_memory_import.hpp>
+
+#include <Epetra_Import.h>
+#include <Epetra_Map.h>
+#include <Epetra_MpiComm.h>
+#include <Epetra_Vector.h>
+
+#include <boost/test/data/test_case.hpp>
+
+#include <vector>
+
+#include "main.cc"
+
+namespace bdata = boost::unit_test::data;
+
+// When emulate_nodes is true, the processors are split between two fake nodes
+// so that some of the ghost values are communicated by Epetra.
+BOOST_DATA_TEST_CASE(shared_memory_import, bdata::make({false, true}),
+                     emulate_nodes)
+{
+  MPI_Comm comm = MPI_COMM_WORLD;
+  int const n_procs = dealii::Utilities::MPI::n_mpi_processes(comm);
+  int const rank = dealii::Utilities::MPI::this_mpi_process(comm);
+  Epetra_MpiComm epetra_comm(comm);
+
+  // Every processor owns a contiguous range of indices. The target map
+  // contains the owned indices in reverse order followed by a few indices of
+  // every other processor.
+  int const n_owned = 10 + rank;
+  int const n_global = n_procs * 10 + n_procs * (n_procs - 1) / 2;
+  int const offset = rank * 10 + rank * (rank - 1) / 2;
+  Epetra_Map source_map(n_global, n_owned, 0, epetra_comm);
+  std::vector<int> target_gids;
+  for (int i = n_owned - 1; i >= 0; --i)
+    target_gids.push_back(offset + i);
+  for (int p = 0; p < n_procs; ++p)
+    if (p != rank)
+    {
+      int const p_offset = p * 10 + p * (p - 1) / 2;
+      for (int i : {0, 3, 9})
+        target_gids.push_back(p_offset + i);
+    }
+  Epetra_Map target_map(-1, target_gids.size(), target_gids.data(), 0,
+                        epetra_comm);
+
+  MPI_Comm node_comm = MPI_COMM_NULL;
+  if (emulate_nodes)
+  {
+    // The processors of a fake node must share memory, which they do since
+    // the tests run on a single node.
+    MPI_Comm_split(comm, rank % 2, rank, &node_comm);
+  }
+  mfmg::SharedMemoryImport shared_memory_import(source_map, target_map,
+                                                node_comm);
+  Epetra_Import epetra_import(target_map, source_map);
+
+  // The values change between the imports to check that the buffers of the
+  // shared memory window are not mixed up.
+  Epetra_Vector source(source_map);
+  Epetra_Vector ref_target(target_map);
+  std::vector<double> target(target_gids.size());
+  for (int k = 0; k < 4; ++k)
+  {
+    for (int i = 0; i < n_owned; ++i)
+      source[i] = 1000. * k + offset + i;
+    ref_target.Import(source, epetra_import, Insert);
+    shared_memory_import.import(source.Values(), target.data());
+    for (unsigned int i = 0; i < target.size(); ++i)
+      BOOST_TEST(target[i] == ref_target[i]);
+  }
+
+  if (node_comm != MPI_COMM_NULL)
+    MPI_Comm_free(&node_comm);
+}
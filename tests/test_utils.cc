@@ -11,13 +11,24 @@
 
 #define BOOST_TEST_MODULE utils
 
+#include <mfmg/common/communication_profiler.hpp>
+#include <mfmg/common/thread_pinning.hpp>
 #include <mfmg/common/utils.hpp>
 
+#include <deal.II/base/parallel.h>
+
 #include <Teuchos_ParameterList.hpp>
 
 #include <boost/property_tree/info_parser.hpp>
 #include <boost/property_tree/ptree.hpp>
 
+#include <mutex>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
 #include "main.cc"
 
 BOOST_AUTO_TEST_CASE(plist2ptree)
@@ -85,3 +96,69 @@ BOOST_AUTO_TEST_CASE(sorting)
 
   BOOST_TEST(reference == vec_2);
 }
+
+BOOST_AUTO_TEST_CASE(communication_profiler)
+{
+  using mfmg::CommunicationProfiler;
+
+  // Only test the attribution of the counters to the stages. The counters are
+  // recorded by hand because the MPI wrappers may not be enabled.
+  CommunicationProfiler::reset();
+  CommunicationProfiler::enter(1, "smoother");
+  CommunicationProfiler::record(2, 0, 64, 1.);
+  CommunicationProfiler::enter(-1, "inner");
+  CommunicationProfiler::record(0, 1, 8, 0.5);
+  CommunicationProfiler::leave();
+  CommunicationProfiler::record(1, 0, 16, 1.);
+  CommunicationProfiler::leave();
+
+  auto const statistics = CommunicationProfiler::get_statistics();
+  BOOST_TEST(statistics.size() == 2);
+  auto const &smoother = statistics.at(std::make_pair(1, "smoother"));
+  BOOST_TEST(smoother.n_messages == 3);
+  BOOST_TEST(smoother.n_collectives == 0);
+  BOOST_TEST(smoother.n_bytes == 80);
+  BOOST_TEST(smoother.time == 2.);
+  auto const &inner = statistics.at(std::make_pair(1, "inner"));
+  BOOST_TEST(inner.n_messages == 0);
+  BOOST_TEST(inner.n_collectives == 1);
+  BOOST_TEST(inner.n_bytes == 8);
+
+  CommunicationProfiler::reset();
+  BOOST_TEST(CommunicationProfiler::get_statistics().empty());
+}
+
+BOOST_AUTO_TEST_CASE(thread_pinning)
+{
+#if defined(DEAL_II_WITH_THREADS) && defined(__linux__)
+  cpu_set_t process_mask;
+  CPU_ZERO(&process_mask);
+  sched_getaffinity(0, sizeof(process_mask), &process_mask);
+
+  BOOST_TEST(mfmg::pin_threads());
+
+  // Every thread that executes a task is pinned to a single core of the
+  // initial affinity mask of the process.
+  std::mutex mutex;
+  std::vector<cpu_set_t> masks;
+  dealii::parallel::apply_to_subranges(
+      0, 1000,
+      [&](unsigned int const, unsigned int const) {
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        sched_getaffinity(0, sizeof(mask), &mask);
+        std::lock_guard<std::mutex> lock(mutex);
+        masks.push_back(mask);
+      },
+      1);
+  BOOST_TEST(mfmg::get_n_unpinned_threads() == 0);
+  for (auto &mask : masks)
+  {
+    BOOST_TEST(CPU_COUNT(&mask) == 1);
+    CPU_AND(&mask, &mask, &process_mask);
+    BOOST_TEST(CPU_COUNT(&mask) == 1);
+  }
+#else
+  BOOST_TEST(!mfmg::pin_threads());
+#endif
+}